@@ -0,0 +1,122 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "ActiveSetEngine.h"
+#include "SimKernel.h"
+
+ActiveSetEngine::ActiveSetEngine()
+    : m_topology( NULL )
+    , m_activeCount( 0 )
+    , m_levelChangeCount( 0 )
+{
+}
+
+ActiveSetEngine::~ActiveSetEngine()
+{
+    // ...
+}
+
+void ActiveSetEngine::Reset( const SimTopology& topology, const SimPowerPlane& )
+{
+    m_topology = &topology;
+    m_activeCount = 0;
+    m_levelChangeCount = 0;
+
+    int tileCount = topology.GetTileCount();
+    m_isQueued.assign( tileCount, 0 );
+    m_worklist.clear();
+    m_changedIndices.clear();
+    m_changedPowers.clear();
+
+    m_dependencyOffsets.clear();
+    for( int i = 0; i < SimKernel::cDependencyOffsetCount; i++ )
+    {
+        m_dependencyOffsets.push_back( SimKernel::cDependencyOffsets[ i ].y * topology.GetStride() + SimKernel::cDependencyOffsets[ i ].x );
+    }
+
+    // Nothing is known about the given state, so everything is evaluated once
+    for( int i = 0; i < tileCount; i++ )
+    {
+        if( topology.GetType( i ) != WireSim::cSimType_None )
+        {
+            m_isQueued[ i ] = 1;
+            m_worklist.push_back( i );
+        }
+    }
+}
+
+void ActiveSetEngine::Touch( int linearIndex )
+{
+    QueueDependents( linearIndex );
+}
+
+int ActiveSetEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    // Evaluate everything against the current state before writing anything
+    for( int i = 0; i < (int)m_worklist.size(); i++ )
+    {
+        int linearIndex = m_worklist[ i ];
+        m_isQueued[ linearIndex ] = 0;
+
+        WireSim::SimPower newPower = SimKernel::EvaluateTile( topology, power, linearIndex );
+        if( newPower != power.Get( linearIndex ) )
+        {
+            m_changedIndices.push_back( linearIndex );
+            m_changedPowers.push_back( (uint8_t)newPower );
+        }
+    }
+
+    m_activeCount = (int)m_worklist.size();
+    m_worklist.clear();
+
+    // Apply, and queue up whatever these changes can affect
+    int changeCount = (int)m_changedIndices.size();
+    m_levelChangeCount = 0;
+    for( int i = 0; i < changeCount; i++ )
+    {
+        int oldPower = power.Get( m_changedIndices[ i ] );
+        if( SimKernel::Settle( (WireSim::SimPower)m_changedPowers[ i ] ) != SimKernel::Settle( (WireSim::SimPower)oldPower ) )
+        {
+            m_levelChangeCount++;
+        }
+        if( changesOut )
+        {
+            changesOut->AddTile( m_changedIndices[ i ], oldPower, m_changedPowers[ i ] );
+        }
+
+        power.Set( m_changedIndices[ i ], m_changedPowers[ i ] );
+        QueueDependents( m_changedIndices[ i ] );
+    }
+
+    m_changedIndices.clear();
+    m_changedPowers.clear();
+
+    return changeCount;
+}
+
+int ActiveSetEngine::GetActiveCount() const
+{
+    return m_activeCount;
+}
+
+int ActiveSetEngine::GetLevelChangeCount() const
+{
+    return m_levelChangeCount;
+}
+
+void ActiveSetEngine::QueueDependents( int linearIndex )
+{
+    for( int i = 0; i < (int)m_dependencyOffsets.size(); i++ )
+    {
+        int dependentIndex = linearIndex + m_dependencyOffsets[ i ];
+        if( m_isQueued[ dependentIndex ] == 0 && m_topology->GetType( dependentIndex ) != WireSim::cSimType_None )
+        {
+            m_isQueued[ dependentIndex ] = 1;
+            m_worklist.push_back( dependentIndex );
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Event-driven engine; only evaluates tiles that
+ can change. A tile's next state depends on a small set of
+ surrounding tiles (see SimKernel), so if none of those has
+ changed since it was last evaluated, neither will it. Every
+ tile changed by a step (or written by SetInput) queues its
+ dependents for the next step, and only those are evaluated.
+ The cost of a step scales with activity, not board size.
+
+***/
+
+#ifndef __ACTIVESETENGINE_H__
+#define __ACTIVESETENGINE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimEngine.h"
+
+class ActiveSetEngine : public SimEngine
+{
+
+public:
+
+    ActiveSetEngine();
+    virtual ~ActiveSetEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Number of tiles evaluated by the last step, and of tiles whose level (not just edge) it changed
+    int GetActiveCount() const;
+    int GetLevelChangeCount() const;
+
+protected:
+
+    // Queue every tile that depends on the given tile for the next step
+    void QueueDependents( int linearIndex );
+
+private:
+
+    // Tiles to evaluate on the next step, and a flag per tile to keep that list unique
+    std::vector< int > m_worklist;
+    std::vector< uint8_t > m_isQueued;
+
+    // Changes found by the current step; applied once every active tile has been evaluated
+    std::vector< int > m_changedIndices;
+    std::vector< uint8_t > m_changedPowers;
+
+    // Topology of the attached simulation; empty tiles never change, so they are never queued
+    const SimTopology* m_topology;
+
+    // SimKernel::cDependencyOffsets as index offsets; the border makes them valid for every tile
+    std::vector< int > m_dependencyOffsets;
+
+    // Tiles evaluated / changed in level by the last step
+    int m_activeCount;
+    int m_levelChangeCount;
+
+};
+
+#endif // __ACTIVESETENGINE_H__
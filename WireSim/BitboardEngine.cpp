@@ -0,0 +1,301 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "BitboardEngine.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace
+{
+    // Tiles per bit plane word
+    const int cTilesPerWord = 64;
+
+    // Empty rows above and below the image, and empty words left and right of each row
+    const int cPaddingRows = 2;
+    const int cPaddingWords = 1;
+
+    // Word of tiles offset by dx columns from the given word, so bit i holds tile ( i + dx ); dx in [-2, 2]
+    inline uint64_t Shift( const uint64_t* word, int dx )
+    {
+        if( dx < 0 )
+        {
+            return ( word[ 0 ] << -dx ) | ( word[ -1 ] >> ( cTilesPerWord + dx ) );
+        }
+        else if( dx > 0 )
+        {
+            return ( word[ 0 ] >> dx ) | ( word[ 1 ] << ( cTilesPerWord - dx ) );
+        }
+        return word[ 0 ];
+    }
+
+    // Index of the lowest set bit; word must be non-zero
+    inline int LowestBit( uint64_t word )
+    {
+        #if defined( _MSC_VER )
+            unsigned long index = 0;
+            if( _BitScanForward( &index, (unsigned long)word ) )
+            {
+                return (int)index;
+            }
+            _BitScanForward( &index, (unsigned long)( word >> 32 ) );
+            return (int)index + 32;
+        #else
+            return __builtin_ctzll( word );
+        #endif
+    }
+}
+
+BitboardEngine::BitboardEngine()
+    : m_width( 0 )
+    , m_height( 0 )
+    , m_stride( 0 )
+{
+}
+
+BitboardEngine::~BitboardEngine()
+{
+    // ...
+}
+
+void BitboardEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    m_width = topology.GetWidth();
+    m_height = topology.GetHeight();
+    m_stride = ( m_width + cTilesPerWord - 1 ) / cTilesPerWord + cPaddingWords * 2;
+    m_touchedIndices.clear();
+
+    for( int i = 0; i < cPlaneCount; i++ )
+    {
+        m_planes[ i ].assign( ( m_height + cPaddingRows * 2 ) * m_stride, 0 );
+    }
+
+    for( int y = 0; y < m_height; y++ )
+    {
+        for( int x = 0; x < m_width; x++ )
+        {
+            uint64_t bit = (uint64_t)1 << ( x % cTilesPerWord );
+            int wordX = x / cTilesPerWord;
+
+            switch( topology.GetType( x, y ) )
+            {
+                case WireSim::cSimType_WireType0:
+                case WireSim::cSimType_WireType1:
+                    *GetWord( cPlane_Wire, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_NotGate:
+                    *GetWord( cPlane_Not, wordX, y ) |= bit;
+                    *GetWord( cPlane_JumpOrNot, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_JumpJoint:
+                    *GetWord( cPlane_JumpOrNot, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_AndGate:
+                    *GetWord( cPlane_And, wordX, y ) |= bit;
+                    *GetWord( cPlane_Gate, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_OrGate:
+                    *GetWord( cPlane_Or, wordX, y ) |= bit;
+                    *GetWord( cPlane_Gate, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_XorGate:
+                    *GetWord( cPlane_Xor, wordX, y ) |= bit;
+                    *GetWord( cPlane_Gate, wordX, y ) |= bit;
+                    break;
+
+                case WireSim::cSimType_None:
+                default:
+                    break;
+            }
+
+            LoadTile( topology, power, x, y );
+        }
+    }
+}
+
+void BitboardEngine::Touch( int linearIndex )
+{
+    m_touchedIndices.push_back( linearIndex );
+}
+
+int BitboardEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    // Pick up any writes made since the last step
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        LoadTile( topology, power, topology.GetX( m_touchedIndices[ i ] ), topology.GetY( m_touchedIndices[ i ] ) );
+    }
+    m_touchedIndices.clear();
+
+    // Every row of inputs has to be ready before any row is evaluated
+    for( int y = 0; y < m_height; y++ )
+    {
+        EvaluateInputs( y );
+    }
+
+    for( int y = 0; y < m_height; y++ )
+    {
+        EvaluateRow( y );
+    }
+
+    // Write back only the tiles that changed
+    int changeCount = 0;
+    int rowWordCount = m_stride - cPaddingWords * 2;
+    for( int y = 0; y < m_height; y++ )
+    {
+        for( int wordX = 0; wordX < rowWordCount; wordX++ )
+        {
+            uint64_t high = *GetWord( cPlane_NextHigh, wordX, y );
+            uint64_t edge = *GetWord( cPlane_NextEdge, wordX, y );
+            uint64_t changed = ( high ^ *GetWord( cPlane_High, wordX, y ) ) | ( edge ^ *GetWord( cPlane_Edge, wordX, y ) );
+
+            while( changed != 0 )
+            {
+                int bitIndex = LowestBit( changed );
+                changed &= changed - 1;
+
+                int index = topology.GetIndex( wordX * cTilesPerWord + bitIndex, y );
+                int powerLevel = (int)( ( high >> bitIndex ) & 1 ) * 2 + (int)( ( edge >> bitIndex ) & 1 );
+                if( changesOut )
+                {
+                    changesOut->AddTile( index, power.Get( index ), powerLevel );
+                }
+                power.Set( index, powerLevel );
+                changeCount++;
+            }
+        }
+    }
+
+    m_planes[ cPlane_High ].swap( m_planes[ cPlane_NextHigh ] );
+    m_planes[ cPlane_Edge ].swap( m_planes[ cPlane_NextEdge ] );
+
+    return changeCount;
+}
+
+uint64_t* BitboardEngine::GetWord( Plane plane, int wordX, int y )
+{
+    return &m_planes[ plane ][ ( y + cPaddingRows ) * m_stride + wordX + cPaddingWords ];
+}
+
+void BitboardEngine::LoadTile( const SimTopology& topology, const SimPowerPlane& power, int x, int y )
+{
+    int powerLevel = power.Get( topology.GetIndex( x, y ) );
+    uint64_t bit = (uint64_t)1 << ( x % cTilesPerWord );
+    int wordX = x / cTilesPerWord;
+
+    uint64_t& high = *GetWord( cPlane_High, wordX, y );
+    uint64_t& edge = *GetWord( cPlane_Edge, wordX, y );
+    high = ( powerLevel & 0x2 ) ? ( high | bit ) : ( high & ~bit );
+    edge = ( powerLevel & 0x1 ) ? ( edge | bit ) : ( edge & ~bit );
+}
+
+void BitboardEngine::EvaluateInputs( int y )
+{
+    int rowWordCount = m_stride - cPaddingWords * 2;
+    for( int wordX = 0; wordX < rowWordCount; wordX++ )
+    {
+        uint64_t wire = *GetWord( cPlane_Wire, wordX, y );
+        uint64_t edge = *GetWord( cPlane_Edge, wordX, y );
+        *GetWord( cPlane_SettledWire, wordX, y ) = wire & ~edge;
+        *GetWord( cPlane_EdgeWire, wordX, y ) = wire & edge;
+
+        uint64_t gate = *GetWord( cPlane_Gate, wordX, y );
+        if( gate == 0 )
+        {
+            *GetWord( cPlane_GateResult, wordX, y ) = 0;
+            continue;
+        }
+
+        // Gates read settled wires on their four corners
+        uint64_t on[ 4 ];
+        uint64_t anyOn = 0;
+        uint64_t anyOff = 0;
+        for( int i = 0; i < 4; i++ )
+        {
+            int dx = ( i == 0 || i == 3 ) ? -1 : 1;
+            int dy = ( i < 2 ) ? -1 : 1;
+
+            uint64_t cornerHigh = Shift( GetWord( cPlane_High, wordX, y + dy ), dx );
+            uint64_t cornerValid = Shift( GetWord( cPlane_Wire, wordX, y + dy ), dx ) & ~Shift( GetWord( cPlane_Edge, wordX, y + dy ), dx );
+
+            on[ i ] = cornerValid & cornerHigh;
+            anyOn |= on[ i ];
+            anyOff |= cornerValid & ~cornerHigh;
+        }
+
+        uint64_t twoOrMoreOn = ( on[ 0 ] & on[ 1 ] ) | ( on[ 0 ] & on[ 2 ] ) | ( on[ 0 ] & on[ 3 ] ) |
+                               ( on[ 1 ] & on[ 2 ] ) | ( on[ 1 ] & on[ 3 ] ) | ( on[ 2 ] & on[ 3 ] );
+        uint64_t oneOn = anyOn & ~twoOrMoreOn;
+
+        *GetWord( cPlane_GateResult, wordX, y ) =
+            ( *GetWord( cPlane_And, wordX, y ) & twoOrMoreOn & ~anyOff ) |
+            ( *GetWord( cPlane_Or, wordX, y ) & anyOn & anyOff ) |
+            ( *GetWord( cPlane_Xor, wordX, y ) & oneOn & anyOff );
+    }
+}
+
+void BitboardEngine::EvaluateRow( int y )
+{
+    // Writers in reverse scan order (bottom, right, left, top), as offsets to the writer
+    static const int cWriterX[ 4 ] = { 0, 1, -1, 0 };
+    static const int cWriterY[ 4 ] = { 1, 0, 0, -1 };
+
+    int rowWordCount = m_stride - cPaddingWords * 2;
+    for( int wordX = 0; wordX < rowWordCount; wordX++ )
+    {
+        uint64_t high = *GetWord( cPlane_High, wordX, y );
+        uint64_t settledWire = *GetWord( cPlane_SettledWire, wordX, y );
+
+        // Edges settle (except on undefined tiles), and only settled wires can be written to
+        uint64_t defined = *GetWord( cPlane_Wire, wordX, y ) | *GetWord( cPlane_JumpOrNot, wordX, y ) | *GetWord( cPlane_Gate, wordX, y );
+        uint64_t nextEdge = *GetWord( cPlane_Edge, wordX, y ) & ~defined;
+        uint64_t nextHigh = high;
+
+        if( settledWire != 0 )
+        {
+            uint64_t unclaimed = settledWire;
+            for( int i = 0; i < 4; i++ )
+            {
+                int dx = cWriterX[ i ];
+                int dy = cWriterY[ i ];
+
+                uint64_t writerHigh = Shift( GetWord( cPlane_High, wordX, y + dy ), dx );
+
+                // Wires on an edge spread their new level
+                uint64_t toggles = Shift( GetWord( cPlane_EdgeWire, wordX, y + dy ), dx ) & ( writerHigh ^ high );
+
+                // Jump joints / not-gates pass on their source (on the far side of the writer); low ones
+                // write right and down, so only to us if they are left / above, and high ones the opposite
+                uint64_t writesToUs = ( dx + dy > 0 ) ? writerHigh : ~writerHigh;
+                uint64_t sourceHigh = Shift( GetWord( cPlane_High, wordX, y + dy * 2 ), dx * 2 );
+                toggles |= Shift( GetWord( cPlane_JumpOrNot, wordX, y + dy ), dx ) & writesToUs &
+                           Shift( GetWord( cPlane_SettledWire, wordX, y + dy * 2 ), dx * 2 ) &
+                           ( sourceHigh ^ Shift( GetWord( cPlane_Not, wordX, y + dy ), dx ) ^ high );
+
+                // Gates pulse an edge of the current level when their result differs
+                uint64_t pulses = Shift( GetWord( cPlane_Gate, wordX, y + dy ), dx ) &
+                                  ( Shift( GetWord( cPlane_GateResult, wordX, y + dy ), dx ) ^ high );
+
+                // The first writer found is the last one to write
+                toggles &= unclaimed;
+                pulses &= unclaimed;
+                nextHigh ^= toggles;
+                nextEdge |= toggles | pulses;
+                unclaimed &= ~( toggles | pulses );
+            }
+        }
+
+        *GetWord( cPlane_NextHigh, wordX, y ) = nextHigh;
+        *GetWord( cPlane_NextEdge, wordX, y ) = nextEdge;
+    }
+}
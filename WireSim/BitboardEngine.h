@@ -0,0 +1,97 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Bit-sliced engine. Every tile type and both bits
+ of every power level are kept as separate bit planes, 64 tiles
+ to a word, and the rules of SimKernel are evaluated with shifts
+ and boolean operations on whole words at a time.
+
+ Power levels split into two bits: the high bit is the level a
+ tile is at (or settles to), the low bit is set on edges. Every
+ write onto a settled wire sets the edge bit, and either toggles
+ the level (wires, jump joints and not-gates) or keeps it (and,
+ or and xor gates pulse their output's current level).
+
+ Each row is padded with an empty word on both ends and the image
+ with two empty rows above and below, so neighbors can be read
+ without any bounds checks. The simulation's own power plane is
+ kept in sync by writing back only the tiles that changed.
+
+***/
+
+#ifndef __BITBOARDENGINE_H__
+#define __BITBOARDENGINE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimEngine.h"
+
+class BitboardEngine : public SimEngine
+{
+
+public:
+
+    BitboardEngine();
+    virtual ~BitboardEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+protected:
+
+    // All bit planes
+    enum Plane
+    {
+        // Static tile types
+        cPlane_Wire,
+        cPlane_JumpOrNot,
+        cPlane_Not,
+        cPlane_Gate,
+        cPlane_And,
+        cPlane_Or,
+        cPlane_Xor,
+
+        // Power bits
+        cPlane_High,
+        cPlane_Edge,
+        cPlane_NextHigh,
+        cPlane_NextEdge,
+
+        // Scratch, rebuilt every step: wires that are settled / on an edge, and gate results
+        cPlane_SettledWire,
+        cPlane_EdgeWire,
+        cPlane_GateResult,
+
+        // Must always be last!
+        cPlaneCount
+    };
+
+    // Word in the given plane for tile column-word and row (image coordinates)
+    inline uint64_t* GetWord( Plane plane, int wordX, int y );
+
+    // Read / write a single tile's power bits
+    void LoadTile( const SimTopology& topology, const SimPowerPlane& power, int x, int y );
+
+    // Compute the scratch planes, then the next power bits, for one row
+    void EvaluateInputs( int y );
+    void EvaluateRow( int y );
+
+private:
+
+    // Size of the image, and words per padded row
+    int m_width, m_height;
+    int m_stride;
+
+    // One bit per tile, padded (see above)
+    std::vector< uint64_t > m_planes[ cPlaneCount ];
+
+    // Tiles written by SetInput since the last step; loaded from the power plane before stepping
+    std::vector< int > m_touchedIndices;
+
+};
+
+#endif // __BITBOARDENGINE_H__
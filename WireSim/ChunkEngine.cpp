@@ -0,0 +1,110 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "ChunkEngine.h"
+#include "SimKernel.h"
+
+ChunkEngine::ChunkEngine()
+    : m_topology( NULL )
+    , m_chunkColumnCount( 0 )
+    , m_chunkRowCount( 0 )
+    , m_skippedChunkCount( 0 )
+{
+}
+
+ChunkEngine::~ChunkEngine()
+{
+    // ...
+}
+
+void ChunkEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    m_topology = &topology;
+
+    // Both buffers start out equal, so every chunk can be skipped until it changes
+    m_backPower = power;
+
+    m_chunkColumnCount = topology.GetStride() / cChunkSize;
+    m_chunkRowCount = ( topology.GetHeight() + cChunkSize - 1 ) / cChunkSize;
+
+    // Nothing is known about the given state, so everything is evaluated once
+    m_isDirty.assign( m_chunkColumnCount * m_chunkRowCount, 1 );
+    m_isNextDirty.assign( m_chunkColumnCount * m_chunkRowCount, 0 );
+    m_skippedChunkCount = 0;
+}
+
+void ChunkEngine::Touch( int linearIndex )
+{
+    m_isDirty[ GetChunk( linearIndex ) ] = 1;
+}
+
+int ChunkEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int changeCount = 0;
+    m_skippedChunkCount = 0;
+
+    for( int chunkY = 0; chunkY < m_chunkRowCount; chunkY++ )
+    {
+        for( int chunkX = 0; chunkX < m_chunkColumnCount; chunkX++ )
+        {
+            int chunk = chunkY * m_chunkColumnCount + chunkX;
+
+            // Anything that changed within reach of this chunk lies in it or one of its neighbors
+            bool isActive = false;
+            for( int y = std::max( 0, chunkY - 1 ); y <= std::min( m_chunkRowCount - 1, chunkY + 1 ) && !isActive; y++ )
+            {
+                for( int x = std::max( 0, chunkX - 1 ); x <= std::min( m_chunkColumnCount - 1, chunkX + 1 ) && !isActive; x++ )
+                {
+                    isActive = ( m_isDirty[ y * m_chunkColumnCount + x ] != 0 );
+                }
+            }
+
+            if( !isActive )
+            {
+                m_isNextDirty[ chunk ] = 0;
+                m_skippedChunkCount++;
+                continue;
+            }
+
+            // One word per row of the chunk
+            int chunkChangeCount = 0;
+            int endRow = std::min( topology.GetHeight(), ( chunkY + 1 ) * cChunkSize );
+            for( int row = chunkY * cChunkSize; row < endRow; row++ )
+            {
+                int word = topology.GetIndex( 0, row ) / SimPowerPlane::cTilesPerWord + chunkX;
+                chunkChangeCount += SimKernel::EvaluateWords( topology, power, m_backPower, word, word + 1, changesOut );
+            }
+
+            m_isNextDirty[ chunk ] = ( chunkChangeCount > 0 );
+            changeCount += chunkChangeCount;
+        }
+    }
+
+    power.Swap( m_backPower );
+    m_isDirty.swap( m_isNextDirty );
+
+    return changeCount;
+}
+
+int ChunkEngine::GetChunkCount() const
+{
+    return (int)m_isDirty.size();
+}
+
+int ChunkEngine::GetSkippedChunkCount() const
+{
+    return m_skippedChunkCount;
+}
+
+inline int ChunkEngine::GetChunk( int linearIndex ) const
+{
+    int chunkX = m_topology->GetX( linearIndex ) / cChunkSize;
+    int chunkY = m_topology->GetY( linearIndex ) / cChunkSize;
+    return chunkY * m_chunkColumnCount + chunkX;
+}
@@ -0,0 +1,71 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Engine that skips idle regions of the board.
+ The image is cut into chunks of 32x32 tiles (one packed word
+ wide), each with a flag telling whether any of its tiles
+ changed on the last step (or was written by SetInput). A
+ tile only depends on tiles up to two away (see SimKernel),
+ so a chunk whose own flag and those of its eight neighbors
+ are all clear cannot change, and is not evaluated at all.
+
+ The back buffer holds the same words as the current power
+ plane for every chunk that did not change, so skipped chunks
+ need no copying when the buffers are swapped.
+
+***/
+
+#ifndef __CHUNKENGINE_H__
+#define __CHUNKENGINE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimEngine.h"
+
+class ChunkEngine : public SimEngine
+{
+
+public:
+
+    ChunkEngine();
+    virtual ~ChunkEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Number of chunks, and of chunks the last step did not evaluate
+    int GetChunkCount() const;
+    int GetSkippedChunkCount() const;
+
+    // Chunks are one packed word wide, and as many rows high
+    static const int cChunkSize = SimPowerPlane::cTilesPerWord;
+
+protected:
+
+    // Chunk of the given tile (see SimTopology::GetIndex)
+    inline int GetChunk( int linearIndex ) const;
+
+private:
+
+    const SimTopology* m_topology;
+
+    // Next power states, swapped with the simulation's power plane after every step
+    SimPowerPlane m_backPower;
+
+    // Chunks per row of chunks (covering the whole padded row), and rows of chunks
+    int m_chunkColumnCount;
+    int m_chunkRowCount;
+
+    // Chunks changed by the last step (or touched since), and by the current one
+    std::vector< uint8_t > m_isDirty;
+    std::vector< uint8_t > m_isNextDirty;
+
+    int m_skippedChunkCount;
+
+};
+
+#endif // __CHUNKENGINE_H__
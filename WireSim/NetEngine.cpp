@@ -0,0 +1,418 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "NetEngine.h"
+#include "SimKernel.h"
+
+namespace
+{
+    // Net marks; visited nets are written back, dirty ones are resolved from their tiles first
+    const uint8_t cMark_None = 0;
+    const uint8_t cMark_Visited = 1;
+    const uint8_t cMark_Dirty = 2;
+
+    // Number of tiles that differ between two packed words
+    inline int CountTileChanges( uint64_t a, uint64_t b )
+    {
+        uint64_t bits = a ^ b;
+        bits = ( bits | ( bits >> 1 ) ) & 0x5555555555555555ULL;
+
+        int count = 0;
+        for( ; bits != 0; bits &= bits - 1 )
+        {
+            count++;
+        }
+        return count;
+    }
+}
+
+NetEngine::NetEngine( int maxFallbackSteps )
+    : m_maxFallbackSteps( maxFallbackSteps )
+    , m_wasNetLevel( false )
+    , m_areLevelsValid( false )
+    , m_isSteady( false )
+{
+}
+
+NetEngine::~NetEngine()
+{
+    // ...
+}
+
+void NetEngine::Reset( const SimTopology& topology, const SimPowerPlane& )
+{
+    m_netlist = topology.GetNetlist();
+
+    int netCount = m_netlist->GetNetCount();
+    m_levels.assign( netCount, 0 );
+    m_startLevels.assign( netCount, 0 );
+    m_drivers.assign( netCount, -1 );
+    m_netMarks.assign( netCount, cMark_None );
+    m_markedNets.clear();
+    m_pendingNodes.clear();
+    m_changedNets.clear();
+    m_touchedIndices.clear();
+
+    m_areLevelsValid = false;
+    m_isSteady = false;
+}
+
+void NetEngine::Touch( int linearIndex )
+{
+    m_touchedIndices.push_back( linearIndex );
+}
+
+int NetEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    if( m_isSteady && m_touchedIndices.empty() )
+    {
+        return 0;
+    }
+
+    // Without known levels everything is resolved from the tiles; otherwise only what was touched
+    bool isFullResolve = !m_areLevelsValid;
+    if( isFullResolve )
+    {
+        for( int i = 0; i < m_netlist->GetNetCount(); i++ )
+        {
+            MarkNet( i, true );
+        }
+        for( int i = 0; i < (int)m_netlist->GetJumpNodes().size(); i++ )
+        {
+            m_pendingNodes.push_back( i );
+        }
+    }
+    else
+    {
+        for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+        {
+            int net = m_netlist->GetNet( m_touchedIndices[ i ] );
+            if( net >= 0 )
+            {
+                MarkNet( net, true );
+            }
+
+            int node = m_netlist->GetJumpNode( m_touchedIndices[ i ] );
+            if( node >= 0 )
+            {
+                m_pendingNodes.push_back( node );
+            }
+        }
+    }
+    m_touchedIndices.clear();
+
+    int changeCount = 0;
+    m_wasNetLevel = ResolveNets( power );
+    if( m_wasNetLevel )
+    {
+        changeCount = WriteBack( power, changesOut );
+
+        // Node tiles only ever settle
+        for( int i = 0; i < (int)m_pendingNodes.size(); i++ )
+        {
+            int index = m_netlist->GetJumpNodes()[ m_pendingNodes[ i ] ].index;
+            WireSim::SimPower simPower = (WireSim::SimPower)power.Get( index );
+            if( SimKernel::IsEdge( simPower ) )
+            {
+                SetTile( index, simPower, SimKernel::Settle( simPower ), power, changesOut );
+                changeCount++;
+            }
+        }
+
+        for( int i = 0; isFullResolve && i < (int)m_netlist->GetGateNodes().size(); i++ )
+        {
+            int index = m_netlist->GetGateNodes()[ i ].index;
+            WireSim::SimPower simPower = (WireSim::SimPower)power.Get( index );
+            if( SimKernel::IsEdge( simPower ) )
+            {
+                SetTile( index, simPower, SimKernel::Settle( simPower ), power, changesOut );
+                changeCount++;
+            }
+        }
+
+        m_isSteady = true;
+    }
+    else
+    {
+        m_areLevelsValid = false;
+        changeCount = Fallback( topology, power, changesOut );
+    }
+
+    // Every visited net is now at its start level for the next step
+    for( int i = 0; i < (int)m_markedNets.size(); i++ )
+    {
+        int net = m_markedNets[ i ];
+        m_startLevels[ net ] = m_levels[ net ];
+        m_drivers[ net ] = -1;
+        m_netMarks[ net ] = cMark_None;
+    }
+    m_markedNets.clear();
+    m_pendingNodes.clear();
+    m_changedNets.clear();
+
+    return changeCount;
+}
+
+const SimNetlist& NetEngine::GetNetlist() const
+{
+    return *m_netlist;
+}
+
+bool NetEngine::WasNetLevel() const
+{
+    return m_wasNetLevel;
+}
+
+bool NetEngine::ResolveNets( const SimPowerPlane& power )
+{
+    // Starting level of every dirty net, straight from its tiles; the net has to be drawn at a
+    // single level, and any edges on it (written by SetInput) flood it with their own level
+    for( int i = 0; i < (int)m_markedNets.size(); i++ )
+    {
+        int net = m_markedNets[ i ];
+        if( m_netMarks[ net ] != cMark_Dirty )
+        {
+            continue;
+        }
+
+        bool hasSettled[ 2 ] = { false, false };
+        bool hasEdges[ 2 ] = { false, false };
+        for( const int* tile = m_netlist->GetNetTilesBegin( net ); tile != m_netlist->GetNetTilesEnd( net ); tile++ )
+        {
+            int simPower = power.Get( *tile );
+            ( SimKernel::IsEdge( (WireSim::SimPower)simPower ) ? hasEdges : hasSettled )[ simPower >> 1 ] = true;
+        }
+
+        if( ( hasSettled[ 0 ] && hasSettled[ 1 ] ) || ( hasEdges[ 0 ] && hasEdges[ 1 ] ) )
+        {
+            return false;
+        }
+
+        int startLevel = ( hasSettled[ 0 ] || hasSettled[ 1 ] ) ? ( hasSettled[ 1 ] ? 1 : 0 ) : ( hasEdges[ 1 ] ? 1 : 0 );
+        m_startLevels[ net ] = (uint8_t)startLevel;
+        m_levels[ net ] = (uint8_t)startLevel;
+
+        if( hasEdges[ 1 - startLevel ] )
+        {
+            m_levels[ net ] = (uint8_t)( 1 - startLevel );
+            m_drivers[ net ] = cPinDriver;
+            m_changedNets.push_back( net );
+        }
+    }
+
+    // Propagate through jump / not nodes until nothing changes; every net may only be changed
+    // once, by a single driver, so that the order of changes cannot matter
+    int nextPendingNode = 0;
+    while( nextPendingNode < (int)m_pendingNodes.size() || !m_changedNets.empty() )
+    {
+        int nodeCount = 1;
+        const int* nodes = NULL;
+        if( nextPendingNode < (int)m_pendingNodes.size() )
+        {
+            nodes = &m_pendingNodes[ nextPendingNode++ ];
+        }
+        else
+        {
+            int net = m_changedNets.back();
+            m_changedNets.pop_back();
+
+            nodes = m_netlist->GetNetJumpNodesBegin( net );
+            nodeCount = (int)( m_netlist->GetNetJumpNodesEnd( net ) - nodes );
+        }
+
+        for( int i = 0; i < nodeCount; i++ )
+        {
+            int sideLevels[ SimNetlist::cSideCount ];
+            EvaluateJumpNode( power, nodes[ i ], sideLevels );
+
+            for( int side = 0; side < SimNetlist::cSideCount; side++ )
+            {
+                if( sideLevels[ side ] < 0 )
+                {
+                    continue;
+                }
+
+                int net = m_netlist->GetNet( m_netlist->GetJumpNodes()[ nodes[ i ] ].sideTiles[ side ] );
+                MarkNet( net, false );
+
+                int driver = nodes[ i ] * SimNetlist::cSideCount + side;
+                if( sideLevels[ side ] != m_startLevels[ net ] )
+                {
+                    if( m_drivers[ net ] == -1 )
+                    {
+                        m_drivers[ net ] = driver;
+                    }
+                    else if( m_drivers[ net ] != driver )
+                    {
+                        return false;
+                    }
+                }
+
+                if( sideLevels[ side ] != m_levels[ net ] )
+                {
+                    if( m_levels[ net ] != m_startLevels[ net ] )
+                    {
+                        return false;
+                    }
+
+                    m_levels[ net ] = (uint8_t)sideLevels[ side ];
+                    m_changedNets.push_back( net );
+                }
+            }
+        }
+    }
+
+    // Nets that changed must agree with every node writing to them, and must not be gate outputs
+    for( int i = 0; i < (int)m_markedNets.size(); i++ )
+    {
+        int net = m_markedNets[ i ];
+        if( m_levels[ net ] == m_startLevels[ net ] )
+        {
+            continue;
+        }
+
+        if( m_netlist->GetNetGateNodesBegin( net ) != m_netlist->GetNetGateNodesEnd( net ) )
+        {
+            return false;
+        }
+
+        const int* netNodes = m_netlist->GetNetJumpNodesBegin( net );
+        int netNodeCount = (int)( m_netlist->GetNetJumpNodesEnd( net ) - netNodes );
+        for( int j = 0; j < netNodeCount; j++ )
+        {
+            int sideLevels[ SimNetlist::cSideCount ];
+            EvaluateJumpNode( power, netNodes[ j ], sideLevels );
+
+            for( int side = 0; side < SimNetlist::cSideCount; side++ )
+            {
+                if( sideLevels[ side ] >= 0 && sideLevels[ side ] != m_levels[ net ] &&
+                    m_netlist->GetNet( m_netlist->GetJumpNodes()[ netNodes[ j ] ].sideTiles[ side ] ) == net )
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    m_areLevelsValid = true;
+    return true;
+}
+
+void NetEngine::EvaluateJumpNode( const SimPowerPlane& power, int node, int sideLevelsOut[ SimNetlist::cSideCount ] )
+{
+    const SimNetlist::JumpNode& jumpNode = m_netlist->GetJumpNodes()[ node ];
+
+    // Low nodes copy left to right and top to bottom, high ones right to left and bottom to top
+    bool isHigh = ( SimKernel::Settle( (WireSim::SimPower)power.Get( jumpNode.index ) ) == WireSim::cSimPower_HighEdge );
+    for( int side = 0; side < SimNetlist::cSideCount; side++ )
+    {
+        sideLevelsOut[ side ] = -1;
+
+        bool isWritten = ( side == 0 || side == 1 ) ? !isHigh : isHigh;
+        int sourceTile = jumpNode.sideTiles[ ( side + 2 ) % SimNetlist::cSideCount ];
+        if( isWritten && sourceTile >= 0 && jumpNode.sideTiles[ side ] >= 0 )
+        {
+            sideLevelsOut[ side ] = m_levels[ m_netlist->GetNet( sourceTile ) ] ^ ( jumpNode.isNot ? 1 : 0 );
+        }
+    }
+}
+
+void NetEngine::MarkNet( int net, bool isDirty )
+{
+    if( m_netMarks[ net ] == cMark_None )
+    {
+        m_markedNets.push_back( net );
+    }
+
+    if( isDirty || m_netMarks[ net ] == cMark_None )
+    {
+        m_netMarks[ net ] = isDirty ? cMark_Dirty : cMark_Visited;
+    }
+}
+
+int NetEngine::WriteBack( SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int changeCount = 0;
+    for( int i = 0; i < (int)m_markedNets.size(); i++ )
+    {
+        int net = m_markedNets[ i ];
+        if( m_netMarks[ net ] != cMark_Dirty && m_levels[ net ] == m_startLevels[ net ] )
+        {
+            continue;
+        }
+
+        int simPower = m_levels[ net ] ? WireSim::cSimPower_HighEdge : WireSim::cSimPower_LowEdge;
+        for( const int* tile = m_netlist->GetNetTilesBegin( net ); tile != m_netlist->GetNetTilesEnd( net ); tile++ )
+        {
+            int oldPower = power.Get( *tile );
+            if( oldPower != simPower )
+            {
+                SetTile( *tile, oldPower, simPower, power, changesOut );
+                changeCount++;
+            }
+        }
+    }
+
+    return changeCount;
+}
+
+void NetEngine::SetTile( int index, int oldPower, int newPower, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    power.Set( index, newPower );
+    if( changesOut )
+    {
+        changesOut->AddTile( index, oldPower, newPower );
+    }
+}
+
+int NetEngine::Fallback( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    // Shares every chunk; only those the fallback writes get copied (see SimPowerPlane)
+    SimPowerPlane startPower = power;
+
+    // Levels are settled once two steps in a row change none; edges can only block a write for
+    // a single step, so after that nothing is left to change them. Gate pulses are left as they
+    // are, the kernel's next steps depend on them. A repeated state means the circuit oscillates,
+    // and nothing will ever settle
+    m_activeSet.Reset( topology, power );
+    m_fallbackStates.Reset( power );
+    int quietStepCount = 0;
+    for( int i = 0; i < m_maxFallbackSteps && quietStepCount < 2; i++ )
+    {
+        m_fallbackChanges.Clear();
+        m_activeSet.Step( topology, power, &m_fallbackChanges );
+        quietStepCount = ( m_activeSet.GetLevelChangeCount() == 0 ) ? quietStepCount + 1 : 0;
+        if( m_fallbackStates.Record( m_fallbackChanges ) && m_fallbackStates.GetPeriod() > 1 )
+        {
+            break;
+        }
+    }
+
+    m_isSteady = ( quietStepCount >= 2 );
+    int changeCount = 0;
+    for( int chunk = 0; chunk < power.GetChunkCount(); chunk++ )
+    {
+        if( power.IsSharedChunk( chunk, startPower ) )
+        {
+            continue;
+        }
+
+        int firstWord = chunk * SimPowerPlane::cChunkWordCount;
+        for( int i = firstWord; i < firstWord + power.GetChunkWordCount( chunk ); i++ )
+        {
+            uint64_t startWord = startPower.GetWord( i );
+            uint64_t word = power.GetWord( i );
+            if( changesOut && startWord != word )
+            {
+                changesOut->AddWord( i, startWord, word );
+            }
+            changeCount += CountTileChanges( startWord, word );
+        }
+    }
+
+    return changeCount;
+}
@@ -0,0 +1,132 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Steady-state engine on the net level (see
+ SimNetlist). Unlike the other engines, a single step runs all
+ the way to the state repeated WireSim::Update calls settle in,
+ so Update returns false on the very next call. A steady state
+ is one where no tile changes level any more; gates whose
+ result differs from an output wire may keep pulsing that
+ wire's current level forever without changing it.
+
+ A level change on a net always floods the whole net, so as
+ long as every net is drawn at a single level, the steady state
+ follows from propagating levels through jump / not nodes, one
+ operation per net instead of one per tile per step. That only
+ holds while the order in which changes arrive cannot matter:
+
+   - no net may change more than once, or be changed by more
+     than one driver (jump / not node, or an edge written by
+     SetInput)
+   - no net that changes may be an output of a gate, since
+     gates fight waves of the other level
+
+ Nets resolved that way are written back settled. When any of
+ that fails, the step falls back to running the exact kernel
+ (ActiveSetEngine) until levels stop changing. Circuits that
+ oscillate never stop; the fallback gives up as soon as the
+ kernel repeats a state (see SimCycleDetector), or after a
+ fixed number of steps, and leaves the plane in the last state
+ it reached. Step then returns the number of tiles changed, as
+ always, and every later step falls back again, so repeated
+ Update calls keep running the circuit a bounded number of
+ kernel steps at a time.
+
+***/
+
+#ifndef __NETENGINE_H__
+#define __NETENGINE_H__
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include "ActiveSetEngine.h"
+#include "SimCycleDetector.h"
+#include "SimEngine.h"
+#include "SimNetlist.h"
+
+class NetEngine : public SimEngine
+{
+
+public:
+
+    // Fallbacks give up once the kernel repeats a state, or after the given number of kernel steps
+    NetEngine( int maxFallbackSteps = 4096 );
+    virtual ~NetEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Compiled circuit
+    const SimNetlist& GetNetlist() const;
+
+    // True if the last step was resolved on nets, false if it had to fall back to the kernel
+    bool WasNetLevel() const;
+
+protected:
+
+    // Find the starting level of all dirty nets, and propagate every change through jump / not
+    // nodes; returns false if the result may depend on timing
+    bool ResolveNets( const SimPowerPlane& power );
+
+    // Find the level a jump / not node writes on each of its sides given the current net
+    // levels (-1 if the side is not written)
+    void EvaluateJumpNode( const SimPowerPlane& power, int node, int sideLevelsOut[ SimNetlist::cSideCount ] );
+
+    // Queue a net for resolving / writing back
+    void MarkNet( int net, bool isDirty );
+
+    // Write resolved nets back as settled tiles; returns the number of tiles changed, which are
+    // also added to the given change list, if any
+    int WriteBack( SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Write a single tile, listing the change if asked to
+    void SetTile( int index, int oldPower, int newPower, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Run the kernel until no tile changes level, or until it gives up; same return value
+    int Fallback( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+private:
+
+    int m_maxFallbackSteps;
+    bool m_wasNetLevel;
+
+    // Shared with the topology (see SimTopology::GetNetlist)
+    std::shared_ptr< const SimNetlist > m_netlist;
+
+    // Level of every net (0 or 1) in the power plane; only valid if all nets are uniform
+    bool m_areLevelsValid;
+    std::vector< uint8_t > m_levels;
+
+    // Level of every net before the current step, and the driver that changed it (-1 none,
+    // otherwise node * cSideCount + side, or cPinDriver)
+    std::vector< uint8_t > m_startLevels;
+    std::vector< int > m_drivers;
+    static const int cPinDriver = -2;
+
+    // Nets visited by the current step, and whether they still need resolving from tiles
+    std::vector< int > m_markedNets;
+    std::vector< uint8_t > m_netMarks;
+
+    // Jump / not nodes to evaluate first, and nets whose level changed but whose dependents
+    // have not been evaluated yet
+    std::vector< int > m_pendingNodes;
+    std::vector< int > m_changedNets;
+
+    // Nothing can change until a tile is touched
+    bool m_isSteady;
+    std::vector< int > m_touchedIndices;
+
+    ActiveSetEngine m_activeSet;
+
+    // States the kernel went through in the current fallback, and the changes of its last step
+    SimCycleDetector m_fallbackStates;
+    SimChangeList m_fallbackChanges;
+
+};
+
+#endif // __NETENGINE_H__
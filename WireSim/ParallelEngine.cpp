@@ -0,0 +1,85 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "ParallelEngine.h"
+#include "SimKernel.h"
+
+ParallelEngine::ParallelEngine( int threadCount )
+    : m_threadPool( threadCount )
+{
+}
+
+ParallelEngine::~ParallelEngine()
+{
+    // ...
+}
+
+void ParallelEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    m_backPower = power;
+
+    // Cut the rows into bands; bands start on chunk boundaries, so no two threads ever write the
+    // same chunk of the back buffer (see SimPowerPlane), and the first and last band also take
+    // the border rows above and below the image
+    int height = topology.GetHeight();
+    int bandCount = std::max( 1, std::min( height, m_threadPool.GetThreadCount() * cBandsPerThread ) );
+
+    m_bandWords.clear();
+    for( int i = 0; i < bandCount; i++ )
+    {
+        int firstRow = ( i * height ) / bandCount;
+        int firstWord = ( i == 0 ) ? 0 : topology.GetIndex( 0, firstRow ) / SimPowerPlane::cTilesPerWord;
+        firstWord -= firstWord % SimPowerPlane::cChunkWordCount;
+        if( m_bandWords.empty() || firstWord > m_bandWords.back() )
+        {
+            m_bandWords.push_back( firstWord );
+        }
+    }
+    m_bandWords.push_back( power.GetWordCount() );
+
+    m_bandChangeCounts.assign( m_bandWords.size() - 1, 0 );
+    m_bandChanges.resize( m_bandWords.size() - 1 );
+}
+
+void ParallelEngine::Touch( int )
+{
+    // Every tile is evaluated on every step; nothing to track
+}
+
+int ParallelEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    m_threadPool.Run( (int)m_bandChangeCounts.size(), [&]( int bandIndex )
+    {
+        SimChangeList* bandChanges = NULL;
+        if( changesOut )
+        {
+            bandChanges = &m_bandChanges[ bandIndex ];
+            bandChanges->Clear();
+        }
+        m_bandChangeCounts[ bandIndex ] = SimKernel::EvaluateWords( topology, power, m_backPower, m_bandWords[ bandIndex ], m_bandWords[ bandIndex + 1 ], bandChanges );
+    } );
+
+    int changeCount = 0;
+    for( int i = 0; i < (int)m_bandChangeCounts.size(); i++ )
+    {
+        changeCount += m_bandChangeCounts[ i ];
+        if( changesOut )
+        {
+            changesOut->Append( m_bandChanges[ i ] );
+        }
+    }
+
+    power.Swap( m_backPower );
+    return changeCount;
+}
+
+int ParallelEngine::GetThreadCount() const
+{
+    return m_threadPool.GetThreadCount();
+}
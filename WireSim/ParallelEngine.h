@@ -0,0 +1,59 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Multi-core engine. A step reads only from the
+ current power plane and each tile writes only itself (see
+ SimKernel), so the image is split into bands of rows that
+ are stepped in parallel into a back buffer by a persistent
+ thread pool. Bands are cut on chunk boundaries (see
+ SimPowerPlane), so no two threads ever write the same chunk,
+ and the results are identical to the serial kernel
+ regardless of thread count.
+
+***/
+
+#ifndef __PARALLELENGINE_H__
+#define __PARALLELENGINE_H__
+
+#include <vector>
+
+#include "SimEngine.h"
+#include "ThreadPool.h"
+
+class ParallelEngine : public SimEngine
+{
+
+public:
+
+    // Thread count includes the calling thread; zero uses one per hardware thread
+    ParallelEngine( int threadCount = 0 );
+    virtual ~ParallelEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    int GetThreadCount() const;
+
+private:
+
+    // Bands per thread; more than one so that uneven bands still balance out
+    static const int cBandsPerThread = 4;
+
+    ThreadPool m_threadPool;
+
+    // Next power states, swapped with the simulation's power plane after every step
+    SimPowerPlane m_backPower;
+
+    // First packed word of each band, plus the end word; and changed words found per band
+    std::vector< int > m_bandWords;
+    std::vector< int > m_bandChangeCounts;
+
+    // Changed words listed per band, when the caller asks for them; joined in band order
+    std::vector< SimChangeList > m_bandChanges;
+
+};
+
+#endif // __PARALLELENGINE_H__
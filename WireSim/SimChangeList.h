@@ -0,0 +1,79 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Tiles changed by a simulation step (see
+ SimEngine::Step), as packed power words: the index of a word,
+ and its bits before and after the change. Only tiles whose
+ bits differ changed, all others have the same bits on both
+ sides, so XOR-ing them gives a mask of the change. The packed
+ kernel adds whole words, and engines that change single tiles
+ add one entry per tile, with the rest of the word left zero.
+ A step changes every tile at most once, but a list may also
+ hold writes made outside of a step (see SimHistory); entries
+ are always in the order the changes were made.
+
+***/
+
+#ifndef __SIMCHANGELIST_H__
+#define __SIMCHANGELIST_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimPowerPlane.h"
+
+class SimChangeList
+{
+public:
+
+    struct Change
+    {
+        int word;
+        uint64_t oldBits;
+        uint64_t newBits;
+    };
+
+    void Clear()
+    {
+        m_changes.clear();
+    }
+
+    // A packed word (see SimPowerPlane::GetWord) went from oldBits to newBits
+    inline void AddWord( int word, uint64_t oldBits, uint64_t newBits )
+    {
+        Change change = { word, oldBits, newBits };
+        m_changes.push_back( change );
+    }
+
+    // A single tile (see SimTopology::GetIndex) went from oldPower to newPower
+    inline void AddTile( int index, int oldPower, int newPower )
+    {
+        int shift = ( index % SimPowerPlane::cTilesPerWord ) * SimPowerPlane::cBitsPerTile;
+        AddWord( index / SimPowerPlane::cTilesPerWord, (uint64_t)oldPower << shift, (uint64_t)newPower << shift );
+    }
+
+    // Add every change of another list, after the ones already listed
+    void Append( const SimChangeList& other )
+    {
+        m_changes.insert( m_changes.end(), other.m_changes.begin(), other.m_changes.end() );
+    }
+
+    int GetCount() const
+    {
+        return (int)m_changes.size();
+    }
+
+    const Change& Get( int index ) const
+    {
+        return m_changes[ index ];
+    }
+
+private:
+
+    std::vector< Change > m_changes;
+
+};
+
+#endif // __SIMCHANGELIST_H__
@@ -0,0 +1,127 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "SimCheckpoint.h"
+#include "SimMappedFile.h"
+#include "SimTopology.h"
+
+namespace
+{
+    const char cMagic[ 8 ] = { 'W', 'S', 'I', 'M', 'C', 'K', 'P', 'T' };
+    const uint32_t cVersion = 2;
+}
+
+bool SimCheckpoint::Save( const char* fileName, const SimTopology& topology, const SimPowerPlane& power, int64_t stepCount )
+{
+    Header header = MakeHeader( topology, power, stepCount );
+
+    std::string tempFileName = std::string( fileName ) + ".tmp";
+    FILE* file = fopen( tempFileName.c_str(), "wb" );
+    if( file == NULL )
+    {
+        printf( "Failed to open checkpoint \"%s\"\n", tempFileName.c_str() );
+        return false;
+    }
+
+    // One sequential pass; the plane is written straight from memory, a chunk at a time
+    bool isWritten = ( fwrite( &header, sizeof( Header ), 1, file ) == 1 );
+    for( int i = 0; i < power.GetChunkCount() && isWritten; i++ )
+    {
+        size_t wordCount = (size_t)power.GetChunkWordCount( i );
+        isWritten = ( fwrite( power.GetChunkWords( i ), sizeof( uint64_t ), wordCount, file ) == wordCount );
+    }
+    isWritten = isWritten && SimMappedFile::Sync( file );
+    isWritten = ( fclose( file ) == 0 ) && isWritten;
+
+    if( !isWritten || !SimMappedFile::RenameOver( tempFileName.c_str(), fileName ) )
+    {
+        printf( "Failed to write checkpoint \"%s\"\n", fileName );
+        remove( tempFileName.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+bool SimCheckpoint::Load( const char* fileName, const SimTopology& topology, SimPowerPlane& powerOut, int64_t& stepCountOut )
+{
+    SimMappedFile file( fileName );
+    if( file.GetData() == NULL || file.GetSize() < sizeof( Header ) )
+    {
+        printf( "Failed to open checkpoint \"%s\"\n", fileName );
+        return false;
+    }
+
+    // Everything but the step count has to match what this topology would write
+    Header header;
+    memcpy( &header, file.GetData(), sizeof( Header ) );
+    Header expectedHeader = MakeHeader( topology, topology.GetInitialPower(), header.stepCount );
+
+    size_t wordByteCount = (size_t)expectedHeader.wordCount * sizeof( uint64_t );
+    if( memcmp( &header, &expectedHeader, sizeof( Header ) ) != 0 || file.GetSize() != sizeof( Header ) + wordByteCount )
+    {
+        printf( "Checkpoint \"%s\" does not match the circuit\n", fileName );
+        return false;
+    }
+
+    powerOut.Resize( expectedHeader.tileCount );
+    if( wordByteCount > 0 )
+    {
+        powerOut.SetWords( (const uint64_t*)( file.GetData() + sizeof( Header ) ) );
+    }
+    stepCountOut = header.stepCount;
+
+    return true;
+}
+
+SimCheckpoint::Header SimCheckpoint::MakeHeader( const SimTopology& topology, const SimPowerPlane& power, int64_t stepCount )
+{
+    // Zeroed first, so padding compares equal too
+    Header header;
+    memset( &header, 0, sizeof( Header ) );
+
+    memcpy( header.magic, cMagic, sizeof( cMagic ) );
+    header.version = cVersion;
+    header.width = topology.GetWidth();
+    header.height = topology.GetHeight();
+    header.stride = topology.GetStride();
+    header.tileCount = power.GetTileCount();
+    header.wordCount = power.GetWordCount();
+    header.inputCount = (int32_t)topology.GetInputIndices().size();
+    header.outputCount = (int32_t)topology.GetOutputIndices().size();
+    header.stepCount = stepCount;
+    header.circuitHash = HashCircuit( topology );
+
+    return header;
+}
+
+uint64_t SimCheckpoint::HashCircuit( const SimTopology& topology )
+{
+    // FNV-1a over the type of every tile, then the pin indices
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const uint64_t cPrime = 0x100000001b3ull;
+    for( int i = 0; i < topology.GetTileCount(); i++ )
+    {
+        hash = ( hash ^ (uint64_t)topology.GetType( i ) ) * cPrime;
+    }
+
+    const std::vector< int >* pinIndices[ 2 ] = { &topology.GetInputIndices(), &topology.GetOutputIndices() };
+    for( int i = 0; i < 2; i++ )
+    {
+        for( size_t j = 0; j < pinIndices[ i ]->size(); j++ )
+        {
+            hash = ( hash ^ (uint32_t)( *pinIndices[ i ] )[ j ] ) * cPrime;
+        }
+    }
+
+    return hash;
+}
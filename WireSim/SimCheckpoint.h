@@ -0,0 +1,70 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Binary dump of the dynamic state of a simulation
+ (see WireSim::SaveCheckpoint): a fixed header, then the packed
+ power plane word for word, in the layout of SimTopology. The
+ plane holds all pin states as well; inputs are tiles like any
+ other. Tile types are not stored, only a hash of them and of
+ the pins, so a checkpoint can only be restored onto a
+ simulation of the same image.
+
+ Saving is a single sequential write to a temporary file, which
+ is synced to disk and then replaces the target, so a run
+ interrupted mid-save (or a crash right after it) still leaves
+ either the previous checkpoint or the new one intact. Loading maps the file
+ into memory and copies the plane out in one go; nothing is
+ decoded or parsed. Words are stored in native byte order.
+
+***/
+
+#ifndef __SIMCHECKPOINT_H__
+#define __SIMCHECKPOINT_H__
+
+#include <stdint.h>
+
+#include "SimPowerPlane.h"
+
+class SimTopology;
+
+class SimCheckpoint
+{
+
+public:
+
+    // Write the given state; returns true on success, false on failure
+    static bool Save( const char* fileName, const SimTopology& topology, const SimPowerPlane& power, int64_t stepCount );
+
+    // Read a state written by Save for the same topology; returns true on success, false on
+    // failure, in which case nothing is written to the outputs
+    static bool Load( const char* fileName, const SimTopology& topology, SimPowerPlane& powerOut, int64_t& stepCountOut );
+
+private:
+
+    // Identifies the file and the layout it was written with
+    struct Header
+    {
+        char magic[ 8 ];
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        int32_t tileCount;
+        int32_t wordCount;
+        int32_t inputCount;
+        int32_t outputCount;
+        int64_t stepCount;
+        uint64_t circuitHash;
+    };
+
+    // Header as expected for the given topology
+    static Header MakeHeader( const SimTopology& topology, const SimPowerPlane& power, int64_t stepCount );
+
+    // Hash of the tile types and pins of the given topology
+    static uint64_t HashCircuit( const SimTopology& topology );
+
+};
+
+#endif // __SIMCHECKPOINT_H__
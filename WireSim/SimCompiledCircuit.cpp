@@ -0,0 +1,400 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "SimCompiledCircuit.h"
+#include "SimKernel.h"
+#include "SimMappedFile.h"
+#include "SimNetlist.h"
+#include "SimTopology.h"
+
+namespace
+{
+    const char cMagic[ 8 ] = { 'W', 'S', 'I', 'M', 'C', 'I', 'R', 'C' };
+    const uint32_t cVersion = 1;
+
+    // Every section starts on its own cache line
+    const size_t cSectionAlignment = 64;
+
+    // Offset right after a section of the given size, rounded up to the next section
+    size_t NextSection( size_t offset, size_t byteCount )
+    {
+        return ( offset + byteCount + cSectionAlignment - 1 ) / cSectionAlignment * cSectionAlignment;
+    }
+
+    // Write an array at the given offset, padding from the current position with zeros
+    bool WriteSection( FILE* file, size_t& position, size_t offset, const void* data, size_t byteCount )
+    {
+        static const char cZeros[ cSectionAlignment ] = { 0 };
+        if( offset > position && fwrite( cZeros, 1, offset - position, file ) != offset - position )
+        {
+            return false;
+        }
+
+        position = offset + byteCount;
+        return byteCount == 0 || fwrite( data, 1, byteCount, file ) == byteCount;
+    }
+
+    // True if every value of the given list is in [first, end)
+    bool IsInRange( const std::vector< int >& values, int first, int end )
+    {
+        for( size_t i = 0; i < values.size(); i++ )
+        {
+            if( values[ i ] < first || values[ i ] >= end )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // True if the given [begin, end) ranges start at zero, never go back, and end with their list
+    bool IsRanges( const std::vector< int >& starts, size_t listSize )
+    {
+        if( starts.empty() || starts.front() != 0 || starts.back() != (int)listSize )
+        {
+            return false;
+        }
+        for( size_t i = 1; i < starts.size(); i++ )
+        {
+            if( starts[ i ] < starts[ i - 1 ] )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Copy an array out of a mapped file
+    template< typename T >
+    void ReadSection( const unsigned char* data, size_t offset, int count, std::vector< T >& out )
+    {
+        out.resize( count );
+        if( count > 0 )
+        {
+            memcpy( &out[ 0 ], data + offset, count * sizeof( T ) );
+        }
+    }
+}
+
+bool SimCompiledCircuit::Save( const char* fileName, const SimTopology& topology )
+{
+    std::shared_ptr< const SimNetlist > netlist = topology.GetNetlist();
+
+    // Zeroed first, so padding is written as zeros too
+    Header header;
+    memset( &header, 0, sizeof( Header ) );
+
+    memcpy( header.magic, cMagic, sizeof( cMagic ) );
+    header.version = cVersion;
+    header.intSize = (int32_t)sizeof( int );
+    header.jumpNodeSize = (int32_t)sizeof( SimNetlist::JumpNode );
+    header.gateNodeSize = (int32_t)sizeof( SimNetlist::GateNode );
+    header.width = topology.GetWidth();
+    header.height = topology.GetHeight();
+    header.stride = topology.GetStride();
+    header.tileCount = topology.GetTileCount();
+    header.wordCount = topology.GetInitialPower().GetWordCount();
+    header.inputCount = (int32_t)topology.GetInputIndices().size();
+    header.outputCount = (int32_t)topology.GetOutputIndices().size();
+    header.netCount = netlist->GetNetCount();
+    header.netTileCount = (int32_t)netlist->m_netTiles.size();
+    header.jumpNodeCount = (int32_t)netlist->m_jumpNodes.size();
+    header.gateNodeCount = (int32_t)netlist->m_gateNodes.size();
+    header.netJumpNodeCount = (int32_t)netlist->m_netJumpNodes.size();
+    header.netGateNodeCount = (int32_t)netlist->m_netGateNodes.size();
+
+    std::string tempFileName = std::string( fileName ) + ".tmp";
+    FILE* file = fopen( tempFileName.c_str(), "wb" );
+    if( file == NULL )
+    {
+        printf( "Failed to open compiled circuit \"%s\"\n", tempFileName.c_str() );
+        return false;
+    }
+
+    // One sequential pass, every array written straight from memory; the power plane is kept in
+    // chunks, so it is packed first
+    std::vector< uint64_t > words( header.wordCount );
+    topology.GetInitialPower().CopyWords( words.data() );
+
+    Layout layout = GetLayout( header );
+    size_t position = 0;
+    bool isWritten = WriteSection( file, position, 0, &header, sizeof( Header ) ) &&
+                     WriteSection( file, position, layout.types, topology.m_types, header.tileCount ) &&
+                     WriteSection( file, position, layout.words, words.data(), header.wordCount * sizeof( uint64_t ) ) &&
+                     WriteSection( file, position, layout.inputs, topology.GetInputIndices().data(), header.inputCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.outputs, topology.GetOutputIndices().data(), header.outputCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.tileNets, netlist->m_tileNets.data(), header.tileCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.netTiles, netlist->m_netTiles.data(), header.netTileCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.netTileStarts, netlist->m_netTileStarts.data(), ( header.netCount + 1 ) * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.jumpNodes, netlist->m_jumpNodes.data(), header.jumpNodeCount * sizeof( SimNetlist::JumpNode ) ) &&
+                     WriteSection( file, position, layout.gateNodes, netlist->m_gateNodes.data(), header.gateNodeCount * sizeof( SimNetlist::GateNode ) ) &&
+                     WriteSection( file, position, layout.netJumpNodes, netlist->m_netJumpNodes.data(), header.netJumpNodeCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.netJumpNodeStarts, netlist->m_netJumpNodeStarts.data(), ( header.netCount + 1 ) * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.netGateNodes, netlist->m_netGateNodes.data(), header.netGateNodeCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.netGateNodeStarts, netlist->m_netGateNodeStarts.data(), ( header.netCount + 1 ) * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.tileJumpNodes, netlist->m_tileJumpNodes.data(), header.tileCount * sizeof( int ) ) &&
+                     WriteSection( file, position, layout.fileSize, NULL, 0 );
+    isWritten = isWritten && SimMappedFile::Sync( file );
+    isWritten = ( fclose( file ) == 0 ) && isWritten;
+
+    // Never rewritten in place; other simulations may have the old file mapped
+    if( !isWritten || !SimMappedFile::RenameOver( tempFileName.c_str(), fileName ) )
+    {
+        printf( "Failed to write compiled circuit \"%s\"\n", fileName );
+        remove( tempFileName.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+bool SimCompiledCircuit::IsCompiled( const unsigned char* data, size_t size )
+{
+    return data != NULL && size >= sizeof( cMagic ) && memcmp( data, cMagic, sizeof( cMagic ) ) == 0;
+}
+
+bool SimCompiledCircuit::Load( SimTopology& topologyOut, std::unique_ptr< SimMappedFile >& file )
+{
+    Header header;
+    if( !IsCompiled( file->GetData(), file->GetSize() ) || file->GetSize() < sizeof( Header ) )
+    {
+        return false;
+    }
+
+    memcpy( &header, file->GetData(), sizeof( Header ) );
+    if( !IsValid( header, file->GetSize() ) )
+    {
+        return false;
+    }
+
+    // The type plane stays in the mapping; the power plane is copied, as every simulation copies
+    // it anyway
+    Layout layout = GetLayout( header );
+    const unsigned char* data = file->GetData();
+    std::vector< int > inputIndices, outputIndices;
+    ReadSection( data, layout.inputs, header.inputCount, inputIndices );
+    ReadSection( data, layout.outputs, header.outputCount, outputIndices );
+    if( !IsValidTiles( header, data + layout.types, inputIndices, outputIndices ) )
+    {
+        printf( "Compiled circuit is corrupt\n" );
+        return false;
+    }
+
+    topologyOut.m_width = header.width;
+    topologyOut.m_height = header.height;
+    topologyOut.m_stride = header.stride;
+    topologyOut.m_tileCount = header.tileCount;
+    topologyOut.m_types = data + layout.types;
+    topologyOut.m_initialPower.Resize( header.tileCount );
+    if( header.wordCount > 0 )
+    {
+        topologyOut.m_initialPower.SetWords( (const uint64_t*)( data + layout.words ) );
+    }
+    topologyOut.m_inputIndices.swap( inputIndices );
+    topologyOut.m_outputIndices.swap( outputIndices );
+    topologyOut.m_file.swap( file );
+
+    return true;
+}
+
+std::shared_ptr< const SimNetlist > SimCompiledCircuit::LoadNetlist( const SimTopology& topology )
+{
+    if( !topology.m_file )
+    {
+        return NULL;
+    }
+
+    // Validated when the topology was loaded
+    const unsigned char* data = topology.m_file->GetData();
+    Header header;
+    memcpy( &header, data, sizeof( Header ) );
+    Layout layout = GetLayout( header );
+
+    std::shared_ptr< SimNetlist > netlist( new SimNetlist() );
+    ReadSection( data, layout.tileNets, header.tileCount, netlist->m_tileNets );
+    ReadSection( data, layout.netTiles, header.netTileCount, netlist->m_netTiles );
+    ReadSection( data, layout.netTileStarts, header.netCount + 1, netlist->m_netTileStarts );
+    ReadSection( data, layout.jumpNodes, header.jumpNodeCount, netlist->m_jumpNodes );
+    ReadSection( data, layout.gateNodes, header.gateNodeCount, netlist->m_gateNodes );
+    ReadSection( data, layout.netJumpNodes, header.netJumpNodeCount, netlist->m_netJumpNodes );
+    ReadSection( data, layout.netJumpNodeStarts, header.netCount + 1, netlist->m_netJumpNodeStarts );
+    ReadSection( data, layout.netGateNodes, header.netGateNodeCount, netlist->m_netGateNodes );
+    ReadSection( data, layout.netGateNodeStarts, header.netCount + 1, netlist->m_netGateNodeStarts );
+    ReadSection( data, layout.tileJumpNodes, header.tileCount, netlist->m_tileJumpNodes );
+
+    if( !IsValidNetlist( *netlist, topology ) )
+    {
+        printf( "Compiled circuit has a broken netlist\n" );
+        return NULL;
+    }
+
+    return netlist;
+}
+
+SimCompiledCircuit::Layout SimCompiledCircuit::GetLayout( const Header& header )
+{
+    Layout layout;
+    layout.types = NextSection( 0, sizeof( Header ) );
+    layout.words = NextSection( layout.types, (size_t)header.tileCount );
+    layout.inputs = NextSection( layout.words, (size_t)header.wordCount * sizeof( uint64_t ) );
+    layout.outputs = NextSection( layout.inputs, (size_t)header.inputCount * sizeof( int ) );
+    layout.tileNets = NextSection( layout.outputs, (size_t)header.outputCount * sizeof( int ) );
+    layout.netTiles = NextSection( layout.tileNets, (size_t)header.tileCount * sizeof( int ) );
+    layout.netTileStarts = NextSection( layout.netTiles, (size_t)header.netTileCount * sizeof( int ) );
+    layout.jumpNodes = NextSection( layout.netTileStarts, (size_t)( header.netCount + 1 ) * sizeof( int ) );
+    layout.gateNodes = NextSection( layout.jumpNodes, (size_t)header.jumpNodeCount * sizeof( SimNetlist::JumpNode ) );
+    layout.netJumpNodes = NextSection( layout.gateNodes, (size_t)header.gateNodeCount * sizeof( SimNetlist::GateNode ) );
+    layout.netJumpNodeStarts = NextSection( layout.netJumpNodes, (size_t)header.netJumpNodeCount * sizeof( int ) );
+    layout.netGateNodes = NextSection( layout.netJumpNodeStarts, (size_t)( header.netCount + 1 ) * sizeof( int ) );
+    layout.netGateNodeStarts = NextSection( layout.netGateNodes, (size_t)header.netGateNodeCount * sizeof( int ) );
+    layout.tileJumpNodes = NextSection( layout.netGateNodeStarts, (size_t)( header.netCount + 1 ) * sizeof( int ) );
+    layout.fileSize = NextSection( layout.tileJumpNodes, (size_t)header.tileCount * sizeof( int ) );
+    return layout;
+}
+
+bool SimCompiledCircuit::IsValid( const Header& header, size_t fileSize )
+{
+    if( header.version != cVersion ||
+        header.intSize != (int32_t)sizeof( int ) ||
+        header.jumpNodeSize != (int32_t)sizeof( SimNetlist::JumpNode ) ||
+        header.gateNodeSize != (int32_t)sizeof( SimNetlist::GateNode ) )
+    {
+        printf( "Compiled circuit was written by a different build\n" );
+        return false;
+    }
+
+    // The layout follows from the image size alone
+    int stride = 0;
+    int tileCount = 0;
+    if( !SimTopology::GetLayout( header.width, header.height, stride, tileCount ) || header.stride != stride || header.tileCount != tileCount ||
+        header.wordCount != ( tileCount + SimPowerPlane::cTilesPerWord - 1 ) / SimPowerPlane::cTilesPerWord ||
+        header.inputCount < 0 || header.outputCount < 0 || header.netCount < 0 || header.netTileCount < 0 ||
+        header.jumpNodeCount < 0 || header.gateNodeCount < 0 || header.netJumpNodeCount < 0 || header.netGateNodeCount < 0 ||
+        GetLayout( header ).fileSize != fileSize )
+    {
+        printf( "Compiled circuit is truncated or corrupt\n" );
+        return false;
+    }
+
+    return true;
+}
+
+bool SimCompiledCircuit::IsValidTiles( const Header& header, const uint8_t* types, const std::vector< int >& inputIndices, const std::vector< int >& outputIndices )
+{
+    // Only the image has types; the kernel reads up to the border, and never past it, only as long as
+    // the border (and the padding and margin around it) is empty
+    int imageBegin = SimTopology::cMargin + SimTopology::cBorder * header.stride;
+    int imageEnd = imageBegin + header.height * header.stride;
+    for( int i = 0; i < header.tileCount; i++ )
+    {
+        bool isImage = ( i >= imageBegin && i < imageEnd && ( i - SimTopology::cMargin ) % header.stride < header.width );
+        if( types[ i ] >= WireSim::cSimTypeCount || ( !isImage && types[ i ] != WireSim::cSimType_None ) )
+        {
+            return false;
+        }
+    }
+
+    // Pins are rows of wires or joints in the left and right column
+    const std::vector< int >* pinRows[ 2 ] = { &inputIndices, &outputIndices };
+    for( int i = 0; i < 2; i++ )
+    {
+        int x = ( i == 0 ) ? 0 : header.width - 1;
+        for( size_t j = 0; j < pinRows[ i ]->size(); j++ )
+        {
+            int y = ( *pinRows[ i ] )[ j ];
+            WireSim::SimType type = ( y >= 0 && y < header.height ) ? (WireSim::SimType)types[ imageBegin + y * header.stride + x ] : WireSim::cSimType_None;
+            if( !SimKernel::IsWire( type ) && type != WireSim::cSimType_JumpJoint )
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool SimCompiledCircuit::IsValidNetlist( const SimNetlist& netlist, const SimTopology& topology )
+{
+    int tileCount = topology.GetTileCount();
+    int netCount = netlist.GetNetCount();
+    if( !IsRanges( netlist.m_netTileStarts, netlist.m_netTiles.size() ) ||
+        !IsRanges( netlist.m_netJumpNodeStarts, netlist.m_netJumpNodes.size() ) ||
+        !IsRanges( netlist.m_netGateNodeStarts, netlist.m_netGateNodes.size() ) ||
+        (int)netlist.m_netJumpNodeStarts.size() != netCount + 1 ||
+        (int)netlist.m_netGateNodeStarts.size() != netCount + 1 ||
+        !IsInRange( netlist.m_tileNets, -1, netCount ) ||
+        !IsInRange( netlist.m_netTiles, 0, tileCount ) ||
+        !IsInRange( netlist.m_netJumpNodes, 0, (int)netlist.m_jumpNodes.size() ) ||
+        !IsInRange( netlist.m_netGateNodes, 0, (int)netlist.m_gateNodes.size() ) ||
+        !IsInRange( netlist.m_tileJumpNodes, -1, (int)netlist.m_jumpNodes.size() ) )
+    {
+        return false;
+    }
+
+    // Nets hold exactly the wires, and node sides and corners are wires or -1; nodes sit on tiles
+    // of their own type, which are inside the border (the type plane was checked on load)
+    for( int i = 0; i < tileCount; i++ )
+    {
+        if( ( netlist.m_tileNets[ i ] >= 0 ) != SimKernel::IsWire( topology.GetType( i ) ) )
+        {
+            return false;
+        }
+    }
+    for( size_t i = 0; i < netlist.m_netTiles.size(); i++ )
+    {
+        int net = netlist.m_tileNets[ netlist.m_netTiles[ i ] ];
+        if( net < 0 || (int)i < netlist.m_netTileStarts[ net ] || (int)i >= netlist.m_netTileStarts[ net + 1 ] )
+        {
+            return false;
+        }
+    }
+
+    for( size_t i = 0; i < netlist.m_jumpNodes.size(); i++ )
+    {
+        const SimNetlist::JumpNode& node = netlist.m_jumpNodes[ i ];
+        WireSim::SimType type = ( node.index >= 0 && node.index < tileCount ) ? topology.GetType( node.index ) : WireSim::cSimType_None;
+        if( type != ( node.isNot ? WireSim::cSimType_NotGate : WireSim::cSimType_JumpJoint ) || netlist.m_tileJumpNodes[ node.index ] != (int)i )
+        {
+            return false;
+        }
+        for( int j = 0; j < SimNetlist::cSideCount; j++ )
+        {
+            if( node.sideTiles[ j ] != -1 && ( node.sideTiles[ j ] < 0 || node.sideTiles[ j ] >= tileCount || netlist.m_tileNets[ node.sideTiles[ j ] ] < 0 ) )
+            {
+                return false;
+            }
+        }
+    }
+
+    for( size_t i = 0; i < netlist.m_gateNodes.size(); i++ )
+    {
+        const SimNetlist::GateNode& node = netlist.m_gateNodes[ i ];
+        WireSim::SimType type = ( node.index >= 0 && node.index < tileCount ) ? topology.GetType( node.index ) : WireSim::cSimType_None;
+        if( type != node.type || ( type != WireSim::cSimType_AndGate && type != WireSim::cSimType_OrGate && type != WireSim::cSimType_XorGate ) )
+        {
+            return false;
+        }
+        for( int j = 0; j < SimNetlist::cSideCount; j++ )
+        {
+            int tiles[ 2 ] = { node.cornerTiles[ j ], node.sideTiles[ j ] };
+            for( int k = 0; k < 2; k++ )
+            {
+                if( tiles[ k ] != -1 && ( tiles[ k ] < 0 || tiles[ k ] >= tileCount || netlist.m_tileNets[ tiles[ k ] ] < 0 ) )
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
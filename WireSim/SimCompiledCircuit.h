@@ -0,0 +1,118 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Circuit compiled ahead of time from its PNG (see
+ WireSim::CompileCircuit), so large images start up without
+ being decoded: a fixed header, then the type plane, initial
+ power plane, pin rows and netlist (see SimNetlist) of a
+ topology, each in its exact in-memory layout.
+
+ Loading maps the file (see SimMappedFile). The type plane is
+ used right where it is mapped; everything else is copied out
+ in one go per array, the netlist only once something asks for
+ it (see SimTopology::GetNetlist). Nothing is decoded or parsed,
+ but every value is range-checked once as it is loaded (the
+ type plane is read through for that), so a corrupt file is
+ refused instead of indexing out of bounds.
+
+ Sections start on cache-line boundaries. Everything is stored
+ in native byte order and struct layout, which the header
+ records; a compiled circuit is only loaded by builds with the
+ same layout, and is meant to be rebuilt from its PNG anywhere
+ else.
+
+***/
+
+#ifndef __SIMCOMPILEDCIRCUIT_H__
+#define __SIMCOMPILEDCIRCUIT_H__
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class SimMappedFile;
+class SimNetlist;
+class SimTopology;
+
+class SimCompiledCircuit
+{
+
+public:
+
+    // Write the given topology and its netlist; returns true on success, false on failure
+    static bool Save( const char* fileName, const SimTopology& topology );
+
+    // True if the given file contents start like a compiled circuit
+    static bool IsCompiled( const unsigned char* data, size_t size );
+
+    // Set up an empty topology from a mapped compiled circuit, taking over the mapping; returns
+    // true on success, false on failure, in which case neither is changed
+    static bool Load( SimTopology& topologyOut, std::unique_ptr< SimMappedFile >& file );
+
+    // Copy the netlist out of the compiled circuit the given topology was loaded from; returns
+    // NULL on failure
+    static std::shared_ptr< const SimNetlist > LoadNetlist( const SimTopology& topology );
+
+private:
+
+    // Identifies the file and the layout it was written with, and holds the length of every array
+    struct Header
+    {
+        char magic[ 8 ];
+        uint32_t version;
+        int32_t intSize;
+        int32_t jumpNodeSize;
+        int32_t gateNodeSize;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        int32_t tileCount;
+        int32_t wordCount;
+        int32_t inputCount;
+        int32_t outputCount;
+        int32_t netCount;
+        int32_t netTileCount;
+        int32_t jumpNodeCount;
+        int32_t gateNodeCount;
+        int32_t netJumpNodeCount;
+        int32_t netGateNodeCount;
+    };
+
+    // Byte offset of every section, in file order, and the size of the whole file
+    struct Layout
+    {
+        size_t types;
+        size_t words;
+        size_t inputs;
+        size_t outputs;
+        size_t tileNets;
+        size_t netTiles;
+        size_t netTileStarts;
+        size_t jumpNodes;
+        size_t gateNodes;
+        size_t netJumpNodes;
+        size_t netJumpNodeStarts;
+        size_t netGateNodes;
+        size_t netGateNodeStarts;
+        size_t tileJumpNodes;
+        size_t fileSize;
+    };
+
+    static Layout GetLayout( const Header& header );
+
+    // Check a header against this build and the size of its file; returns true if it can be loaded
+    static bool IsValid( const Header& header, size_t fileSize );
+
+    // Check every tile type and pin of a valid header's file, once on load; returns true if the
+    // kernel and every engine can use them without reading out of bounds
+    static bool IsValidTiles( const Header& header, const uint8_t* types, const std::vector< int >& inputIndices, const std::vector< int >& outputIndices );
+
+    // Same for every index of a netlist read from the file of the given topology
+    static bool IsValidNetlist( const SimNetlist& netlist, const SimTopology& topology );
+
+};
+
+#endif // __SIMCOMPILEDCIRCUIT_H__
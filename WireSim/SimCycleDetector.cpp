@@ -0,0 +1,157 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "SimCycleDetector.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+namespace
+{
+    // Low bit of every tile in a packed word
+    const uint64_t cTileLowBits = 0x5555555555555555ULL;
+
+    // Index of the lowest set bit; word must be non-zero
+    inline int LowestBit( uint64_t word )
+    {
+        #if defined( _MSC_VER )
+            unsigned long index = 0;
+            if( _BitScanForward( &index, (unsigned long)word ) )
+            {
+                return (int)index;
+            }
+            _BitScanForward( &index, (unsigned long)( word >> 32 ) );
+            return (int)index + 32;
+        #else
+            return __builtin_ctzll( word );
+        #endif
+    }
+}
+
+SimCycleDetector::SimCycleDetector( int historySize )
+    : m_hash( 0 )
+    , m_step( 0 )
+    , m_period( 0 )
+    , m_startStep( 0 )
+{
+    int tableSize = 1;
+    while( tableSize < historySize )
+    {
+        tableSize *= 2;
+    }
+
+    m_history.resize( tableSize );
+}
+
+SimCycleDetector::~SimCycleDetector()
+{
+    // ...
+}
+
+void SimCycleDetector::Reset( const SimPowerPlane& power )
+{
+    Entry emptyEntry = { 0, -1 };
+    m_history.assign( m_history.size(), emptyEntry );
+
+    m_hash = 0;
+    m_step = 0;
+    m_period = 0;
+    m_startStep = 0;
+
+    for( int i = 0; i < power.GetWordCount(); i++ )
+    {
+        uint64_t word = power.GetWord( i );
+        uint64_t tileBits = ( word | ( word >> 1 ) ) & cTileLowBits;
+        while( tileBits != 0 )
+        {
+            int bit = LowestBit( tileBits );
+            m_hash ^= GetKey( i * SimPowerPlane::cTilesPerWord + bit / SimPowerPlane::cBitsPerTile, (int)( word >> bit ) & 0x3 );
+            tileBits &= tileBits - 1;
+        }
+    }
+
+    AddEntry();
+}
+
+bool SimCycleDetector::Record( const SimChangeList& changes )
+{
+    // Only tiles whose bits differ changed
+    for( int i = 0; i < changes.GetCount(); i++ )
+    {
+        const SimChangeList::Change& change = changes.Get( i );
+        uint64_t difference = change.oldBits ^ change.newBits;
+        uint64_t tileBits = ( difference | ( difference >> 1 ) ) & cTileLowBits;
+        while( tileBits != 0 )
+        {
+            int bit = LowestBit( tileBits );
+            int index = change.word * SimPowerPlane::cTilesPerWord + bit / SimPowerPlane::cBitsPerTile;
+            m_hash ^= GetKey( index, (int)( change.oldBits >> bit ) & 0x3 ) ^ GetKey( index, (int)( change.newBits >> bit ) & 0x3 );
+            tileBits &= tileBits - 1;
+        }
+    }
+
+    m_step++;
+    AddEntry();
+
+    return HasCycle();
+}
+
+int SimCycleDetector::GetStep() const
+{
+    return m_step;
+}
+
+uint64_t SimCycleDetector::GetHash() const
+{
+    return m_hash;
+}
+
+bool SimCycleDetector::HasCycle() const
+{
+    return ( m_period > 0 );
+}
+
+int SimCycleDetector::GetPeriod() const
+{
+    return m_period;
+}
+
+int SimCycleDetector::GetStartStep() const
+{
+    return m_startStep;
+}
+
+uint64_t SimCycleDetector::GetKey( int index, int power )
+{
+    if( power == 0 )
+    {
+        return 0;
+    }
+
+    // SplitMix64 finalizer; spreads consecutive inputs over all bits
+    uint64_t key = (uint64_t)index * 4 + (uint64_t)power;
+    key += 0x9e3779b97f4a7c15ULL;
+    key = ( key ^ ( key >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    key = ( key ^ ( key >> 27 ) ) * 0x94d049bb133111ebULL;
+    return key ^ ( key >> 31 );
+}
+
+void SimCycleDetector::AddEntry()
+{
+    Entry& entry = m_history[ (size_t)( m_hash & ( m_history.size() - 1 ) ) ];
+
+    // The slot holds the latest step that had this hash, so the distance is the exact period
+    if( !HasCycle() && entry.step >= 0 && entry.hash == m_hash )
+    {
+        m_period = m_step - entry.step;
+        m_startStep = entry.step;
+    }
+
+    entry.hash = m_hash;
+    entry.step = m_step;
+}
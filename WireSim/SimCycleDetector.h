@@ -0,0 +1,85 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Finds the step at which a simulation starts to
+ repeat itself. Circuits with feedback (not-gate loops, clocks)
+ never settle; but a circuit only has a finite number of
+ states, and every state fully determines the next one, so as
+ soon as any state shows up a second time, the same sequence of
+ states will repeat forever.
+
+ Every state is reduced to a 64-bit Zobrist hash: the XOR of
+ one key per tile and power level, with low-edge tiles adding
+ nothing. Changing a tile only flips its old and new keys, so
+ the hash is kept up to date from the changes each step lists
+ (see SimChangeList); recording a step costs nothing for the
+ tiles it did not change. Recent hashes are kept in a small direct-mapped table
+ (newer states overwrite older ones in the same slot), so
+ cycles of up to roughly the table size are found within one
+ turn of the cycle; equal hashes are trusted to be equal states.
+
+***/
+
+#ifndef __SIMCYCLEDETECTOR_H__
+#define __SIMCYCLEDETECTOR_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimChangeList.h"
+#include "SimPowerPlane.h"
+
+class SimCycleDetector
+{
+
+public:
+
+    // The history table holds the given number of states, rounded up to a power of two
+    SimCycleDetector( int historySize = 4096 );
+    ~SimCycleDetector();
+
+    // Start over from the given state, which becomes step zero
+    void Reset( const SimPowerPlane& power );
+
+    // Record the state reached by the next step, given the tiles it changed; returns true once a
+    // cycle was found (and keeps returning true until the next reset)
+    bool Record( const SimChangeList& changes );
+
+    // Number of states recorded since the last reset, and hash of the last one
+    int GetStep() const;
+    uint64_t GetHash() const;
+
+    // Length of the cycle found, and the step at which the states started to repeat; the state
+    // at that step is the same as the state period steps later. Both are zero if none was found
+    bool HasCycle() const;
+    int GetPeriod() const;
+    int GetStartStep() const;
+
+    // Key of the given tile (see SimTopology::GetIndex) at the given power level
+    static uint64_t GetKey( int index, int power );
+
+private:
+
+    struct Entry
+    {
+        uint64_t hash;
+        int step;
+    };
+
+    // Add the current state to the history, checking for an earlier occurrence first
+    void AddEntry();
+
+    std::vector< Entry > m_history;
+
+    // Hash of the last recorded state
+    uint64_t m_hash;
+    int m_step;
+
+    int m_period;
+    int m_startStep;
+
+};
+
+#endif // __SIMCYCLEDETECTOR_H__
@@ -0,0 +1,47 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Interface for alternative ways of stepping a
+ simulation (see WireSim::SetEngine). An engine advances the
+ power plane of a circuit one step at a time, and must always
+ produce exactly the same states as WireSim's own per-pixel
+ kernel; only the amount of work done may differ.
+
+***/
+
+#ifndef __SIMENGINE_H__
+#define __SIMENGINE_H__
+
+#include "SimChangeList.h"
+#include "SimPowerPlane.h"
+#include "SimTopology.h"
+
+class SimEngine
+{
+
+public:
+
+    virtual ~SimEngine() {}
+
+    // Called when attached to a simulation, and whenever the power plane was replaced
+    // wholesale; any cached activity or state must be dropped
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power ) = 0;
+
+    // Called after a tile (see SimTopology::GetIndex) was written outside of a step (e.g. WireSim::SetInput)
+    virtual void Touch( int linearIndex ) = 0;
+
+    // Advance the given power plane one step, in place; returns the amount of change (tiles or
+    // packed words, depending on the engine), which is zero only if no tile changed. Given a
+    // change list, every tile the step changed is added to it, and the plane is left as Flush
+    // would leave it; the plane must have been flushed before the first such step
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut ) = 0;
+
+    // Called before the power plane is read as a whole (e.g. WireSim::SaveState); engines that
+    // keep part of the state elsewhere between steps write it back here
+    virtual void Flush( const SimTopology&, SimPowerPlane& ) {}
+
+};
+
+#endif // __SIMENGINE_H__
@@ -0,0 +1,241 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#include "../lodepng.h"
+#include "SimFrameWriter.h"
+#include "SimTopology.h"
+#include "WireSim.h"
+
+SimFrameWriter::SimFrameWriter( int threadCount, int maxFrameCount, size_t maxByteCount, bool isOrdered )
+    : m_maxFrameCount( std::max( 1, maxFrameCount ) )
+    , m_maxByteCount( maxByteCount )
+    , m_isOrdered( isOrdered )
+    , m_byteCount( 0 )
+    , m_isWriting( false )
+    , m_hasFailed( false )
+    , m_isExiting( false )
+    , m_queuedFrameCount( 0 )
+    , m_queueDepthSum( 0.0 )
+    , m_encodeTimeSum( 0.0 )
+{
+    m_metrics.frameCount = 0;
+    m_metrics.maxQueueDepth = 0;
+    m_metrics.averageQueueDepth = 0.0;
+    m_metrics.averageEncodeTime = 0.0;
+    m_metrics.maxEncodeTime = 0.0;
+    m_metrics.waitTime = 0.0;
+    m_metrics.peakByteCount = 0;
+
+    if( threadCount <= 0 )
+    {
+        threadCount = std::max( 1, (int)std::thread::hardware_concurrency() );
+    }
+
+    for( int i = 0; i < threadCount; i++ )
+    {
+        m_workers.push_back( std::thread( &SimFrameWriter::WorkerMain, this ) );
+    }
+}
+
+SimFrameWriter::~SimFrameWriter()
+{
+    Flush();
+
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_isExiting = true;
+    }
+    m_workCondition.notify_all();
+
+    for( int i = 0; i < (int)m_workers.size(); i++ )
+    {
+        m_workers[ i ].join();
+    }
+}
+
+int SimFrameWriter::GetThreadCount() const
+{
+    return (int)m_workers.size();
+}
+
+void SimFrameWriter::Write( const std::shared_ptr< const SimTopology >& topology, const SimPowerPlane& power, const char* pngOutFileName, int pixelSize, bool highlightEdgeChanges, WireSim::SaveProfile profile )
+{
+    std::unique_ptr< Frame > frame( new Frame() );
+    frame->topology = topology;
+    frame->power = power;
+    frame->fileName = pngOutFileName;
+    frame->pixelSize = pixelSize;
+    frame->highlightEdgeChanges = highlightEdgeChanges;
+    frame->profile = profile;
+    frame->isEncoding = false;
+    frame->isEncoded = false;
+    frame->isFailed = false;
+    frame->byteCount = EstimateByteCount( *topology, power, pixelSize );
+
+    {
+        std::unique_lock< std::mutex > lock( m_mutex );
+
+        std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+        while( !m_frames.empty() && ( (int)m_frames.size() >= m_maxFrameCount || m_byteCount + frame->byteCount > m_maxByteCount ) )
+        {
+            m_spaceCondition.wait( lock );
+        }
+        m_metrics.waitTime += std::chrono::duration< double >( std::chrono::steady_clock::now() - waitStart ).count();
+
+        m_byteCount += frame->byteCount;
+        m_frames.push_back( std::move( frame ) );
+
+        m_queuedFrameCount++;
+        m_queueDepthSum += (double)m_frames.size();
+        m_metrics.maxQueueDepth = std::max( m_metrics.maxQueueDepth, (int)m_frames.size() );
+        m_metrics.peakByteCount = std::max( m_metrics.peakByteCount, m_byteCount );
+    }
+    m_workCondition.notify_one();
+}
+
+bool SimFrameWriter::Flush()
+{
+    std::unique_lock< std::mutex > lock( m_mutex );
+    while( !m_frames.empty() )
+    {
+        m_spaceCondition.wait( lock );
+    }
+
+    bool hasSucceeded = !m_hasFailed;
+    m_hasFailed = false;
+    return hasSucceeded;
+}
+
+SimFrameWriter::Metrics SimFrameWriter::GetMetrics() const
+{
+    std::lock_guard< std::mutex > lock( m_mutex );
+
+    Metrics metrics = m_metrics;
+    metrics.averageQueueDepth = ( m_queuedFrameCount > 0 ) ? m_queueDepthSum / m_queuedFrameCount : 0.0;
+    metrics.averageEncodeTime = ( m_metrics.frameCount > 0 ) ? m_encodeTimeSum / m_metrics.frameCount : 0.0;
+    return metrics;
+}
+
+size_t SimFrameWriter::EstimateByteCount( const SimTopology& topology, const SimPowerPlane& power, int pixelSize )
+{
+    size_t pixelCount = (size_t)topology.GetWidth() * topology.GetHeight() * pixelSize * pixelSize;
+    return (size_t)power.GetWordCount() * sizeof( uint64_t ) + pixelCount * 2;
+}
+
+void SimFrameWriter::WorkerMain()
+{
+    std::unique_lock< std::mutex > lock( m_mutex );
+    for( ;; )
+    {
+        // Oldest frame nobody has picked up yet
+        Frame* frame = NULL;
+        for( size_t i = 0; i < m_frames.size() && frame == NULL; i++ )
+        {
+            if( !m_frames[ i ]->isEncoding )
+            {
+                frame = m_frames[ i ].get();
+            }
+        }
+
+        if( frame == NULL )
+        {
+            if( m_isExiting )
+            {
+                return;
+            }
+            m_workCondition.wait( lock );
+            continue;
+        }
+
+        frame->isEncoding = true;
+        lock.unlock();
+
+        // Frames are only ever removed by the thread that writes them, so this one stays put
+        std::chrono::steady_clock::time_point encodeStart = std::chrono::steady_clock::now();
+        frame->isFailed = !WireSim::EncodeState( *frame->topology, frame->power, frame->pixelSize, frame->highlightEdgeChanges, frame->pngData, frame->profile );
+        frame->power = SimPowerPlane();
+        double encodeTime = std::chrono::duration< double >( std::chrono::steady_clock::now() - encodeStart ).count();
+
+        lock.lock();
+        frame->isEncoded = true;
+        m_encodeTimeSum += encodeTime;
+        m_metrics.maxEncodeTime = std::max( m_metrics.maxEncodeTime, encodeTime );
+
+        // From here on only the PNG is held
+        m_byteCount -= frame->byteCount;
+        frame->byteCount = frame->pngData.capacity();
+        m_byteCount += frame->byteCount;
+        m_spaceCondition.notify_all();
+
+        if( m_isOrdered )
+        {
+            WriteFrames( lock );
+        }
+        else
+        {
+            lock.unlock();
+            bool isFailed = !WriteFrame( *frame );
+            lock.lock();
+            RemoveFrame( frame, isFailed );
+        }
+    }
+}
+
+bool SimFrameWriter::WriteFrame( const Frame& frame )
+{
+    if( frame.isFailed )
+    {
+        printf( "Error encoding\n" );
+        return false;
+    }
+
+    if( lodepng_save_file( &frame.pngData[ 0 ], frame.pngData.size(), frame.fileName.c_str() ) != 0 )
+    {
+        printf( "Error writing \"%s\"\n", frame.fileName.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+void SimFrameWriter::WriteFrames( std::unique_lock< std::mutex >& lock )
+{
+    while( !m_isWriting && !m_frames.empty() && m_frames.front()->isEncoded )
+    {
+        // Stays in the queue until written, so it keeps counting as in flight
+        Frame* frame = m_frames.front().get();
+        m_isWriting = true;
+        lock.unlock();
+
+        bool isFailed = !WriteFrame( *frame );
+
+        lock.lock();
+        m_isWriting = false;
+        RemoveFrame( frame, isFailed );
+    }
+}
+
+void SimFrameWriter::RemoveFrame( Frame* frame, bool isFailed )
+{
+    for( size_t i = 0; i < m_frames.size(); i++ )
+    {
+        if( m_frames[ i ].get() == frame )
+        {
+            m_byteCount -= frame->byteCount;
+            m_frames.erase( m_frames.begin() + i );
+            break;
+        }
+    }
+
+    m_metrics.frameCount++;
+    m_hasFailed = m_hasFailed || isFailed;
+    m_spaceCondition.notify_all();
+}
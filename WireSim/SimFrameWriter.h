@@ -0,0 +1,145 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Background PNG writer for frame dumps (see
+ WireSim::SaveState). Encoding a frame costs far more than
+ stepping the simulation, so the simulation only hands over a
+ copy of its packed power plane (two bits per tile, sharing
+ chunks until either side writes them, see SimPowerPlane) and
+ moves on; a pool of encoder threads turns queued frames into PNGs,
+ each thread encoding whole frames on its own. By default
+ files are still written in the order the frames were queued
+ (a frame that is done early waits for the ones before it);
+ unordered writers let every thread write its own frames as
+ soon as they are encoded.
+
+ Frames in flight (queued, being encoded, or waiting to be
+ written) are bounded both in number and in memory; each is
+ charged its estimated peak while encoding, and its PNG size
+ once encoded. Once either limit is reached, queuing a frame
+ blocks until enough frames are written, so a simulation that
+ outruns its encoders slows down to their pace instead of
+ piling up memory. A single frame is always let through, even
+ if it alone is over budget.
+
+***/
+
+#ifndef __SIMFRAMEWRITER_H__
+#define __SIMFRAMEWRITER_H__
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stddef.h>
+
+#include "SimPowerPlane.h"
+#include "WireSim.h"
+
+class SimTopology;
+
+class SimFrameWriter
+{
+
+public:
+
+    // Thread count of zero uses one per hardware thread
+    SimFrameWriter( int threadCount = 0, int maxFrameCount = 16, size_t maxByteCount = 256 * 1024 * 1024, bool isOrdered = true );
+
+    // Writes all frames still in flight
+    ~SimFrameWriter();
+
+    int GetThreadCount() const;
+
+    // Queue a frame of the given circuit; blocks while the limit on frames in flight is reached
+    void Write( const std::shared_ptr< const SimTopology >& topology, const SimPowerPlane& power, const char* pngOutFileName, int pixelSize, bool highlightEdgeChanges, WireSim::SaveProfile profile = WireSim::cSaveProfile_Default );
+
+    // Wait for every queued frame to be written; returns false if any frame failed since the last call
+    bool Flush();
+
+    // Totals since the writer was created; times in seconds
+    struct Metrics
+    {
+        int frameCount;             // Frames written or failed
+        int maxQueueDepth;          // Frames in flight when queuing a frame, including it
+        double averageQueueDepth;
+        double averageEncodeTime;   // Per frame
+        double maxEncodeTime;
+        double waitTime;            // Time spent blocked in Write
+        size_t peakByteCount;       // Memory charged to frames in flight
+    };
+
+    Metrics GetMetrics() const;
+
+protected:
+
+    // Frame from queuing to writing
+    struct Frame
+    {
+        std::shared_ptr< const SimTopology > topology;
+        SimPowerPlane power;
+        std::string fileName;
+        int pixelSize;
+        bool highlightEdgeChanges;
+        WireSim::SaveProfile profile;
+
+        bool isEncoding;
+        bool isEncoded;
+        bool isFailed;
+        std::vector< unsigned char > pngData;
+
+        // Memory charged against the budget
+        size_t byteCount;
+    };
+
+    // Memory taken by a frame at its peak: its power plane, then the raw image and the filtered
+    // copy the encoder makes of it (one byte per pixel at most)
+    static size_t EstimateByteCount( const SimTopology& topology, const SimPowerPlane& power, int pixelSize );
+
+    // Encoder thread main loop
+    void WorkerMain();
+
+    // Write a frame's PNG to its file; returns false on failure. Called without the lock
+    static bool WriteFrame( const Frame& frame );
+
+    // Write out all encoded frames at the front of the queue; called with the lock held, which
+    // is released while writing
+    void WriteFrames( std::unique_lock< std::mutex >& lock );
+
+    // Remove a written frame from the queue; called with the lock held
+    void RemoveFrame( Frame* frame, bool isFailed );
+
+private:
+
+    std::vector< std::thread > m_workers;
+    int m_maxFrameCount;
+    size_t m_maxByteCount;
+    bool m_isOrdered;
+
+    // Frames in flight, oldest first, and the memory charged for them
+    std::deque< std::unique_ptr< Frame > > m_frames;
+    size_t m_byteCount;
+
+    // Only one thread writes files at a time in ordered mode, so they land in order
+    bool m_isWriting;
+    bool m_hasFailed;
+    bool m_isExiting;
+
+    // Running totals for GetMetrics
+    int m_queuedFrameCount;
+    double m_queueDepthSum;
+    double m_encodeTimeSum;
+    Metrics m_metrics;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_spaceCondition;
+
+};
+
+#endif // __SIMFRAMEWRITER_H__
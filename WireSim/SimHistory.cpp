@@ -0,0 +1,208 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "SimHistory.h"
+#include "SimSnapshot.h"
+
+SimHistory::SimHistory( const std::shared_ptr< const SimTopology >& topology, int keyframeInterval )
+    : m_topology( topology )
+    , m_keyframeInterval( std::max( 1, keyframeInterval ) )
+    , m_firstStep( 0 )
+    , m_bitmapWordCount( 0 )
+{
+}
+
+SimHistory::~SimHistory()
+{
+    // ...
+}
+
+void SimHistory::Reset( const SimPowerPlane& power, int64_t stepCount )
+{
+    m_firstStep = stepCount;
+    m_changedWords.clear();
+    m_changeMasks.clear();
+    m_stepStarts.clear();
+
+    m_keyframes.clear();
+    m_keyframes.push_back( std::make_shared< SimSnapshot >( m_topology, power, stepCount ) );
+
+    m_writes.Clear();
+    m_bitmapWordCount = ( power.GetWordCount() + 63 ) / 64;
+}
+
+void SimHistory::Record( const SimPowerPlane& power, const SimChangeList& changes )
+{
+    StepStart stepStart = { m_changedWords.size(), m_changeMasks.size() };
+    m_stepStarts.push_back( stepStart );
+
+    // Words are stored once each, in order; the packed kernel lists them that way already
+    m_stepMasks.clear();
+    AddChanges( m_writes );
+    AddChanges( changes );
+    m_writes.Clear();
+
+    bool isSorted = true;
+    for( size_t i = 1; i < m_stepMasks.size() && isSorted; i++ )
+    {
+        isSorted = ( m_stepMasks[ i - 1 ].first < m_stepMasks[ i ].first );
+    }
+    if( !isSorted )
+    {
+        std::sort( m_stepMasks.begin(), m_stepMasks.end() );
+    }
+
+    for( size_t i = 0; i < m_stepMasks.size(); )
+    {
+        int word = m_stepMasks[ i ].first;
+        uint64_t mask = 0;
+        for( ; i < m_stepMasks.size() && m_stepMasks[ i ].first == word; i++ )
+        {
+            mask ^= m_stepMasks[ i ].second;
+        }
+
+        // Tiles written and then stepped back to where they were did not change
+        if( mask != 0 )
+        {
+            m_changedWords.push_back( word );
+            m_changeMasks.push_back( mask );
+        }
+    }
+
+    // Busy steps swap their index list for a bitmap
+    size_t changeCount = m_changedWords.size() - stepStart.firstWord;
+    if( changeCount * sizeof( int ) > m_bitmapWordCount * sizeof( uint64_t ) )
+    {
+        m_changeMasks.resize( m_changeMasks.size() + m_bitmapWordCount, 0 );
+        uint64_t* bitmap = &m_changeMasks[ m_changeMasks.size() - m_bitmapWordCount ];
+        for( size_t i = stepStart.firstWord; i < m_changedWords.size(); i++ )
+        {
+            bitmap[ m_changedWords[ i ] / 64 ] |= (uint64_t)1 << ( m_changedWords[ i ] % 64 );
+        }
+        m_changedWords.resize( stepStart.firstWord );
+    }
+
+    int64_t step = GetLastStep();
+    if( ( step - m_firstStep ) % m_keyframeInterval == 0 )
+    {
+        m_keyframes.push_back( std::make_shared< SimSnapshot >( m_topology, power, step, m_keyframes.back().get() ) );
+    }
+}
+
+int64_t SimHistory::GetFirstStep() const
+{
+    return m_firstStep;
+}
+
+int64_t SimHistory::GetLastStep() const
+{
+    return m_firstStep + (int64_t)m_stepStarts.size();
+}
+
+bool SimHistory::GetState( int64_t step, SimPowerPlane& powerOut ) const
+{
+    if( m_keyframes.empty() || step < m_firstStep || step > GetLastStep() )
+    {
+        return false;
+    }
+
+    // Start at the closest keyframe at or before the step, then replay changes up to it
+    int keyframe = (int)( ( step - m_firstStep ) / m_keyframeInterval );
+    m_keyframes[ keyframe ]->CopyTo( powerOut );
+    ApplyChanges( m_firstStep + (int64_t)keyframe * m_keyframeInterval, step, powerOut );
+
+    return true;
+}
+
+void SimHistory::RecordWrite( int index, int oldPower, int newPower )
+{
+    m_writes.AddTile( index, oldPower, newPower );
+}
+
+bool SimHistory::Truncate( int64_t step )
+{
+    if( m_keyframes.empty() || step < m_firstStep || step > GetLastStep() )
+    {
+        return false;
+    }
+
+    size_t stepCount = (size_t)( step - m_firstStep );
+    StepStart stepStart = GetStepStart( step );
+    m_stepStarts.resize( stepCount );
+    m_changedWords.resize( stepStart.firstWord );
+    m_changeMasks.resize( stepStart.firstMask );
+    m_keyframes.resize( stepCount / m_keyframeInterval + 1 );
+    m_writes.Clear();
+
+    return true;
+}
+
+size_t SimHistory::GetByteCount() const
+{
+    size_t byteCount = m_changedWords.capacity() * sizeof( int ) + m_changeMasks.capacity() * sizeof( uint64_t ) + m_stepStarts.capacity() * sizeof( StepStart );
+    for( size_t i = 0; i < m_keyframes.size(); i++ )
+    {
+        byteCount += m_keyframes[ i ]->GetByteCount();
+    }
+    return byteCount;
+}
+
+SimHistory::StepStart SimHistory::GetStepStart( int64_t step ) const
+{
+    size_t stepIndex = (size_t)( step - m_firstStep );
+    if( stepIndex < m_stepStarts.size() )
+    {
+        return m_stepStarts[ stepIndex ];
+    }
+
+    StepStart endStart = { m_changedWords.size(), m_changeMasks.size() };
+    return endStart;
+}
+
+void SimHistory::AddChanges( const SimChangeList& changes )
+{
+    for( int i = 0; i < changes.GetCount(); i++ )
+    {
+        const SimChangeList::Change& change = changes.Get( i );
+        m_stepMasks.push_back( std::make_pair( change.word, change.oldBits ^ change.newBits ) );
+    }
+}
+
+void SimHistory::ApplyChanges( int64_t firstStep, int64_t endStep, SimPowerPlane& power ) const
+{
+    for( int64_t step = firstStep; step < endStep; step++ )
+    {
+        StepStart stepStart = GetStepStart( step );
+        StepStart nextStart = GetStepStart( step + 1 );
+
+        if( nextStart.firstWord > stepStart.firstWord || nextStart.firstMask == stepStart.firstMask )
+        {
+            for( size_t i = 0; i < nextStart.firstWord - stepStart.firstWord; i++ )
+            {
+                int word = m_changedWords[ stepStart.firstWord + i ];
+                power.SetWord( word, power.GetWord( word ) ^ m_changeMasks[ stepStart.firstMask + i ] );
+            }
+        }
+        else
+        {
+            const uint64_t* bitmap = &m_changeMasks[ nextStart.firstMask - m_bitmapWordCount ];
+            const uint64_t* mask = &m_changeMasks[ stepStart.firstMask ];
+            for( int i = 0; i < m_bitmapWordCount; i++ )
+            {
+                for( int bit = 0; bitmap[ i ] != 0 && bit < 64; bit++ )
+                {
+                    if( ( bitmap[ i ] >> bit ) & 1 )
+                    {
+                        power.SetWord( i * 64 + bit, power.GetWord( i * 64 + bit ) ^ *mask++ );
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,113 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Record of every state a simulation went
+ through (see WireSim::SetHistoryRecording), so any earlier
+ step can be looked at again. Each step only stores the packed
+ power words that changed, as XOR masks, taken from the changes
+ the step listed (see SimChangeList); so memory and time grow
+ with activity rather than board size, and a quiet step costs
+ nothing but its offsets. Changed words are listed by index, or, once
+ that would take more space, by a bitmap over all words
+ (stored after the masks). Every so many steps a keyframe
+ (a SimSnapshot, sharing unchanged chunks with the previous
+ keyframe) is stored as well, so rebuilding a state never
+ replays more than one keyframe interval of changes.
+
+***/
+
+#ifndef __SIMHISTORY_H__
+#define __SIMHISTORY_H__
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SimChangeList.h"
+#include "SimPowerPlane.h"
+
+class SimSnapshot;
+class SimTopology;
+
+class SimHistory
+{
+
+public:
+
+    // A keyframe is stored every keyframeInterval steps
+    SimHistory( const std::shared_ptr< const SimTopology >& topology, int keyframeInterval = 256 );
+    ~SimHistory();
+
+    // Drop everything, and start over at the given state and step
+    void Reset( const SimPowerPlane& power, int64_t stepCount );
+
+    // Record the state reached by the next step, given the tiles it changed
+    void Record( const SimPowerPlane& power, const SimChangeList& changes );
+
+    // Record a tile written outside of a step (see WireSim::SetInput); stored with the changes of
+    // the next step
+    void RecordWrite( int index, int oldPower, int newPower );
+
+    // Range of steps that can be rebuilt
+    int64_t GetFirstStep() const;
+    int64_t GetLastStep() const;
+
+    // Rebuild the state of a recorded step; returns false if the step is out of range
+    bool GetState( int64_t step, SimPowerPlane& powerOut ) const;
+
+    // Forget every step after the given one, so recording goes on from there; returns false if
+    // the step is out of range
+    bool Truncate( int64_t step );
+
+    // Memory taken by changes and keyframes
+    size_t GetByteCount() const;
+
+private:
+
+    // Where the changes of a step start in the word and mask lists
+    struct StepStart
+    {
+        size_t firstWord;
+        size_t firstMask;
+    };
+
+    // Changes recorded after the given step (none if it is the last)
+    StepStart GetStepStart( int64_t step ) const;
+
+    // Apply the changes of all steps from first up to end to the given plane
+    void ApplyChanges( int64_t firstStep, int64_t endStep, SimPowerPlane& power ) const;
+
+    // Add the given changes to those of the step being recorded
+    void AddChanges( const SimChangeList& changes );
+
+    std::shared_ptr< const SimTopology > m_topology;
+    int m_keyframeInterval;
+
+    int64_t m_firstStep;
+
+    // Keyframe of every keyframe interval, starting at the first step
+    std::vector< std::shared_ptr< const SimSnapshot > > m_keyframes;
+
+    // Changes of all steps after the first; indices of changed words (empty for a step stored
+    // as bitmap), and XOR masks
+    std::vector< int > m_changedWords;
+    std::vector< uint64_t > m_changeMasks;
+    std::vector< StepStart > m_stepStarts;
+
+    // Words in a bitmap over all power words
+    int m_bitmapWordCount;
+
+    // Writes since the last recorded step
+    SimChangeList m_writes;
+
+    // Changed words and masks of the step being recorded; a word may be listed several times
+    // (engines list single tiles), so they are merged before being stored
+    std::vector< std::pair< int, uint64_t > > m_stepMasks;
+
+};
+
+#endif // __SIMHISTORY_H__
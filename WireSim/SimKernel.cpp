@@ -0,0 +1,255 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "SimKernel.h"
+
+namespace
+{
+    // Directly adjacent directions: right, down, left, top
+    const int cDirectionCount = 4;
+    const Vec2 cDirections[ cDirectionCount ] =
+    {
+        Vec2( 1, 0 ),
+        Vec2( 0, 1 ),
+        Vec2( -1, 0 ),
+        Vec2( 0, -1 ),
+    };
+
+    // Writers in reverse scan order; the first one found is the last one to write
+    const int cWriterOrder[ cDirectionCount ] = { 1, 0, 2, 3 };
+
+    // Corner offsets, relative to a gate
+    const int cCornerCount = 4;
+    const Vec2 cCorners[ cCornerCount ] =
+    {
+        Vec2( -1, -1 ),
+        Vec2( 1, -1 ),
+        Vec2( 1, 1 ),
+        Vec2( -1, 1 ),
+    };
+
+    inline int GetOffset( const SimTopology& topology, const Vec2& offset )
+    {
+        return offset.y * topology.GetStride() + offset.x;
+    }
+}
+
+const Vec2 SimKernel::cDependencyOffsets[ SimKernel::cDependencyOffsetCount ] =
+{
+    Vec2( -1, -2 ), Vec2( 0, -2 ), Vec2( 1, -2 ),
+    Vec2( -2, -1 ), Vec2( 0, -1 ), Vec2( 2, -1 ),
+    Vec2( -2, 0 ), Vec2( -1, 0 ), Vec2( 0, 0 ), Vec2( 1, 0 ), Vec2( 2, 0 ),
+    Vec2( -2, 1 ), Vec2( 0, 1 ), Vec2( 2, 1 ),
+    Vec2( -1, 2 ), Vec2( 0, 2 ), Vec2( 1, 2 ),
+};
+
+WireSim::SimPower SimKernel::EvaluateTile( const SimTopology& topology, const SimPowerPlane& power, int index )
+{
+    WireSim::SimType centerType = topology.GetType( index );
+    WireSim::SimPower centerPower = (WireSim::SimPower)power.Get( index );
+
+    // Ignore if undefined simulation tile
+    if( centerType == WireSim::cSimType_None )
+    {
+        return centerPower;
+    }
+
+    // Edges always settle, and nothing writes onto them
+    if( IsEdge( centerPower ) )
+    {
+        return Settle( centerPower );
+    }
+
+    // Only settled wires are ever written to by their neighbors
+    if( !IsWire( centerType ) )
+    {
+        return centerPower;
+    }
+
+    return EvaluateWire( topology, power, index, centerPower );
+}
+
+WireSim::SimPower SimKernel::EvaluateWire( const SimTopology& topology, const SimPowerPlane& power, int index, WireSim::SimPower centerPower )
+{
+    // Wires are never in the border, so every tile read from here on is within the layout
+    for( int i = 0; i < cDirectionCount; i++ )
+    {
+        WireSim::SimPower drivenPower = centerPower;
+        if( IsDriven( topology, power, index, cWriterOrder[ i ], centerPower, drivenPower ) )
+        {
+            return drivenPower;
+        }
+    }
+
+    return centerPower;
+}
+
+int SimKernel::EvaluateWords( const SimTopology& topology, const SimPowerPlane& source, SimPowerPlane& dest, int firstWord, int endWord, SimChangeList* changesOut )
+{
+    int tileCount = source.GetTileCount();
+
+    // Border tiles are undefined, so they are simply evaluated (and kept) like any other. Words go
+    // a chunk at a time (see SimPowerPlane): a chunk left as it was takes the source's, so dest
+    // only keeps copies of the chunks that change
+    int changedCount = 0;
+    uint64_t chunkWords[ SimPowerPlane::cChunkWordCount ];
+    for( int chunkFirstWord = firstWord; chunkFirstWord < endWord; )
+    {
+        int chunk = chunkFirstWord / SimPowerPlane::cChunkWordCount;
+        int chunkStartWord = chunk * SimPowerPlane::cChunkWordCount;
+        int chunkEndWord = chunkStartWord + source.GetChunkWordCount( chunk );
+        int rangeEndWord = std::min( endWord, chunkEndWord );
+
+        int chunkChangedCount = 0;
+        for( int i = chunkFirstWord; i < rangeEndWord; i++ )
+        {
+            uint64_t word = 0;
+            int firstIndex = i * SimPowerPlane::cTilesPerWord;
+            int wordTileCount = std::min( SimPowerPlane::cTilesPerWord, tileCount - firstIndex );
+            for( int j = 0; j < wordTileCount; j++ )
+            {
+                word |= (uint64_t)EvaluateTile( topology, source, firstIndex + j ) << ( j * SimPowerPlane::cBitsPerTile );
+            }
+
+            uint64_t sourceWord = source.GetWord( i );
+            if( word != sourceWord )
+            {
+                chunkChangedCount++;
+                if( changesOut )
+                {
+                    changesOut->AddWord( i, sourceWord, word );
+                }
+            }
+            chunkWords[ i - chunkFirstWord ] = word;
+        }
+
+        bool isWholeChunk = ( chunkFirstWord == chunkStartWord && rangeEndWord == chunkEndWord );
+        if( chunkChangedCount == 0 && ( isWholeChunk || dest.IsSharedChunk( chunk, source ) ) )
+        {
+            dest.ShareChunk( chunk, source );
+        }
+        else
+        {
+            for( int i = chunkFirstWord; i < rangeEndWord; i++ )
+            {
+                dest.SetWord( i, chunkWords[ i - chunkFirstWord ] );
+            }
+        }
+
+        changedCount += chunkChangedCount;
+        chunkFirstWord = rangeEndWord;
+    }
+
+    return changedCount;
+}
+
+bool SimKernel::IsDriven( const SimTopology& topology, const SimPowerPlane& power, int index, int direction, WireSim::SimPower centerPower, WireSim::SimPower& drivenPowerOut )
+{
+    int offset = GetOffset( topology, cDirections[ direction ] );
+    int writerIndex = index + offset;
+    WireSim::SimType writerType = topology.GetType( writerIndex );
+    WireSim::SimPower writerPower = (WireSim::SimPower)power.Get( writerIndex );
+
+    switch( writerType )
+    {
+        // Wires only spread on their own edge-change, toward their new level
+        case WireSim::cSimType_WireType0:
+        case WireSim::cSimType_WireType1:
+            {
+                WireSim::SimPower writerLevel = Settle( writerPower );
+                if( IsEdge( writerPower ) && writerLevel != centerPower )
+                {
+                    drivenPowerOut = ( writerLevel == WireSim::cSimPower_HighEdge ) ? WireSim::cSimPower_RisingEdge : WireSim::cSimPower_FallingEdge;
+                    return true;
+                }
+            }
+            break;
+
+        // Low joints / not-gates write right and down, high ones left and top; we are the
+        // output, and the source is on the far side of the writer
+        case WireSim::cSimType_JumpJoint:
+        case WireSim::cSimType_NotGate:
+            {
+                bool writesRightDown = ( Settle( writerPower ) == WireSim::cSimPower_LowEdge );
+                bool isRightDown = ( direction == 2 || direction == 3 );
+                if( writesRightDown != isRightDown )
+                {
+                    break;
+                }
+
+                int sourceIndex = writerIndex + offset;
+                WireSim::SimPower resultPower = (WireSim::SimPower)power.Get( sourceIndex );
+                if( !IsWire( topology.GetType( sourceIndex ) ) || IsEdge( resultPower ) )
+                {
+                    break;
+                }
+
+                // Flip if not-gate
+                if( writerType == WireSim::cSimType_NotGate )
+                {
+                    resultPower = ( resultPower == WireSim::cSimPower_LowEdge ) ? WireSim::cSimPower_HighEdge : WireSim::cSimPower_LowEdge;
+                }
+
+                if( resultPower != centerPower )
+                {
+                    drivenPowerOut = ( resultPower == WireSim::cSimPower_LowEdge ) ? WireSim::cSimPower_FallingEdge : WireSim::cSimPower_RisingEdge;
+                    return true;
+                }
+            }
+            break;
+
+        // Gates read their settled corner wires and write all directly adjacent tiles
+        case WireSim::cSimType_AndGate:
+        case WireSim::cSimType_OrGate:
+        case WireSim::cSimType_XorGate:
+            {
+                int onCount = 0;
+                int offCount = 0;
+                for( int i = 0; i < cCornerCount; i++ )
+                {
+                    int inputIndex = writerIndex + GetOffset( topology, cCorners[ i ] );
+                    WireSim::SimPower inputPower = (WireSim::SimPower)power.Get( inputIndex );
+                    if( IsWire( topology.GetType( inputIndex ) ) && !IsEdge( inputPower ) )
+                    {
+                        onCount += ( inputPower == WireSim::cSimPower_HighEdge ) ? 1 : 0;
+                        offCount += ( inputPower == WireSim::cSimPower_LowEdge ) ? 1 : 0;
+                    }
+                }
+
+                WireSim::SimPower resultPower = WireSim::cSimPower_LowEdge;
+                if( writerType == WireSim::cSimType_AndGate && onCount >= 2 && offCount <= 0 )
+                {
+                    resultPower = WireSim::cSimPower_HighEdge;
+                }
+                else if( writerType == WireSim::cSimType_OrGate && onCount >= 1 && offCount > 0 )
+                {
+                    resultPower = WireSim::cSimPower_HighEdge;
+                }
+                else if( writerType == WireSim::cSimType_XorGate && onCount == 1 && offCount > 0 )
+                {
+                    resultPower = WireSim::cSimPower_HighEdge;
+                }
+
+                // Note that gates pulse the edge of the output's current level, as WireSim::Update does
+                if( resultPower != centerPower )
+                {
+                    drivenPowerOut = ( centerPower == WireSim::cSimPower_HighEdge ) ? WireSim::cSimPower_RisingEdge : WireSim::cSimPower_FallingEdge;
+                    return true;
+                }
+            }
+            break;
+
+        // Ignore these cases
+        case WireSim::cSimType_None:
+        default:
+            break;
+    }
+
+    return false;
+}
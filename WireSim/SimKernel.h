@@ -0,0 +1,88 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: The WireSim step, one tile at a time. The rules
+ (see WireSim.h) describe what each tile writes out to its
+ neighbors; this pulls those writes in instead, computing the
+ next power of a single tile from its neighborhood only, so
+ tiles can be evaluated in any order, in parallel, or not at
+ all.
+
+ Every write to a neighbor is a rising or falling edge onto a
+ settled wire, and only directly adjacent tiles ever write to
+ one another. Writes are defined as happening in scan order,
+ so when several neighbors write the same tile the last one
+ wins; the pull form checks the writers in reverse scan order:
+ bottom, right, left, then top.
+
+ The next state of a tile depends on the tiles marked below
+ (itself, its writers, the sources of jump / not writers and
+ the corners of gate writers). The set is symmetric, so it is
+ also the set of tiles affected by a change to a tile:
+
+           . X X X .
+           X . X . X
+           X X X X X
+           X . X . X
+           . X X X .
+
+***/
+
+#ifndef __SIMKERNEL_H__
+#define __SIMKERNEL_H__
+
+#include "SimChangeList.h"
+#include "SimPowerPlane.h"
+#include "SimTopology.h"
+#include "Vec2.h"
+#include "WireSim.h"
+
+class SimKernel
+{
+
+public:
+
+    // Offsets of every tile that can affect a tile's next state (see above)
+    static const int cDependencyOffsetCount = 17;
+    static const Vec2 cDependencyOffsets[ cDependencyOffsetCount ];
+
+    // Returns the power the given tile (see SimTopology::GetIndex) will have after the next step
+    static WireSim::SimPower EvaluateTile( const SimTopology& topology, const SimPowerPlane& power, int index );
+
+    // Same as EvaluateTile, for a tile known to be a settled wire with the given power
+    static WireSim::SimPower EvaluateWire( const SimTopology& topology, const SimPowerPlane& power, int index, WireSim::SimPower centerPower );
+
+    // Writes the next state of every tile in the given range of packed words [firstWord, endWord)
+    // into dest; returns the number of words that differ from source, which are also added to
+    // the given change list, if any. Whole chunks left unchanged are shared with source (see
+    // SimPowerPlane), so threads writing the same dest must each be given whole chunks
+    static int EvaluateWords( const SimTopology& topology, const SimPowerPlane& source, SimPowerPlane& dest, int firstWord, int endWord, SimChangeList* changesOut );
+
+    // Fast inline filters
+    static inline bool IsEdge( WireSim::SimPower simPower )
+    {
+        return ( simPower == WireSim::cSimPower_FallingEdge || simPower == WireSim::cSimPower_RisingEdge );
+    }
+
+    static inline bool IsWire( WireSim::SimType simType )
+    {
+        return ( simType == WireSim::cSimType_WireType0 || simType == WireSim::cSimType_WireType1 );
+    }
+
+    // Level an edge settles to; settled levels are returned as-is
+    static inline WireSim::SimPower Settle( WireSim::SimPower simPower )
+    {
+        return ( simPower == WireSim::cSimPower_RisingEdge || simPower == WireSim::cSimPower_HighEdge ) ? WireSim::cSimPower_HighEdge : WireSim::cSimPower_LowEdge;
+    }
+
+protected:
+
+    // Checks if the neighbor in the given direction (an index into the directly-adjacent
+    // offsets, from the tile's point of view) writes to the given settled wire tile
+    static bool IsDriven( const SimTopology& topology, const SimPowerPlane& power, int index, int direction, WireSim::SimPower centerPower, WireSim::SimPower& drivenPowerOut );
+
+};
+
+#endif // __SIMKERNEL_H__
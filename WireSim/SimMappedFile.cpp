@@ -0,0 +1,119 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "SimMappedFile.h"
+
+SimMappedFile::SimMappedFile( const char* fileName )
+    : m_data( NULL )
+    , m_size( 0 )
+{
+    #ifdef _WIN32
+        m_file = CreateFileA( fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        m_mapping = NULL;
+        LARGE_INTEGER size;
+        if( m_file != INVALID_HANDLE_VALUE && GetFileSizeEx( m_file, &size ) && size.QuadPart > 0 )
+        {
+            m_mapping = CreateFileMappingA( m_file, NULL, PAGE_READONLY, 0, 0, NULL );
+            if( m_mapping != NULL )
+            {
+                m_data = (const unsigned char*)MapViewOfFile( m_mapping, FILE_MAP_READ, 0, 0, 0 );
+                m_size = ( m_data != NULL ) ? (size_t)size.QuadPart : 0;
+            }
+        }
+    #else
+        int file = open( fileName, O_RDONLY );
+        struct stat fileStat;
+        if( file >= 0 && fstat( file, &fileStat ) == 0 && fileStat.st_size > 0 )
+        {
+            void* data = mmap( NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+            if( data != MAP_FAILED )
+            {
+                m_data = (const unsigned char*)data;
+                m_size = (size_t)fileStat.st_size;
+            }
+        }
+        if( file >= 0 )
+        {
+            close( file );
+        }
+    #endif
+}
+
+SimMappedFile::~SimMappedFile()
+{
+    #ifdef _WIN32
+        if( m_data != NULL )
+        {
+            UnmapViewOfFile( m_data );
+        }
+        if( m_mapping != NULL )
+        {
+            CloseHandle( m_mapping );
+        }
+        if( m_file != INVALID_HANDLE_VALUE )
+        {
+            CloseHandle( m_file );
+        }
+    #else
+        if( m_data != NULL )
+        {
+            munmap( (void*)m_data, m_size );
+        }
+    #endif
+}
+
+bool SimMappedFile::Sync( FILE* file )
+{
+    if( fflush( file ) != 0 )
+    {
+        return false;
+    }
+
+    #ifdef _WIN32
+        return _commit( _fileno( file ) ) == 0;
+    #else
+        return fsync( fileno( file ) ) == 0;
+    #endif
+}
+
+bool SimMappedFile::RenameOver( const char* tempFileName, const char* fileName )
+{
+    #ifdef _WIN32
+        return MoveFileExA( tempFileName, fileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+    #else
+        if( rename( tempFileName, fileName ) != 0 )
+        {
+            return false;
+        }
+
+        // The new name is an entry of the directory, which is only durable once that is synced
+        std::string directoryName( fileName );
+        size_t slash = directoryName.rfind( '/' );
+        directoryName = ( slash == std::string::npos ) ? "." : directoryName.substr( 0, slash + 1 );
+        int directory = open( directoryName.c_str(), O_RDONLY );
+        if( directory < 0 )
+        {
+            return false;
+        }
+        bool isSynced = ( fsync( directory ) == 0 );
+        close( directory );
+        return isSynced;
+    #endif
+}
@@ -0,0 +1,59 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Read-only view of a whole file, mapped into
+ memory; pages are only read from disk once they are touched,
+ and are shared with every other process mapping the same
+ file. Used for everything WireSim loads without decoding
+ (see SimCheckpoint and SimCompiledCircuit).
+
+***/
+
+#ifndef __SIMMAPPEDFILE_H__
+#define __SIMMAPPEDFILE_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+class SimMappedFile
+{
+
+public:
+
+    // Map the given file; on failure (or if the file is empty) there is no data
+    SimMappedFile( const char* fileName );
+    ~SimMappedFile();
+
+    // Contents of the file, or NULL
+    const unsigned char* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+    // Flush the given file opened for writing all the way to disk; returns false on failure
+    static bool Sync( FILE* file );
+
+    // Replace the target with a completely written (and synced) file; files that may be mapped are
+    // never rewritten in place, since views of the old contents stay valid only that way. Returns
+    // once the rename itself is on disk (the directory is synced too). Unlike POSIX, Windows does
+    // not replace on rename
+    static bool RenameOver( const char* tempFileName, const char* fileName );
+
+private:
+
+    // Not copyable; the mapping is released by the destructor
+    SimMappedFile( const SimMappedFile& );
+    SimMappedFile& operator=( const SimMappedFile& );
+
+    const unsigned char* m_data;
+    size_t m_size;
+
+    // File and mapping handles
+    #ifdef _WIN32
+        void* m_file;
+        void* m_mapping;
+    #endif
+
+};
+
+#endif // __SIMMAPPEDFILE_H__
@@ -0,0 +1,152 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "SimKernel.h"
+#include "SimNetlist.h"
+
+SimNetlist::SimNetlist( const SimTopology& topology )
+{
+    int stride = topology.GetStride();
+    const int sideOffsets[ cSideCount ] = { 1, stride, -1, -stride };
+    const int cornerOffsets[ cSideCount ] = { -stride - 1, -stride + 1, stride + 1, stride - 1 };
+
+    int tileCount = topology.GetTileCount();
+    m_tileNets.assign( tileCount, -1 );
+    m_tileJumpNodes.assign( tileCount, -1 );
+    m_netTileStarts.push_back( 0 );
+
+    // Flood-fill wires into nets; the border keeps every neighbor read within the layout
+    std::vector< int > stack;
+    for( int y = 0; y < topology.GetHeight(); y++ )
+    {
+        for( int x = 0; x < topology.GetWidth(); x++ )
+        {
+            int index = topology.GetIndex( x, y );
+            if( m_tileNets[ index ] >= 0 || !SimKernel::IsWire( topology.GetType( index ) ) )
+            {
+                continue;
+            }
+
+            int net = GetNetCount();
+            m_tileNets[ index ] = net;
+            stack.push_back( index );
+
+            while( !stack.empty() )
+            {
+                int tile = stack.back();
+                stack.pop_back();
+                m_netTiles.push_back( tile );
+
+                for( int i = 0; i < cSideCount; i++ )
+                {
+                    int neighbor = tile + sideOffsets[ i ];
+                    if( m_tileNets[ neighbor ] < 0 && SimKernel::IsWire( topology.GetType( neighbor ) ) )
+                    {
+                        m_tileNets[ neighbor ] = net;
+                        stack.push_back( neighbor );
+                    }
+                }
+            }
+
+            m_netTileStarts.push_back( (int)m_netTiles.size() );
+        }
+    }
+
+    // Nodes are collected per net, then flattened
+    std::vector< std::vector< int > > netJumpNodes( GetNetCount() );
+    std::vector< std::vector< int > > netGateNodes( GetNetCount() );
+
+    // Then the nodes between them
+    for( int y = 0; y < topology.GetHeight(); y++ )
+    {
+        for( int x = 0; x < topology.GetWidth(); x++ )
+        {
+            int index = topology.GetIndex( x, y );
+            WireSim::SimType simType = topology.GetType( index );
+
+            switch( simType )
+            {
+                case WireSim::cSimType_JumpJoint:
+                case WireSim::cSimType_NotGate:
+                    {
+                        JumpNode node;
+                        node.index = index;
+                        node.isNot = ( simType == WireSim::cSimType_NotGate );
+                        for( int i = 0; i < cSideCount; i++ )
+                        {
+                            node.sideTiles[ i ] = ( m_tileNets[ index + sideOffsets[ i ] ] >= 0 ) ? index + sideOffsets[ i ] : -1;
+                            if( node.sideTiles[ i ] >= 0 )
+                            {
+                                std::vector< int >& netNodes = netJumpNodes[ m_tileNets[ node.sideTiles[ i ] ] ];
+                                if( netNodes.empty() || netNodes.back() != (int)m_jumpNodes.size() )
+                                {
+                                    netNodes.push_back( (int)m_jumpNodes.size() );
+                                }
+                            }
+                        }
+
+                        m_tileJumpNodes[ index ] = (int)m_jumpNodes.size();
+                        m_jumpNodes.push_back( node );
+                    }
+                    break;
+
+                case WireSim::cSimType_AndGate:
+                case WireSim::cSimType_OrGate:
+                case WireSim::cSimType_XorGate:
+                    {
+                        GateNode node;
+                        node.index = index;
+                        node.type = simType;
+                        for( int i = 0; i < cSideCount; i++ )
+                        {
+                            node.cornerTiles[ i ] = ( m_tileNets[ index + cornerOffsets[ i ] ] >= 0 ) ? index + cornerOffsets[ i ] : -1;
+                            node.sideTiles[ i ] = ( m_tileNets[ index + sideOffsets[ i ] ] >= 0 ) ? index + sideOffsets[ i ] : -1;
+                            if( node.sideTiles[ i ] >= 0 )
+                            {
+                                std::vector< int >& netNodes = netGateNodes[ m_tileNets[ node.sideTiles[ i ] ] ];
+                                if( netNodes.empty() || netNodes.back() != (int)m_gateNodes.size() )
+                                {
+                                    netNodes.push_back( (int)m_gateNodes.size() );
+                                }
+                            }
+                        }
+
+                        m_gateNodes.push_back( node );
+                    }
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    m_netJumpNodeStarts.push_back( 0 );
+    m_netGateNodeStarts.push_back( 0 );
+    for( int net = 0; net < GetNetCount(); net++ )
+    {
+        m_netJumpNodes.insert( m_netJumpNodes.end(), netJumpNodes[ net ].begin(), netJumpNodes[ net ].end() );
+        m_netJumpNodeStarts.push_back( (int)m_netJumpNodes.size() );
+        m_netGateNodes.insert( m_netGateNodes.end(), netGateNodes[ net ].begin(), netGateNodes[ net ].end() );
+        m_netGateNodeStarts.push_back( (int)m_netGateNodes.size() );
+    }
+}
+
+SimNetlist::SimNetlist()
+{
+    // ...
+}
+
+SimNetlist::~SimNetlist()
+{
+    // ...
+}
+
+int SimNetlist::GetJumpNode( int index ) const
+{
+    return m_tileJumpNodes[ index ];
+}
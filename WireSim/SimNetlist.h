@@ -0,0 +1,113 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Net-level view of a circuit. Directly adjacent
+ wire tiles always share their level changes (of either wire
+ type; the kernel does not tell them apart), so every connected
+ group of wires is merged into a single net. What is left are
+ the nodes between nets:
+
+ Jump joints and not-gates copy (or invert) the tile on one
+ side onto the tile on the other; low ones copy left to right
+ and top to bottom, high ones the other way around.
+
+ And, or and xor gates read their four corners and write their
+ four directly adjacent tiles.
+
+ Built once from a topology (see SimTopology::GetNetlist);
+ nothing in here changes while simulating (the direction of a
+ jump / not node depends on its current power, so both
+ directions are kept). Everything is kept in flat arrays, so a
+ compiled circuit can store it as is.
+
+***/
+
+#ifndef __SIMNETLIST_H__
+#define __SIMNETLIST_H__
+
+#include <vector>
+
+#include "SimTopology.h"
+#include "WireSim.h"
+
+class SimNetlist
+{
+
+public:
+
+    // Sides of a node, in SimKernel's order: right, down, left, top
+    static const int cSideCount = 4;
+
+    // Jump joint or not-gate; sides that are not wires are -1
+    struct JumpNode
+    {
+        int index;
+        bool isNot;
+        int sideTiles[ cSideCount ];
+    };
+
+    // And, or or xor gate; corners (top-left, top-right, bottom-right, bottom-left) and
+    // sides that are not wires are -1
+    struct GateNode
+    {
+        int index;
+        WireSim::SimType type;
+        int cornerTiles[ cSideCount ];
+        int sideTiles[ cSideCount ];
+    };
+
+    SimNetlist( const SimTopology& topology );
+    ~SimNetlist();
+
+    // Nets; every wire tile is in exactly one, other tiles in none (-1)
+    int GetNetCount() const { return (int)m_netTileStarts.size() - 1; }
+    int GetNet( int index ) const { return m_tileNets[ index ]; }
+
+    // Tiles of a net, as a [begin, end) range into a shared list
+    const int* GetNetTilesBegin( int net ) const { return &m_netTiles[ 0 ] + m_netTileStarts[ net ]; }
+    const int* GetNetTilesEnd( int net ) const { return &m_netTiles[ 0 ] + m_netTileStarts[ net + 1 ]; }
+
+    // All nodes
+    const std::vector< JumpNode >& GetJumpNodes() const { return m_jumpNodes; }
+    const std::vector< GateNode >& GetGateNodes() const { return m_gateNodes; }
+
+    // Nodes touching a net on any side (jump / not) or with an output into it (gates), as
+    // [begin, end) ranges like the tiles
+    const int* GetNetJumpNodesBegin( int net ) const { return m_netJumpNodes.data() + m_netJumpNodeStarts[ net ]; }
+    const int* GetNetJumpNodesEnd( int net ) const { return m_netJumpNodes.data() + m_netJumpNodeStarts[ net + 1 ]; }
+    const int* GetNetGateNodesBegin( int net ) const { return m_netGateNodes.data() + m_netGateNodeStarts[ net ]; }
+    const int* GetNetGateNodesEnd( int net ) const { return m_netGateNodes.data() + m_netGateNodeStarts[ net + 1 ]; }
+
+    // Jump / not node at the given tile, or -1
+    int GetJumpNode( int index ) const;
+
+private:
+
+    // Empty netlist, filled in by SimCompiledCircuit
+    SimNetlist();
+    friend class SimCompiledCircuit;
+
+    // Net of every tile
+    std::vector< int > m_tileNets;
+
+    // Tiles of all nets, grouped by net; net n owns [ m_netTileStarts[ n ], m_netTileStarts[ n + 1 ] )
+    std::vector< int > m_netTiles;
+    std::vector< int > m_netTileStarts;
+
+    std::vector< JumpNode > m_jumpNodes;
+    std::vector< GateNode > m_gateNodes;
+
+    // Nodes of all nets, grouped by net in the same way
+    std::vector< int > m_netJumpNodes;
+    std::vector< int > m_netJumpNodeStarts;
+    std::vector< int > m_netGateNodes;
+    std::vector< int > m_netGateNodeStarts;
+
+    // Jump node of every tile, or -1
+    std::vector< int > m_tileJumpNodes;
+
+};
+
+#endif // __SIMNETLIST_H__
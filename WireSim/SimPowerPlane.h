@@ -0,0 +1,184 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Packed power states of every tile; two bits
+ per tile (see WireSim::SimPower), 32 tiles per word. This
+ is the only state that changes during a simulation step.
+
+ Words are kept in fixed-size chunks, held by shared pointers.
+ Copying a plane only copies the pointers; a chunk is copied
+ the first time a shared one is written to, and writes that
+ leave a word as it was copy nothing. So a copied plane (see
+ SimSnapshot) costs memory only for the chunks written since,
+ and a chunk whose pointer is the same in two planes holds the
+ same words in both, without looking at them.
+
+***/
+
+#ifndef __SIMPOWERPLANE_H__
+#define __SIMPOWERPLANE_H__
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class SimPowerPlane
+{
+public:
+
+    // Number of bits used for each tile, and number of tiles in a word
+    static const int cBitsPerTile = 2;
+    static const int cTilesPerWord = 32;
+
+    // Packed words per chunk
+    static const int cChunkWordCount = 128;
+
+    SimPowerPlane()
+        : m_tileCount( 0 )
+        , m_wordCount( 0 )
+    {
+    }
+
+    // Resize to hold the given number of tiles; all tiles are reset to zero (low-edge)
+    void Resize( int tileCount )
+    {
+        m_tileCount = tileCount;
+        m_wordCount = ( tileCount + cTilesPerWord - 1 ) / cTilesPerWord;
+
+        // The last chunk may be partial; its tail is left zero
+        m_chunks.resize( ( m_wordCount + cChunkWordCount - 1 ) / cChunkWordCount );
+        for( size_t i = 0; i < m_chunks.size(); i++ )
+        {
+            m_chunks[ i ] = std::make_shared< Chunk >();
+            memset( m_chunks[ i ]->words, 0, sizeof( m_chunks[ i ]->words ) );
+        }
+    }
+
+    int GetTileCount() const
+    {
+        return m_tileCount;
+    }
+
+    // Read / write a single tile's power level using linear indexing (never negative, so unsigned
+    // division is just a shift)
+    inline int Get( int index ) const
+    {
+        return (int)( ( GetWord( (unsigned)index / cTilesPerWord ) >> ( ( (unsigned)index % cTilesPerWord ) * cBitsPerTile ) ) & 0x3 );
+    }
+
+    inline void Set( int index, int power )
+    {
+        int word = (unsigned)index / cTilesPerWord;
+        int shift = ( (unsigned)index % cTilesPerWord ) * cBitsPerTile;
+        SetWord( word, ( GetWord( word ) & ~( (uint64_t)0x3 << shift ) ) | ( (uint64_t)( power & 0x3 ) << shift ) );
+    }
+
+    // Exchange contents with another plane; only pointers are swapped
+    void Swap( SimPowerPlane& other )
+    {
+        std::swap( m_tileCount, other.m_tileCount );
+        std::swap( m_wordCount, other.m_wordCount );
+        m_chunks.swap( other.m_chunks );
+    }
+
+    // Raw word access
+    int GetWordCount() const
+    {
+        return m_wordCount;
+    }
+
+    inline uint64_t GetWord( int word ) const
+    {
+        return m_chunks[ (unsigned)word / cChunkWordCount ]->words[ (unsigned)word % cChunkWordCount ];
+    }
+
+    inline void SetWord( int word, uint64_t bits )
+    {
+        std::shared_ptr< Chunk >& chunk = m_chunks[ (unsigned)word / cChunkWordCount ];
+        uint64_t* slot = &chunk->words[ (unsigned)word % cChunkWordCount ];
+        if( *slot != bits )
+        {
+            if( chunk.use_count() != 1 )
+            {
+                chunk = std::make_shared< Chunk >( *chunk );
+                slot = &chunk->words[ (unsigned)word % cChunkWordCount ];
+            }
+            *slot = bits;
+        }
+    }
+
+    // Copy all words out to / in from packed memory, of GetWordCount() words
+    void CopyWords( uint64_t* wordsOut ) const
+    {
+        for( int i = 0; i < (int)m_chunks.size(); i++ )
+        {
+            memcpy( wordsOut + i * cChunkWordCount, m_chunks[ i ]->words, GetChunkWordCount( i ) * sizeof( uint64_t ) );
+        }
+    }
+
+    void SetWords( const uint64_t* words )
+    {
+        for( int i = 0; i < (int)m_chunks.size(); i++ )
+        {
+            size_t byteCount = GetChunkWordCount( i ) * sizeof( uint64_t );
+            if( memcmp( m_chunks[ i ]->words, words + i * cChunkWordCount, byteCount ) != 0 )
+            {
+                if( m_chunks[ i ].use_count() != 1 )
+                {
+                    m_chunks[ i ] = std::make_shared< Chunk >( *m_chunks[ i ] );
+                }
+                memcpy( m_chunks[ i ]->words, words + i * cChunkWordCount, byteCount );
+            }
+        }
+    }
+
+    // Chunk access; the last chunk may hold fewer than cChunkWordCount words
+    int GetChunkCount() const
+    {
+        return (int)m_chunks.size();
+    }
+
+    int GetChunkWordCount( int chunk ) const
+    {
+        return std::min( cChunkWordCount, m_wordCount - chunk * cChunkWordCount );
+    }
+
+    const uint64_t* GetChunkWords( int chunk ) const
+    {
+        return m_chunks[ chunk ]->words;
+    }
+
+    // True if the given chunk is shared with another plane (so holds the same words in both)
+    bool IsSharedChunk( int chunk, const SimPowerPlane& other ) const
+    {
+        return m_chunks[ chunk ] == other.m_chunks[ chunk ];
+    }
+
+    // Drop the given chunk for the one of another plane of the same size
+    void ShareChunk( int chunk, const SimPowerPlane& other )
+    {
+        if( m_chunks[ chunk ] != other.m_chunks[ chunk ] )
+        {
+            m_chunks[ chunk ] = other.m_chunks[ chunk ];
+        }
+    }
+
+private:
+
+    struct Chunk
+    {
+        uint64_t words[ cChunkWordCount ];
+    };
+
+    int m_tileCount;
+    int m_wordCount;
+    std::vector< std::shared_ptr< Chunk > > m_chunks;
+
+};
+
+#endif // __SIMPOWERPLANE_H__
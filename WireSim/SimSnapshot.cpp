@@ -0,0 +1,77 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <string.h>
+
+#include "SimSnapshot.h"
+
+SimSnapshot::SimSnapshot( const std::shared_ptr< const SimTopology >& topology, const SimPowerPlane& power, int64_t stepCount, const SimSnapshot* baseSnapshot )
+    : m_topology( topology )
+    , m_power( power )
+    , m_stepCount( stepCount )
+    , m_newChunkCount( 0 )
+{
+    if( baseSnapshot != NULL && ( baseSnapshot->m_topology != topology || baseSnapshot->m_power.GetWordCount() != m_power.GetWordCount() ) )
+    {
+        baseSnapshot = NULL;
+    }
+
+    // A chunk still shared with the base was never written since; the others may have been
+    // written back to the same words
+    const SimPowerPlane* basePower = ( baseSnapshot != NULL ) ? &baseSnapshot->m_power : NULL;
+    for( int i = 0; i < m_power.GetChunkCount(); i++ )
+    {
+        if( basePower != NULL && m_power.IsSharedChunk( i, *basePower ) )
+        {
+            continue;
+        }
+
+        if( basePower != NULL && memcmp( basePower->GetChunkWords( i ), m_power.GetChunkWords( i ), m_power.GetChunkWordCount( i ) * sizeof( uint64_t ) ) == 0 )
+        {
+            m_power.ShareChunk( i, *basePower );
+        }
+        else
+        {
+            m_newChunkCount++;
+        }
+    }
+}
+
+SimSnapshot::~SimSnapshot()
+{
+    // ...
+}
+
+const std::shared_ptr< const SimTopology >& SimSnapshot::GetTopology() const
+{
+    return m_topology;
+}
+
+void SimSnapshot::CopyTo( SimPowerPlane& powerOut ) const
+{
+    powerOut = m_power;
+}
+
+int64_t SimSnapshot::GetStepCount() const
+{
+    return m_stepCount;
+}
+
+int SimSnapshot::GetChunkCount() const
+{
+    return m_power.GetChunkCount();
+}
+
+int SimSnapshot::GetNewChunkCount() const
+{
+    return m_newChunkCount;
+}
+
+size_t SimSnapshot::GetByteCount() const
+{
+    return m_newChunkCount * SimPowerPlane::cChunkWordCount * sizeof( uint64_t ) + m_power.GetChunkCount() * sizeof( std::shared_ptr< void > );
+}
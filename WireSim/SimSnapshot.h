@@ -0,0 +1,67 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Frozen state of a simulation (see
+ WireSim::Snapshot), from which any number of new simulations
+ can be forked. It holds a copy of the power plane, so shares
+ every chunk of it (see SimPowerPlane); a simulation forked
+ from it shares them in turn, and only copies the ones it
+ writes to. A chunk the plane still shares with the snapshot
+ it was forked from (or last took) has not been written since,
+ so it is shared again without looking at it; only the others
+ are compared against their base chunk. So many branches of a
+ common prefix only cost memory for the chunks each of them
+ changed, plus one pointer per chunk.
+
+***/
+
+#ifndef __SIMSNAPSHOT_H__
+#define __SIMSNAPSHOT_H__
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SimPowerPlane.h"
+
+class SimTopology;
+
+class SimSnapshot
+{
+
+public:
+
+    // Freeze the given power plane, reached after the given number of steps; chunks that hold the same words as in the base snapshot
+    // (if any, of the same topology) are shared with it rather than with the plane
+    SimSnapshot( const std::shared_ptr< const SimTopology >& topology, const SimPowerPlane& power, int64_t stepCount, const SimSnapshot* baseSnapshot = NULL );
+    ~SimSnapshot();
+
+    const std::shared_ptr< const SimTopology >& GetTopology() const;
+
+    // Copy the power plane; only chunk pointers are copied
+    void CopyTo( SimPowerPlane& powerOut ) const;
+
+    // Steps the simulation had taken
+    int64_t GetStepCount() const;
+
+    // Number of chunks, and of chunks that were new when this snapshot was taken (not shared
+    // with the base snapshot)
+    int GetChunkCount() const;
+    int GetNewChunkCount() const;
+
+    // Memory taken by chunks that were new to this snapshot, and by the chunk pointers
+    size_t GetByteCount() const;
+
+private:
+
+    std::shared_ptr< const SimTopology > m_topology;
+
+    SimPowerPlane m_power;
+    int64_t m_stepCount;
+    int m_newChunkCount;
+
+};
+
+#endif // __SIMSNAPSHOT_H__
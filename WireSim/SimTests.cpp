@@ -0,0 +1,805 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+#include <limits.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../lodepng.h"
+#include "ActiveSetEngine.h"
+#include "BitboardEngine.h"
+#include "ChunkEngine.h"
+#include "NetEngine.h"
+#include "ParallelEngine.h"
+#include "SimHistory.h"
+#include "SimPowerPlane.h"
+#include "SimSnapshot.h"
+#include "SimTests.h"
+#include "SimTopology.h"
+#include "SimdEngine.h"
+#include "TimingWheelEngine.h"
+#include "TypeListEngine.h"
+#include "WireSim.h"
+
+namespace
+{
+    // All inputs high makes its gates pulse forever (a cycle of 6 steps)
+    const char* cCycleFileName = "AndGateTests.png";
+
+    // Inputs toggle while it runs, so every branch sees changes
+    const char* cForkFileName = "JumperTests.png";
+
+    // Same size and pins as cCycleFileName
+    const char* cSameSizeFileName = "OrGateTests.png";
+
+    // Written next to the circuits, and removed again
+    const char* cCheckpointFileName = "SimTests.checkpoint";
+
+    // Written next to the circuits, and removed again
+    const char* cLargeImageFileName = "SimTests.png";
+    const char* cCompiledFileName = "SimTests.wsb";
+
+    const int cMaxEvalSteps = 10000;
+
+    // Steps taken before cycle detection starts over on an input change
+    const int cStepsBeforeInput = 5;
+
+    // Steps recorded by TestHistoryRoundTrip (more than one keyframe interval, see SimHistory),
+    // and the one it goes back to
+    const int cHistoryStepCount = 300;
+    const int cRestoredStep = 170;
+
+    // Every sample circuit; TestEngines adds a board wide and tall enough to be stepped in several bands
+    const char* cSampleFileNames[] =
+    {
+        "AndGateTests.png", "Circuit_2To4Decoder_v2.png", "Circuit_2To4Decoder_v3.png", "JumperTests.png",
+        "NotGateTests.png", "OrGateTests.png", "SolidWire.png", "StraightWireGreen.png", "StraightWireOrange.png",
+        "StraightWires.png", "WireOverlap.png", "WirePair_128Full.png", "WirePair_16Full.png", "XorGateTests.png",
+    };
+    const int cSampleCount = sizeof( cSampleFileNames ) / sizeof( cSampleFileNames[ 0 ] );
+
+    // Written next to the circuits, and removed again: cForkFileName, repeated across and down
+    const char* cTiledFileName = "SimTests_tiled.png";
+    const int cTiledCountX = 64;
+    const int cTiledCountY = 7;
+
+    // Written next to the circuits, and removed again: tiles of all gate samples, shuffled
+    const char* cRandomFileName = "SimTests_random.png";
+    const char* cRandomSourceFileNames[] = { "AndGateTests.png", "JumperTests.png", "NotGateTests.png", "OrGateTests.png", "XorGateTests.png" };
+    const int cRandomSize = 64;
+
+    // Steps compared one at a time (on the samples, and on the tiled board), and the limit when
+    // running until settled (WirePair_128Full settles after about 500)
+    const int cEngineStepCount = 80;
+    const int cTiledStepCount = 8;
+    const int cEngineEvalSteps = 600;
+
+    // Image decoded a row at a time
+    struct DecodedRows
+    {
+        std::vector< unsigned char > image;
+        unsigned int width;
+    };
+
+    void CopyRow( void* context, unsigned int y, const unsigned char* rgba )
+    {
+        DecodedRows* rows = (DecodedRows*)context;
+        memcpy( &rows->image[ (size_t)y * rows->width * 4 ], rgba, rows->width * 4 );
+    }
+
+    // True if the given PNG decodes to the same RGBA image as a whole and a row at a time
+    bool IsSameByRows( const std::vector< unsigned char >& png )
+    {
+        std::vector< unsigned char > image;
+        unsigned int width = 0, height = 0;
+        if( png.empty() || lodepng::decode( image, width, height, png ) != 0 )
+        {
+            return false;
+        }
+
+        DecodedRows rows;
+        rows.image.assign( image.size(), 0 );
+        rows.width = width;
+        lodepng::State state;
+        unsigned int rowWidth = 0, rowHeight = 0;
+        unsigned int error = lodepng_decode_rows( &rowWidth, &rowHeight, &state, &png[ 0 ], png.size(), CopyRow, &rows );
+        return error == 0 && rowWidth == width && rowHeight == height && rows.image == image;
+    }
+
+    // Encode an image with runs, noise and gradients, so rows use every filter and inflating
+    // needs the whole deflate window; returns an empty PNG on failure
+    std::vector< unsigned char > EncodeTestImage( LodePNGColorType colorType, bool isFiltered )
+    {
+        const unsigned int cWidth = 300, cHeight = 200;
+        const unsigned char cColors[ 4 ][ 3 ] = { { 0, 0, 0 }, { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 } };
+        std::vector< unsigned char > image( cWidth * cHeight * 4, 255 );
+        unsigned int seed = 1;
+        for( unsigned int y = 0; y < cHeight; y++ )
+        {
+            for( unsigned int x = 0; x < cWidth; x++ )
+            {
+                seed = seed * 1103515245 + 12345;
+                int color = ( ( x / 9 + y / 4 ) % 5 == 0 ) ? ( seed >> 16 ) % 4 : ( x * y / 97 ) % 4;
+                memcpy( &image[ ( y * cWidth + x ) * 4 ], cColors[ color ], 3 );
+            }
+        }
+
+        lodepng::State state;
+        state.encoder.auto_convert = LAC_NO;
+        state.info_png.color.colortype = colorType;
+        if( colorType == LCT_PALETTE )
+        {
+            for( int i = 0; i < 4; i++ )
+            {
+                lodepng_palette_add( &state.info_png.color, cColors[ i ][ 0 ], cColors[ i ][ 1 ], cColors[ i ][ 2 ], 255 );
+            }
+        }
+
+        // Filter types cycle from row to row
+        std::vector< unsigned char > filters( cHeight );
+        for( unsigned int y = 0; y < cHeight; y++ )
+        {
+            filters[ y ] = isFiltered ? (unsigned char)( y % 5 ) : 0;
+        }
+        state.encoder.filter_strategy = LFS_PREDEFINED;
+        state.encoder.predefined_filters = &filters[ 0 ];
+
+        std::vector< unsigned char > png;
+        if( lodepng::encode( png, image, cWidth, cHeight, state ) != 0 )
+        {
+            png.clear();
+        }
+        return png;
+    }
+
+    // Offset of the first chunk of the given type in a PNG, or 0 if there is none
+    size_t FindChunk( const std::vector< unsigned char >& png, const char* type )
+    {
+        for( size_t offset = 8; offset + 12 <= png.size(); offset += lodepng_chunk_length( &png[ offset ] ) + 12 )
+        {
+            if( lodepng_chunk_type_equals( &png[ offset ], type ) )
+            {
+                return offset;
+            }
+        }
+        return 0;
+    }
+
+    // Decode a PNG to RGBA on the given number of threads; returns an empty image on failure
+    std::vector< unsigned char > DecodeImage( const std::vector< unsigned char >& png, unsigned int threadCount )
+    {
+        lodepng::State state;
+        state.decoder.zlibsettings.threadcount = threadCount;
+        std::vector< unsigned char > image;
+        unsigned int width = 0, height = 0;
+        if( png.empty() || lodepng::decode( image, width, height, state, png ) != 0 )
+        {
+            image.clear();
+        }
+        return image;
+    }
+
+    // Split the image data of a PNG into IDAT chunks of at most the given size
+    std::vector< unsigned char > SplitImageData( const std::vector< unsigned char >& png, unsigned int chunkSize )
+    {
+        if( png.size() < 8 )
+        {
+            return png;
+        }
+
+        std::vector< unsigned char > imageData;
+        unsigned char* out = NULL;
+        size_t outSize = 0;
+        bool isWritten = false;
+        for( size_t offset = 8; offset + 12 <= png.size(); offset += lodepng_chunk_length( &png[ offset ] ) + 12 )
+        {
+            const unsigned char* chunk = &png[ offset ];
+            if( lodepng_chunk_type_equals( chunk, "IDAT" ) )
+            {
+                imageData.insert( imageData.end(), chunk + 8, chunk + 8 + lodepng_chunk_length( chunk ) );
+                continue;
+            }
+
+            // All of it goes right before the first chunk after it
+            for( size_t i = 0; !isWritten && i < imageData.size(); i += chunkSize )
+            {
+                unsigned int length = (unsigned int)std::min( (size_t)chunkSize, imageData.size() - i );
+                lodepng_chunk_create( &out, &outSize, length, "IDAT", &imageData[ i ] );
+            }
+            isWritten = isWritten || !imageData.empty();
+            lodepng_chunk_append( &out, &outSize, chunk );
+        }
+
+        std::vector< unsigned char > result( 8 + outSize );
+        memcpy( &result[ 0 ], &png[ 0 ], 8 );
+        if( outSize > 0 )
+        {
+            memcpy( &result[ 8 ], out, outSize );
+        }
+        free( out );
+        return result;
+    }
+
+    // Step with an input pattern that depends on the step only, so branches can be replayed
+    void StepWithInputs( WireSim& wireSim, int steps )
+    {
+        for( int i = 0; i < steps; i++ )
+        {
+            int64_t step = wireSim.GetStepCount();
+            for( int j = 0; j < wireSim.GetInputCount(); j++ )
+            {
+                wireSim.SetInput( j, ( ( step / 7 + j ) % 3 ) != 0 );
+            }
+            wireSim.Update();
+        }
+    }
+
+    // Engines compared with the per-pixel kernel; those that are not step-exact (the net engine
+    // settles in a single step) are only compared once the kernel has settled too
+    template< typename T >
+    SimEngine* CreateTestEngine()
+    {
+        return new T();
+    }
+
+    SimEngine* CreateParallelEngine()
+    {
+        return new ParallelEngine( 4 );
+    }
+
+    SimEngine* CreateScalarEngine()
+    {
+        return new SimdEngine( SimdEngine::cSimdLevel_Scalar );
+    }
+
+    struct EngineCase
+    {
+        const char* name;
+        SimEngine* ( *create )();
+        bool isStepExact;
+    };
+
+    const EngineCase cEngineCases[] =
+    {
+        { "NetEngine", &CreateTestEngine< NetEngine >, false },
+        { "ActiveSetEngine", &CreateTestEngine< ActiveSetEngine >, true },
+        { "ParallelEngine", &CreateParallelEngine, true },
+        { "BitboardEngine", &CreateTestEngine< BitboardEngine >, true },
+        { "SimdEngine", &CreateTestEngine< SimdEngine >, true },
+        { "SimdEngine (scalar)", &CreateScalarEngine, true },
+        { "TimingWheelEngine", &CreateTestEngine< TimingWheelEngine >, true },
+        { "ChunkEngine", &CreateTestEngine< ChunkEngine >, true },
+        { "TypeListEngine", &CreateTestEngine< TypeListEngine >, true },
+    };
+    const int cEngineCaseCount = sizeof( cEngineCases ) / sizeof( cEngineCases[ 0 ] );
+
+    // Save the given circuit repeated across and down; returns false on failure
+    bool SaveTiledImage( const char* fileName, const char* tiledFileName, unsigned int countX, unsigned int countY )
+    {
+        std::vector< unsigned char > image;
+        unsigned int width = 0, height = 0;
+        if( lodepng::decode( image, width, height, fileName ) != 0 )
+        {
+            return false;
+        }
+
+        std::vector< unsigned char > tiled( (size_t)width * countX * height * countY * 4 );
+        for( unsigned int y = 0; y < height * countY; y++ )
+        {
+            for( unsigned int i = 0; i < countX; i++ )
+            {
+                memcpy( &tiled[ ( (size_t)y * width * countX + i * width ) * 4 ], &image[ (size_t)( y % height ) * width * 4 ], width * 4 );
+            }
+        }
+        return lodepng::encode( tiledFileName, tiled, width * countX, height * countY ) == 0;
+    }
+
+    // Save a board of the given size with every tile colored like a random tile of the given
+    // circuits, so wires end up next to every kind of writer; returns false on failure
+    bool SaveRandomImage( const char* const* fileNames, int fileCount, const char* randomFileName, unsigned int width, unsigned int height )
+    {
+        std::vector< unsigned char > colors;
+        for( int i = 0; i < fileCount; i++ )
+        {
+            std::vector< unsigned char > image;
+            unsigned int imageWidth = 0, imageHeight = 0;
+            if( lodepng::decode( image, imageWidth, imageHeight, fileNames[ i ] ) != 0 )
+            {
+                return false;
+            }
+            colors.insert( colors.end(), image.begin(), image.end() );
+        }
+
+        std::vector< unsigned char > image( (size_t)width * height * 4 );
+        unsigned int seed = 7;
+        for( size_t i = 0; i < image.size(); i += 4 )
+        {
+            seed = seed * 1103515245 + 12345;
+            memcpy( &image[ i ], &colors[ ( seed >> 8 ) % ( colors.size() / 4 ) * 4 ], 4 );
+        }
+        return lodepng::encode( randomFileName, image, width, height ) == 0;
+    }
+
+    // Set every input high
+    void SetAllInputs( WireSim& wireSim )
+    {
+        for( int i = 0; i < wireSim.GetInputCount(); i++ )
+        {
+            wireSim.SetInput( i, true );
+        }
+    }
+
+    // Engines each test runs with; NULL is the per-pixel kernel
+    SimEngine* CreateEngine( int engineIndex )
+    {
+        switch( engineIndex )
+        {
+            case 1: return new ActiveSetEngine();
+            case 2: return new TimingWheelEngine();
+            default: return NULL;
+        }
+    }
+    const int cEngineCount = 3;
+}
+
+int SimTests::Run()
+{
+    int failCount = 0;
+    failCount += TestEngines();
+    failCount += TestCycleAfterInput();
+    failCount += TestForkRoundTrip();
+    failCount += TestHistoryRoundTrip();
+    failCount += TestCheckpointRoundTrip();
+    failCount += TestLoadByRows();
+    failCount += TestCompiledCircuit();
+    failCount += TestParallelImage();
+    failCount += TestEncodeTooLarge();
+
+    printf( "Tests %s (%d failed)\n", ( failCount == 0 ) ? "passed" : "FAILED", failCount );
+    return failCount;
+}
+
+int SimTests::TestEngines()
+{
+    int failCount = 0;
+    failCount += Check( SaveTiledImage( cForkFileName, cTiledFileName, cTiledCountX, cTiledCountY ), "Engines", "tiled board is saved" );
+    failCount += Check( SaveRandomImage( cRandomSourceFileNames, sizeof( cRandomSourceFileNames ) / sizeof( cRandomSourceFileNames[ 0 ] ),
+                                         cRandomFileName, cRandomSize, cRandomSize ), "Engines", "random board is saved" );
+
+    std::vector< const char* > fileNames( cSampleFileNames, cSampleFileNames + cSampleCount );
+    fileNames.push_back( cRandomFileName );
+    fileNames.push_back( cTiledFileName );
+    bool hasNetLevelStep = false;
+    bool hasFallbackStep = false;
+    for( size_t board = 0; board < fileNames.size(); board++ )
+    {
+        for( int engineIndex = 0; engineIndex < cEngineCaseCount; engineIndex++ )
+        {
+            const EngineCase& engineCase = cEngineCases[ engineIndex ];
+            std::string prefix = std::string( engineCase.name ) + " on " + fileNames[ board ] + ": ";
+
+            if( engineCase.isStepExact )
+            {
+                WireSim kernel( fileNames[ board ] );
+                WireSim engine( fileNames[ board ] );
+                engine.SetEngine( engineCase.create() );
+
+                // Large boards are only compared for a few steps
+                bool isSame = true;
+                int stepCount = ( fileNames[ board ] == cTiledFileName ) ? cTiledStepCount : cEngineStepCount;
+                for( int step = 0; step < stepCount && isSame; step++ )
+                {
+                    StepWithInputs( kernel, 1 );
+                    StepWithInputs( engine, 1 );
+                    isSame = IsSameState( kernel, engine );
+                }
+                failCount += Check( isSame, "Engines", ( prefix + "steps like the kernel" ).c_str() );
+
+                // Only the kernel runs several steps at a time in bands of rows; a block of steps
+                // is split after 8, so both runs take a partial block at the end
+                for( int i = 0; i < 2 && isSame; i++ )
+                {
+                    SetAllInputs( kernel );
+                    SetAllInputs( engine );
+                    isSame = ( kernel.Update( 9 + i * 8 ) == engine.Update( 9 + i * 8 ) ) && IsSameState( kernel, engine );
+                    StepWithInputs( kernel, 3 );
+                    StepWithInputs( engine, 3 );
+                }
+                failCount += Check( isSame, "Engines", ( prefix + "steps in bands like the kernel" ).c_str() );
+            }
+
+            // Large boards are only stepped, not run until settled
+            if( fileNames[ board ] == cTiledFileName )
+            {
+                continue;
+            }
+
+            // Only the kernel hands the last few changes to an active set engine
+            WireSim kernel( fileNames[ board ] );
+            WireSim engine( fileNames[ board ] );
+            engine.SetEngine( engineCase.create() );
+            SetAllInputs( kernel );
+            SetAllInputs( engine );
+            WireSim::EvalStatus kernelStatus = WireSim::cEvalStatus_Settled;
+            WireSim::EvalStatus engineStatus = WireSim::cEvalStatus_Settled;
+            int kernelSteps = kernel.Eval( cEngineEvalSteps, 0.0, kernelStatus );
+            int engineSteps = engine.Eval( cEngineEvalSteps, 0.0, engineStatus );
+            if( engineCase.isStepExact )
+            {
+                failCount += Check( kernelStatus == engineStatus && kernelSteps == engineSteps && IsSameState( kernel, engine ),
+                                    "Engines", ( prefix + "runs like the kernel" ).c_str() );
+            }
+            else if( kernelStatus == WireSim::cEvalStatus_Settled )
+            {
+                failCount += Check( engineStatus == WireSim::cEvalStatus_Settled && IsSameState( kernel, engine ),
+                                    "Engines", ( prefix + "settles like the kernel" ).c_str() );
+            }
+
+            NetEngine* netEngine = dynamic_cast< NetEngine* >( engine.GetEngine() );
+            if( netEngine != NULL )
+            {
+                hasNetLevelStep = hasNetLevelStep || netEngine->WasNetLevel();
+                hasFallbackStep = hasFallbackStep || !netEngine->WasNetLevel();
+            }
+        }
+    }
+
+    failCount += Check( hasNetLevelStep && hasFallbackStep, "Engines", "net engine both resolves nets and falls back to the kernel" );
+    remove( cTiledFileName );
+    remove( cRandomFileName );
+    return failCount;
+}
+
+int SimTests::TestCycleAfterInput()
+{
+    int failCount = 0;
+    for( int engineIndex = 0; engineIndex < cEngineCount; engineIndex++ )
+    {
+        WireSim wireSim( cCycleFileName );
+        failCount += Check( wireSim.GetInputCount() > 0, "CycleAfterInput", "circuit has inputs" );
+        if( wireSim.GetInputCount() == 0 )
+        {
+            return failCount;
+        }
+
+        wireSim.SetEngine( CreateEngine( engineIndex ) );
+        wireSim.SetCycleDetection( true );
+        wireSim.Update( cStepsBeforeInput );
+        for( int i = 0; i < wireSim.GetInputCount(); i++ )
+        {
+            wireSim.SetInput( i, true );
+        }
+        wireSim.SetHistoryRecording( true );
+
+        WireSim::EvalStatus status = WireSim::cEvalStatus_Settled;
+        wireSim.Eval( cMaxEvalSteps, 0.0, status );
+        int period = 0;
+        int64_t startStep = 0;
+        failCount += Check( status == WireSim::cEvalStatus_Cycle, "CycleAfterInput", "all inputs high ends in a cycle" );
+        failCount += Check( wireSim.GetCycle( period, startStep ) && period > 1, "CycleAfterInput", "cycle has a period" );
+
+        // The start step counts like GetStepCount, not from the input change
+        SimPowerPlane startPower, repeatPower;
+        failCount += Check( startStep >= cStepsBeforeInput && wireSim.GetHistory()->GetState( startStep, startPower ) &&
+                            wireSim.GetHistory()->GetState( startStep + period, repeatPower ) && IsSamePower( startPower, repeatPower ),
+                            "CycleAfterInput", "state at the start step comes back a period later" );
+
+        // The cycle no longer applies once an input changes; states after the change are new
+        wireSim.SetInput( 0, false );
+        failCount += Check( !wireSim.GetCycle( period, startStep ), "CycleAfterInput", "input change drops the cycle" );
+
+        wireSim.Eval( 1, 0.0, status );
+        failCount += Check( status == WireSim::cEvalStatus_StepLimit || status == WireSim::cEvalStatus_Settled,
+                            "CycleAfterInput", "first step after an input change is running or settled" );
+    }
+
+    return failCount;
+}
+
+int SimTests::TestForkRoundTrip()
+{
+    int failCount = 0;
+    for( int engineIndex = 0; engineIndex < cEngineCount; engineIndex++ )
+    {
+        WireSim wireSim( cForkFileName );
+        wireSim.SetEngine( CreateEngine( engineIndex ) );
+        StepWithInputs( wireSim, 20 );
+
+        // Forks start on the per-pixel kernel
+        std::unique_ptr< WireSim > fork( wireSim.Fork() );
+        failCount += Check( fork->GetStepCount() == wireSim.GetStepCount(), "ForkRoundTrip", "fork keeps the step count" );
+        failCount += Check( fork->Snapshot()->GetNewChunkCount() == 0, "ForkRoundTrip", "fork starts on the chunks of its snapshot" );
+        failCount += Check( IsSameState( *fork, wireSim ), "ForkRoundTrip", "fork starts in the same state" );
+
+        StepWithInputs( wireSim, 30 );
+        StepWithInputs( *fork, 30 );
+        failCount += Check( IsSameState( *fork, wireSim ), "ForkRoundTrip", "fork steps like its origin" );
+
+        WireSim replay( cForkFileName );
+        StepWithInputs( replay, 50 );
+        failCount += Check( IsSameState( *fork, replay ), "ForkRoundTrip", "fork steps like a replay from the start" );
+
+        // Without a step in between, a snapshot shares every chunk with the one before
+        fork->Snapshot();
+        std::shared_ptr< const SimSnapshot > unchangedSnapshot = fork->Snapshot();
+        failCount += Check( unchangedSnapshot->GetNewChunkCount() == 0, "ForkRoundTrip", "unchanged snapshot shares every chunk" );
+    }
+
+    return failCount;
+}
+
+int SimTests::TestHistoryRoundTrip()
+{
+    int failCount = 0;
+    for( int engineIndex = 0; engineIndex < cEngineCount; engineIndex++ )
+    {
+        WireSim wireSim( cForkFileName );
+        wireSim.SetEngine( CreateEngine( engineIndex ) );
+        wireSim.SetHistoryRecording( true );
+
+        // States of a replay without history; snapshots would flush the engine in between
+        WireSim replay( cForkFileName );
+        std::vector< SimPowerPlane > states( cHistoryStepCount + 1 );
+        replay.Snapshot()->CopyTo( states[ 0 ] );
+        for( int i = 1; i <= cHistoryStepCount; i++ )
+        {
+            StepWithInputs( wireSim, 1 );
+            StepWithInputs( replay, 1 );
+            replay.Snapshot()->CopyTo( states[ i ] );
+        }
+
+        const SimHistory* history = wireSim.GetHistory();
+        bool isSame = ( history->GetFirstStep() == 0 && history->GetLastStep() == cHistoryStepCount );
+        for( int i = 0; i <= cHistoryStepCount && isSame; i++ )
+        {
+            SimPowerPlane power;
+            isSame = history->GetState( i, power ) && IsSamePower( power, states[ i ] );
+        }
+        failCount += Check( isSame, "HistoryRoundTrip", "every step is rebuilt as it was" );
+
+        // Going back drops the steps after it, and recording goes on from there
+        failCount += Check( wireSim.RestoreStep( cRestoredStep ) && history->GetLastStep() == cRestoredStep, "HistoryRoundTrip", "step is restored" );
+        StepWithInputs( wireSim, 20 );
+
+        WireSim restoredReplay( cForkFileName );
+        StepWithInputs( restoredReplay, cRestoredStep + 20 );
+        SimPowerPlane power, replayPower;
+        restoredReplay.Snapshot()->CopyTo( replayPower );
+        failCount += Check( IsSameState( wireSim, restoredReplay ), "HistoryRoundTrip", "restored simulation steps like a replay" );
+        failCount += Check( history->GetState( cRestoredStep + 20, power ) && IsSamePower( power, replayPower ), "HistoryRoundTrip", "steps after a restore are recorded" );
+    }
+
+    return failCount;
+}
+
+int SimTests::TestCheckpointRoundTrip()
+{
+    int failCount = 0;
+
+    WireSim wireSim( cForkFileName );
+    StepWithInputs( wireSim, 25 );
+    failCount += Check( wireSim.SaveCheckpoint( cCheckpointFileName ), "CheckpointRoundTrip", "checkpoint is saved" );
+    StepWithInputs( wireSim, 30 );
+
+    // Loaded into a fresh simulation of the same circuit, stepping with an engine
+    WireSim loaded( cForkFileName );
+    loaded.SetEngine( new TimingWheelEngine() );
+    failCount += Check( loaded.LoadCheckpoint( cCheckpointFileName ), "CheckpointRoundTrip", "checkpoint is loaded" );
+    failCount += Check( loaded.GetStepCount() == 25, "CheckpointRoundTrip", "checkpoint keeps the step count" );
+    StepWithInputs( loaded, 30 );
+    failCount += Check( IsSameState( loaded, wireSim ), "CheckpointRoundTrip", "loaded simulation steps like the saved one" );
+
+    // A different circuit keeps its own state
+    WireSim other( cCycleFileName );
+    WireSim untouched( cCycleFileName );
+    failCount += Check( !other.LoadCheckpoint( cCheckpointFileName ), "CheckpointRoundTrip", "checkpoint of another circuit is refused" );
+    failCount += Check( other.GetStepCount() == 0 && IsSameState( other, untouched ), "CheckpointRoundTrip", "refused checkpoint changes nothing" );
+
+    // Same size and pins, different gates
+    failCount += Check( other.SaveCheckpoint( cCheckpointFileName ), "CheckpointRoundTrip", "checkpoint is saved over the last" );
+    WireSim sameSize( cSameSizeFileName );
+    failCount += Check( sameSize.GetTopology()->GetTileCount() == other.GetTopology()->GetTileCount() &&
+                        sameSize.GetInputCount() == other.GetInputCount() && sameSize.GetOutputCount() == other.GetOutputCount(),
+                        "CheckpointRoundTrip", "circuits have the same size" );
+    failCount += Check( !sameSize.LoadCheckpoint( cCheckpointFileName ), "CheckpointRoundTrip", "checkpoint of a circuit of the same size is refused" );
+
+    remove( cCheckpointFileName );
+    return failCount;
+}
+
+int SimTests::TestLoadByRows()
+{
+    int failCount = 0;
+
+    std::vector< unsigned char > filtered = EncodeTestImage( LCT_RGBA, true );
+    failCount += Check( IsSameByRows( filtered ), "LoadByRows", "filtered RGBA image" );
+    failCount += Check( IsSameByRows( EncodeTestImage( LCT_RGB, true ) ), "LoadByRows", "filtered RGB image" );
+    failCount += Check( IsSameByRows( EncodeTestImage( LCT_PALETTE, false ) ), "LoadByRows", "palette image" );
+
+    std::vector< unsigned char > split = SplitImageData( filtered, 1000 );
+    failCount += Check( split.size() > filtered.size() + 12 * 10, "LoadByRows", "image data is split into chunks" );
+    failCount += Check( IsSameByRows( split ), "LoadByRows", "image with many IDAT chunks" );
+
+    // The sample circuits, as the simulation loads them
+    const char* cFileNames[] = { cCycleFileName, cForkFileName, "WirePair_128Full.png" };
+    for( int i = 0; i < 3; i++ )
+    {
+        std::vector< unsigned char > png;
+        lodepng::load_file( png, cFileNames[ i ] );
+        failCount += Check( IsSameByRows( png ), "LoadByRows", cFileNames[ i ] );
+    }
+
+    // A header claiming more tiles than an int can index (nothing past it is read)
+    std::vector< unsigned char > image( 4, 255 );
+    std::vector< unsigned char > png;
+    lodepng::encode( png, image, 1, 1 );
+    const unsigned char cSize[ 4 ] = { 0, 0, 0xc3, 0x50 }; // 50000
+    memcpy( &png[ 16 ], cSize, 4 );
+    memcpy( &png[ 20 ], cSize, 4 );
+    lodepng_chunk_generate_crc( &png[ 8 ] );
+    lodepng::save_file( png, cLargeImageFileName );
+    SimTopology topology( cLargeImageFileName );
+    failCount += Check( topology.GetTileCount() == 0 && topology.GetWidth() == 0, "LoadByRows", "board too large to index is refused" );
+    remove( cLargeImageFileName );
+
+    return failCount;
+}
+
+int SimTests::TestCompiledCircuit()
+{
+    int failCount = 0;
+    failCount += Check( WireSim::CompileCircuit( cForkFileName, cCompiledFileName ), "CompiledCircuit", "circuit is compiled" );
+
+    // The net engine steps on the netlist stored in the file, or on one built from the image; it
+    // settles in a single step, so both run it
+    for( int i = 0; i < 2; i++ )
+    {
+        WireSim image( cForkFileName );
+        WireSim compiled( cCompiledFileName );
+        failCount += Check( compiled.GetInputCount() == image.GetInputCount() && compiled.GetOutputCount() == image.GetOutputCount() &&
+                            IsSameState( compiled, image ), "CompiledCircuit", "compiled circuit starts like the image" );
+        image.SetEngine( ( i == 0 ) ? NULL : new NetEngine() );
+        compiled.SetEngine( ( i == 0 ) ? NULL : new NetEngine() );
+
+        bool isSame = true;
+        for( int step = 0; step < 60 && isSame; step++ )
+        {
+            StepWithInputs( image, 1 );
+            StepWithInputs( compiled, 1 );
+            isSame = IsSameState( compiled, image );
+        }
+        failCount += Check( isSame, "CompiledCircuit", ( i == 0 ) ? "compiled circuit steps like the image" : "compiled netlist steps like the image" );
+    }
+
+    // Find the type plane by its first image row, which only holds wires and gates of the circuit
+    std::vector< unsigned char > file;
+    lodepng::load_file( file, cCompiledFileName );
+    SimTopology topology( cForkFileName );
+    std::vector< unsigned char > firstRow( topology.GetWidth() );
+    for( int x = 0; x < topology.GetWidth(); x++ )
+    {
+        firstRow[ x ] = (unsigned char)topology.GetType( x, 0 );
+    }
+    size_t rowOffset = std::search( file.begin(), file.end(), firstRow.begin(), firstRow.end() ) - file.begin();
+    failCount += Check( rowOffset > 0 && rowOffset < file.size(), "CompiledCircuit", "type plane is found" );
+    if( rowOffset == 0 || rowOffset >= file.size() )
+    {
+        remove( cCompiledFileName );
+        return failCount;
+    }
+
+    // A type that doesn't exist, and a wire in the border, which the kernel would read past
+    const size_t cCorruptOffsets[ 2 ] = { rowOffset + 1, rowOffset - 1 };
+    const unsigned char cCorruptTypes[ 2 ] = { 0xff, WireSim::cSimType_WireType0 };
+    for( int i = 0; i < 2; i++ )
+    {
+        std::vector< unsigned char > corrupt = file;
+        corrupt[ cCorruptOffsets[ i ] ] = cCorruptTypes[ i ];
+        lodepng::save_file( corrupt, cCompiledFileName );
+        SimTopology corruptTopology( cCompiledFileName );
+        failCount += Check( corruptTopology.GetTileCount() == 0, "CompiledCircuit", ( i == 0 ) ? "unknown tile type is refused" : "wire in the border is refused" );
+    }
+
+    remove( cCompiledFileName );
+    return failCount;
+}
+
+int SimTests::TestParallelImage()
+{
+    int failCount = 0;
+
+    // Noise, so the image data stays large enough to be deflated in several pieces
+    const unsigned int cWidth = 1024, cHeight = 768, cThreadCount = 4;
+    std::vector< unsigned char > image( cWidth * cHeight * 4 );
+    unsigned int seed = 1;
+    for( size_t i = 0; i < image.size(); i++ )
+    {
+        seed = seed * 1103515245 + 12345;
+        image[ i ] = ( i % 4 == 3 ) ? 255 : (unsigned char)( ( seed >> 16 ) & ( ( i / 4096 ) % 2 ? 0xff : 0x07 ) );
+    }
+
+    lodepng::State state;
+    state.encoder.zlibsettings.threadcount = cThreadCount;
+    std::vector< unsigned char > png;
+    failCount += Check( lodepng::encode( png, image, cWidth, cHeight, state ) == 0, "ParallelImage", "image is encoded on several threads" );
+    size_t indexOffset = FindChunk( png, "dfIX" );
+    failCount += Check( indexOffset != 0 && lodepng_chunk_length( &png[ indexOffset ] ) == cThreadCount * 8, "ParallelImage", "image data is deflated in pieces" );
+    if( indexOffset == 0 )
+    {
+        return failCount;
+    }
+
+    std::vector< unsigned char > serial = DecodeImage( png, 0 );
+    failCount += Check( serial == image, "ParallelImage", "decoded on one thread" );
+    failCount += Check( DecodeImage( png, cThreadCount ) == serial, "ParallelImage", "decoded on several threads" );
+
+    // The second piece claims to start a byte late; its inflate fails, and the stream is inflated as a whole
+    unsigned char* pieceStart = &png[ indexOffset + 8 + 8 ];
+    unsigned int start = ( (unsigned int)pieceStart[ 0 ] << 24 ) | ( pieceStart[ 1 ] << 16 ) | ( pieceStart[ 2 ] << 8 ) | pieceStart[ 3 ];
+    start++;
+    for( int i = 0; i < 4; i++ )
+    {
+        pieceStart[ i ] = (unsigned char)( start >> ( 24 - i * 8 ) );
+    }
+    lodepng_chunk_generate_crc( &png[ indexOffset ] );
+    failCount += Check( DecodeImage( png, cThreadCount ) == serial, "ParallelImage", "tampered index falls back to a whole inflate" );
+
+    return failCount;
+}
+
+int SimTests::TestEncodeTooLarge()
+{
+    int failCount = 0;
+
+    SimTopology topology( cCycleFileName );
+    const SimPowerPlane& power = topology.GetInitialPower();
+    std::vector< unsigned char > png;
+    failCount += Check( WireSim::EncodeState( topology, power, 1, false, png ), "EncodeTooLarge", "state is encoded" );
+    failCount += Check( !WireSim::EncodeState( topology, power, INT_MAX / 2, false, png ), "EncodeTooLarge", "image wider than an int is refused" );
+    failCount += Check( !WireSim::EncodeState( topology, power, 0, false, png ), "EncodeTooLarge", "empty pixels are refused" );
+
+    return failCount;
+}
+
+bool SimTests::IsSameState( WireSim& a, WireSim& b )
+{
+    SimPowerPlane powerA, powerB;
+    a.Snapshot()->CopyTo( powerA );
+    b.Snapshot()->CopyTo( powerB );
+    return IsSamePower( powerA, powerB );
+}
+
+bool SimTests::IsSamePower( const SimPowerPlane& a, const SimPowerPlane& b )
+{
+    if( a.GetWordCount() != b.GetWordCount() )
+    {
+        return false;
+    }
+
+    for( int i = 0; i < a.GetWordCount(); i++ )
+    {
+        if( a.GetWord( i ) != b.GetWord( i ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int SimTests::Check( bool isPassed, const char* testName, const char* description )
+{
+    if( !isPassed )
+    {
+        printf( "FAILED %s: %s\n", testName, description );
+    }
+    return isPassed ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Self-tests of the simulation, run on the sample
+ circuits next to the project (see main.cpp; run with the
+ single argument "test" from that directory). Every test
+ prints what failed, and the number of failures is returned.
+
+***/
+
+#ifndef __SIMTESTS_H__
+#define __SIMTESTS_H__
+
+class SimPowerPlane;
+class WireSim;
+
+class SimTests
+{
+
+public:
+
+    // Run all tests; returns zero on success, else the number of failed checks
+    static int Run();
+
+private:
+
+    // Every engine produces the same states as the per-pixel kernel on every sample circuit, step by
+    // step, several steps at a time (see WireSim::Update) and until settled (see WireSim::Eval)
+    static int TestEngines();
+
+    // Cycle detection starts over once an input changes (see WireSim::SetCycleDetection)
+    static int TestCycleAfterInput();
+
+    // A fork steps through the same states as the simulation it was forked from, and as one
+    // replayed from the start (see WireSim::Fork)
+    static int TestForkRoundTrip();
+
+    // Every recorded step is rebuilt as the simulation went through it, input changes included,
+    // and a simulation restored to one of them goes on like a replay (see WireSim::RestoreStep)
+    static int TestHistoryRoundTrip();
+
+    // A simulation loaded from a checkpoint goes on like the one that saved it, and checkpoints of
+    // other circuits are refused (see WireSim::SaveCheckpoint)
+    static int TestCheckpointRoundTrip();
+
+    // Images decoded a row at a time come out the same as decoded as a whole, and boards too large
+    // to index fail to load instead of throwing (see lodepng_decode_rows, SimTopology)
+    static int TestLoadByRows();
+
+    // A compiled circuit steps like the image it was compiled from, with and without its netlist,
+    // and corrupt ones are refused (see WireSim::CompileCircuit)
+    static int TestCompiledCircuit();
+
+    // Images deflated in pieces on several threads decode the same on one, and a dfIX index that
+    // doesn't match the image data falls back to inflating it as a whole (see LodePNGCompressSettings)
+    static int TestParallelImage();
+
+    // States too large to encode as a whole are refused instead of overflowing (see WireSim::EncodeState)
+    static int TestEncodeTooLarge();
+
+    // True if both simulations are in the same state
+    static bool IsSameState( WireSim& a, WireSim& b );
+
+    // True if both planes hold the same power states
+    static bool IsSamePower( const SimPowerPlane& a, const SimPowerPlane& b );
+
+    // Print the given check if it failed; returns the number of failures (0 or 1)
+    static int Check( bool isPassed, const char* testName, const char* description );
+
+};
+
+#endif // __SIMTESTS_H__
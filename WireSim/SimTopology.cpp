@@ -0,0 +1,176 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <limits.h>
+#include <stdio.h>
+
+#include "../lodepng.h"
+#include "SimCompiledCircuit.h"
+#include "SimMappedFile.h"
+#include "SimNetlist.h"
+#include "SimTopology.h"
+
+SimTopology::SimTopology( const char* fileName )
+    : m_width( 0 )
+    , m_height( 0 )
+    , m_stride( 0 )
+    , m_tileCount( 0 )
+    , m_types( NULL )
+{
+    // Compiled circuits keep the mapping for their type plane; images are decoded straight out of it
+    std::unique_ptr< SimMappedFile > file( new SimMappedFile( fileName ) );
+    bool isLoaded = false;
+    if( SimCompiledCircuit::IsCompiled( file->GetData(), file->GetSize() ) )
+    {
+        isLoaded = SimCompiledCircuit::Load( *this, file );
+    }
+    else
+    {
+        isLoaded = LoadImage( file->GetData(), file->GetSize() );
+    }
+
+    if( !isLoaded )
+    {
+        printf( "Failed to load\n" );
+    }
+}
+
+SimTopology::~SimTopology()
+{
+    // ...
+}
+
+std::shared_ptr< const SimNetlist > SimTopology::GetNetlist() const
+{
+    std::lock_guard< std::mutex > lock( m_netlistMutex );
+    if( !m_netlist )
+    {
+        // Compiled circuits carry theirs; anything else (or a broken one) is built from the tiles
+        if( m_file )
+        {
+            m_netlist = SimCompiledCircuit::LoadNetlist( *this );
+        }
+        if( !m_netlist )
+        {
+            m_netlist = std::make_shared< SimNetlist >( *this );
+        }
+    }
+
+    return m_netlist;
+}
+
+bool SimTopology::LoadImage( const unsigned char* pngData, size_t pngSize )
+{
+    unsigned int width;
+    unsigned int height;
+
+    // Rows are given as RGBA format, one at a time, and decoded straight into the planes; the whole image
+    // is never held, only the planes and a few rows
+    lodepng::State state;
+    unsigned int error = lodepng_inspect( &width, &height, &state, pngData, pngSize );
+    if( error != 0 )
+    {
+        return false;
+    }
+
+    if( !GetLayout( width, height, m_stride, m_tileCount ) )
+    {
+        printf( "Image of %u x %u tiles is too large\n", width, height );
+        return false;
+    }
+
+    m_width = (int)width;
+    m_height = (int)height;
+
+    // Unknown colors are treated as empty tiles, as is the whole border
+    m_typeStorage.assign( m_tileCount, WireSim::cSimType_None );
+    m_types = &m_typeStorage[ 0 ];
+    m_initialPower.Resize( m_tileCount );
+    error = lodepng_decode_rows( &width, &height, &state, pngData, pngSize, &SimTopology::LoadImageRow, this );
+
+    if( error != 0 )
+    {
+        m_width = m_height = m_stride = m_tileCount = 0;
+        m_types = NULL;
+        std::vector< uint8_t >().swap( m_typeStorage );
+        m_initialPower.Resize( 0 );
+        return false;
+    }
+
+    // Every other line
+    for( int y = 0; y < m_height; y += 2 )
+    {
+        // Read left and right
+        for( int dx = 0; dx < 2; dx++ )
+        {
+            int x = 0;
+            if( dx == 1 )
+            {
+                x = m_width - 1;
+            }
+
+            WireSim::SimType simType = GetType( x, y );
+
+            if( simType == WireSim::cSimType_WireType0 ||
+                simType == WireSim::cSimType_WireType1 ||
+                simType == WireSim::cSimType_JumpJoint )
+            {
+                if( dx == 0 )
+                {
+                    m_inputIndices.push_back( y );
+                }
+                else
+                {
+                    m_outputIndices.push_back( y );
+                }
+            }
+        }
+    }
+
+    // TODO: Initialize all not-gates...
+
+    return true;
+}
+
+void SimTopology::LoadImageRow( void* context, unsigned int y, const unsigned char* rgba )
+{
+    // Decode each color into its type and power once; RGBA is converted to ARGB
+    SimTopology* topology = (SimTopology*)context;
+    for( int x = 0; x < topology->m_width; x++ )
+    {
+        WireSim::SimColor simColor = 0;
+        simColor |= (WireSim::SimColor)( rgba[ x * 4 + 0 ] & 0xff ) << 16;
+        simColor |= (WireSim::SimColor)( rgba[ x * 4 + 1 ] & 0xff ) << 8;
+        simColor |= (WireSim::SimColor)( rgba[ x * 4 + 2 ] & 0xff );
+
+        WireSim::SimType simType = WireSim::cSimType_None;
+        WireSim::SimPower simPower = WireSim::cSimPower_LowEdge;
+        WireSim::GetSimType( simColor, simType, simPower );
+        int index = topology->GetIndex( x, (int)y );
+        topology->m_typeStorage[ index ] = (uint8_t)simType;
+        topology->m_initialPower.Set( index, simPower );
+    }
+}
+
+bool SimTopology::GetLayout( int64_t width, int64_t height, int& strideOut, int& tileCountOut )
+{
+    // Room for the border on the right of every row, rounded up to whole words
+    int64_t stride = ( width + cBorder + SimPowerPlane::cTilesPerWord - 1 ) / SimPowerPlane::cTilesPerWord * SimPowerPlane::cTilesPerWord;
+    int64_t tileCount = cMargin + ( height + cBorder * 2 ) * stride;
+
+    // Tiles are addressed with int indices
+    if( width <= 0 || height <= 0 || tileCount > INT_MAX )
+    {
+        strideOut = 0;
+        tileCountOut = 0;
+        return false;
+    }
+
+    strideOut = (int)stride;
+    tileCountOut = (int)tileCount;
+    return true;
+}
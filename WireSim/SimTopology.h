@@ -0,0 +1,148 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: The immutable part of a circuit; the type of
+ every tile, the input / output pin rows, and the power
+ levels the circuit was drawn with. Nothing in here changes
+ while simulating, so a single topology can be shared by
+ any number of WireSim instances of the same image.
+
+ Tiles are stored row by row inside a border of undefined
+ (cSimType_None) tiles, as wide as the reach of the kernel, so
+ the neighborhood of any real tile can be read by adding fixed
+ offsets to its index; boundary handling is a property of the
+ layout, not a check on every read. The right border of a row
+ doubles as the left border of the next, and rows are padded
+ to a whole number of packed power words (see SimPowerPlane),
+ so every row starts on its own word. Power planes of a
+ simulation use the same layout; see GetIndex.
+
+ A topology is either decoded from a PNG, or mapped straight
+ from a compiled circuit (see SimCompiledCircuit), in which case
+ the type plane is read from the mapped file as is.
+
+***/
+
+#ifndef __SIMTOPOLOGY_H__
+#define __SIMTOPOLOGY_H__
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include "SimPowerPlane.h"
+#include "WireSim.h"
+
+class SimMappedFile;
+class SimNetlist;
+
+class SimTopology
+{
+
+public:
+
+    // Load and decode the given PNG, or map the given compiled circuit (told apart by contents,
+    // not by name); on failure the topology is empty (zero-sized)
+    SimTopology( const char* fileName );
+    ~SimTopology();
+
+    // Size of the image
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+    // Width of the border of undefined tiles around the image; the kernel never reads further out
+    static const int cBorder = 2;
+
+    // Tiles between vertically adjacent tiles, and the number of tiles including the border
+    int GetStride() const { return m_stride; }
+    int GetTileCount() const { return m_tileCount; }
+
+    // Index of the given 2D position, and back; top-left is origin (0,0). The border can be
+    // addressed with coordinates up to cBorder outside of the image
+    inline int GetIndex( int x, int y ) const
+    {
+        return cMargin + ( y + cBorder ) * m_stride + x;
+    }
+
+    inline int GetX( int index ) const
+    {
+        return ( index - cMargin ) % m_stride;
+    }
+
+    inline int GetY( int index ) const
+    {
+        return ( index - cMargin ) / m_stride - cBorder;
+    }
+
+    // Tile type by index, or 2D position
+    inline WireSim::SimType GetType( int index ) const
+    {
+        return (WireSim::SimType)m_types[ index ];
+    }
+
+    inline WireSim::SimType GetType( int x, int y ) const
+    {
+        return (WireSim::SimType)m_types[ GetIndex( x, y ) ];
+    }
+
+    // Rows of the input / output pins (wire pixels in the left and right column even-rows)
+    const std::vector< int >& GetInputIndices() const { return m_inputIndices; }
+    const std::vector< int >& GetOutputIndices() const { return m_outputIndices; }
+
+    // Power levels as drawn in the source image
+    const SimPowerPlane& GetInitialPower() const { return m_initialPower; }
+
+    // Net-level view of the circuit (see SimNetlist); built on first use, or read from the compiled
+    // circuit, and shared by everything using this topology. Safe to call from any thread
+    std::shared_ptr< const SimNetlist > GetNetlist() const;
+
+private:
+
+    // Not copyable; the type plane may point into a mapping owned by this topology
+    SimTopology( const SimTopology& );
+    SimTopology& operator=( const SimTopology& );
+
+    // Decode a PNG image; returns true on success, false on failure
+    bool LoadImage( const unsigned char* pngData, size_t pngSize );
+
+    // Decode one RGBA row of the image into the type and power planes; called back while decoding
+    static void LoadImageRow( void* context, unsigned int y, const unsigned char* rgba );
+
+    // Tiles per padded row, and tiles including the border, for the given image size; returns false
+    // (and zeros) if the image is empty, or has too many tiles to index with an int
+    static bool GetLayout( int64_t width, int64_t height, int& strideOut, int& tileCountOut );
+
+    friend class SimCompiledCircuit;
+
+    // Undefined tiles before the first border row, so the left border of that row can be read too;
+    // one packed word, to keep rows word-aligned
+    static const int cMargin = SimPowerPlane::cTilesPerWord;
+
+    // Size of image, tiles per padded row, and tiles including the border
+    int m_width, m_height;
+    int m_stride;
+    int m_tileCount;
+
+    // One SimType per tile, including the border; points into m_typeStorage for decoded images,
+    // or into m_file for compiled circuits
+    const uint8_t* m_types;
+    std::vector< uint8_t > m_typeStorage;
+    std::unique_ptr< SimMappedFile > m_file;
+
+    // List of input / outpout indices (wire pixels in the left and right column even-rows)
+    std::vector< int > m_inputIndices;
+    std::vector< int > m_outputIndices;
+
+    // Initial states
+    SimPowerPlane m_initialPower;
+
+    // Built (or loaded) by the first GetNetlist
+    mutable std::mutex m_netlistMutex;
+    mutable std::shared_ptr< const SimNetlist > m_netlist;
+
+};
+
+#endif // __SIMTOPOLOGY_H__
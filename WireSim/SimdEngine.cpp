@@ -0,0 +1,382 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+#include <string.h>
+
+#include "SimdEngine.h"
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+    #define WIRESIM_SIMD_X86
+
+    // AVX2 intrinsics need at least Visual Studio 2013
+    #if !defined( _MSC_VER ) || _MSC_VER >= 1800
+        #define WIRESIM_SIMD_AVX2
+    #endif
+#endif
+
+#if defined( WIRESIM_SIMD_X86 )
+    #if defined( _MSC_VER )
+        #include <intrin.h>
+    #endif
+    #include <immintrin.h>
+#endif
+
+namespace
+{
+    // Empty bytes before the first and after the last padded row, for reads that run off the image
+    const int cMargin = 32;
+
+    // Undefined rows above and below the image; the kernel reads up to two tiles away
+    const int cPaddingRows = 2;
+
+    // Row strides are rounded up to this, the widest vector, with at least two undefined tiles per row
+    const int cStrideAlignment = 32;
+    const int cPaddingColumns = 2;
+
+    inline int BitCount( uint32_t bits )
+    {
+        bits = bits - ( ( bits >> 1 ) & 0x55555555 );
+        bits = ( bits & 0x33333333 ) + ( ( bits >> 2 ) & 0x33333333 );
+        return (int)( ( ( ( bits + ( bits >> 4 ) ) & 0x0F0F0F0F ) * 0x01010101 ) >> 24 );
+    }
+
+    // Portable fallback: eight tiles packed into a 64-bit word
+    struct ScalarOps
+    {
+        typedef uint64_t Vec;
+        static const int cLanes = 8;
+
+        static inline Vec Load( const uint8_t* source ) { Vec v; memcpy( &v, source, sizeof( v ) ); return v; }
+        static inline void Store( uint8_t* dest, Vec v ) { memcpy( dest, &v, sizeof( v ) ); }
+        static inline Vec Splat( uint8_t value ) { return 0x0101010101010101ULL * value; }
+
+        static inline Vec And( Vec a, Vec b ) { return a & b; }
+        static inline Vec Or( Vec a, Vec b ) { return a | b; }
+        static inline Vec Xor( Vec a, Vec b ) { return a ^ b; }
+        static inline Vec AndNot( Vec a, Vec b ) { return a & ~b; }
+
+        // Low bit of every byte set if any bit of that byte is set
+        static inline Vec NonZeroBytes( Vec v )
+        {
+            v |= v >> 4;
+            v |= v >> 2;
+            v |= v >> 1;
+            return v & 0x0101010101010101ULL;
+        }
+
+        static inline Vec HasFlag( Vec v, Vec flag ) { return NonZeroBytes( v & flag ) * 0xFF; }
+        static inline bool IsZero( Vec mask ) { return mask == 0; }
+        static inline int CountEqual( Vec a, Vec b ) { return cLanes - (int)( ( NonZeroBytes( a ^ b ) * 0x0101010101010101ULL ) >> 56 ); }
+    };
+
+    namespace Scalar
+    {
+        typedef ScalarOps Ops;
+        #include "SimdKernel.inl"
+    }
+}
+
+#if defined( WIRESIM_SIMD_X86 )
+
+#if defined( __clang__ )
+    #pragma clang attribute push( __attribute__(( target( "sse2" ) )), apply_to = function )
+#elif defined( __GNUC__ )
+    #pragma GCC push_options
+    #pragma GCC target( "sse2" )
+#endif
+
+namespace
+{
+    struct Sse2Ops
+    {
+        typedef __m128i Vec;
+        static const int cLanes = 16;
+
+        static inline Vec Load( const uint8_t* source ) { return _mm_loadu_si128( (const __m128i*)source ); }
+        static inline void Store( uint8_t* dest, Vec v ) { _mm_storeu_si128( (__m128i*)dest, v ); }
+        static inline Vec Splat( uint8_t value ) { return _mm_set1_epi8( (char)value ); }
+
+        static inline Vec And( Vec a, Vec b ) { return _mm_and_si128( a, b ); }
+        static inline Vec Or( Vec a, Vec b ) { return _mm_or_si128( a, b ); }
+        static inline Vec Xor( Vec a, Vec b ) { return _mm_xor_si128( a, b ); }
+        static inline Vec AndNot( Vec a, Vec b ) { return _mm_andnot_si128( b, a ); }
+
+        static inline Vec HasFlag( Vec v, Vec flag ) { return _mm_cmpeq_epi8( _mm_and_si128( v, flag ), flag ); }
+        static inline bool IsZero( Vec mask ) { return _mm_movemask_epi8( mask ) == 0; }
+        static inline int CountEqual( Vec a, Vec b ) { return BitCount( (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) ); }
+    };
+
+    namespace Sse2
+    {
+        typedef Sse2Ops Ops;
+        #include "SimdKernel.inl"
+    }
+}
+
+#if defined( __clang__ )
+    #pragma clang attribute pop
+#elif defined( __GNUC__ )
+    #pragma GCC pop_options
+#endif
+
+#endif // WIRESIM_SIMD_X86
+
+#if defined( WIRESIM_SIMD_AVX2 )
+
+#if defined( __clang__ )
+    #pragma clang attribute push( __attribute__(( target( "avx2" ) )), apply_to = function )
+#elif defined( __GNUC__ )
+    #pragma GCC push_options
+    #pragma GCC target( "avx2" )
+#endif
+
+namespace
+{
+    struct Avx2Ops
+    {
+        typedef __m256i Vec;
+        static const int cLanes = 32;
+
+        static inline Vec Load( const uint8_t* source ) { return _mm256_loadu_si256( (const __m256i*)source ); }
+        static inline void Store( uint8_t* dest, Vec v ) { _mm256_storeu_si256( (__m256i*)dest, v ); }
+        static inline Vec Splat( uint8_t value ) { return _mm256_set1_epi8( (char)value ); }
+
+        static inline Vec And( Vec a, Vec b ) { return _mm256_and_si256( a, b ); }
+        static inline Vec Or( Vec a, Vec b ) { return _mm256_or_si256( a, b ); }
+        static inline Vec Xor( Vec a, Vec b ) { return _mm256_xor_si256( a, b ); }
+        static inline Vec AndNot( Vec a, Vec b ) { return _mm256_andnot_si256( b, a ); }
+
+        static inline Vec HasFlag( Vec v, Vec flag ) { return _mm256_cmpeq_epi8( _mm256_and_si256( v, flag ), flag ); }
+        static inline bool IsZero( Vec mask ) { return _mm256_testz_si256( mask, mask ) != 0; }
+        static inline int CountEqual( Vec a, Vec b ) { return BitCount( (uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( a, b ) ) ); }
+    };
+
+    namespace Avx2
+    {
+        typedef Avx2Ops Ops;
+        #include "SimdKernel.inl"
+    }
+}
+
+#if defined( __clang__ )
+    #pragma clang attribute pop
+#elif defined( __GNUC__ )
+    #pragma GCC pop_options
+#endif
+
+#endif // WIRESIM_SIMD_AVX2
+
+SimdEngine::SimdEngine( SimdLevel maxLevel )
+    : m_width( 0 )
+    , m_height( 0 )
+    , m_stride( 0 )
+    , m_currentPower( 0 )
+{
+    m_simdLevel = std::min( maxLevel, GetSupportedLevel() );
+    switch( m_simdLevel )
+    {
+        #if defined( WIRESIM_SIMD_AVX2 )
+        case cSimdLevel_Avx2:
+            m_evaluateGates = Avx2::EvaluateGates;
+            m_evaluateTiles = Avx2::EvaluateTiles;
+            break;
+        #endif
+
+        #if defined( WIRESIM_SIMD_X86 )
+        case cSimdLevel_Sse2:
+            m_evaluateGates = Sse2::EvaluateGates;
+            m_evaluateTiles = Sse2::EvaluateTiles;
+            break;
+        #endif
+
+        case cSimdLevel_Scalar:
+        default:
+            m_simdLevel = cSimdLevel_Scalar;
+            m_evaluateGates = Scalar::EvaluateGates;
+            m_evaluateTiles = Scalar::EvaluateTiles;
+            break;
+    }
+}
+
+SimdEngine::~SimdEngine()
+{
+    // ...
+}
+
+void SimdEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    m_width = topology.GetWidth();
+    m_height = topology.GetHeight();
+    m_stride = ( m_width + cPaddingColumns + cStrideAlignment - 1 ) / cStrideAlignment * cStrideAlignment;
+    m_currentPower = 0;
+    m_touchedIndices.clear();
+
+    int byteCount = cMargin * 2 + ( m_height + cPaddingRows * 2 ) * m_stride;
+    m_types.assign( byteCount, 0 );
+    m_power[ 0 ].assign( byteCount, 0 );
+    m_power[ 1 ].assign( byteCount, 0 );
+    m_gateResults.assign( byteCount, 0 );
+
+    for( int y = 0; y < m_height; y++ )
+    {
+        for( int x = 0; x < m_width; x++ )
+        {
+            uint8_t flags = cFlag_Defined;
+            switch( topology.GetType( x, y ) )
+            {
+                case WireSim::cSimType_WireType0:
+                case WireSim::cSimType_WireType1:
+                    flags |= cFlag_Wire;
+                    break;
+
+                case WireSim::cSimType_NotGate:
+                    flags |= cFlag_JumpOrNot | cFlag_Not;
+                    break;
+
+                case WireSim::cSimType_JumpJoint:
+                    flags |= cFlag_JumpOrNot;
+                    break;
+
+                case WireSim::cSimType_AndGate:
+                    flags |= cFlag_Gate | cFlag_And;
+                    break;
+
+                case WireSim::cSimType_OrGate:
+                    flags |= cFlag_Gate | cFlag_Or;
+                    break;
+
+                case WireSim::cSimType_XorGate:
+                    flags |= cFlag_Gate | cFlag_Xor;
+                    break;
+
+                case WireSim::cSimType_None:
+                default:
+                    flags = 0;
+                    break;
+            }
+
+            m_types[ GetOffset( x, y ) ] = flags;
+            LoadTile( topology, power, topology.GetIndex( x, y ) );
+        }
+    }
+}
+
+void SimdEngine::Touch( int linearIndex )
+{
+    m_touchedIndices.push_back( linearIndex );
+}
+
+int SimdEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    // Pick up any writes made since the last step
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        LoadTile( topology, power, m_touchedIndices[ i ] );
+    }
+    m_touchedIndices.clear();
+
+    if( m_width <= 0 || m_height <= 0 )
+    {
+        return 0;
+    }
+
+    // The padding between rows is evaluated too (and never changes), so the image is one run of tiles
+    int begin = GetOffset( 0, 0 );
+    int end = GetOffset( m_width, m_height - 1 );
+
+    const uint8_t* source = &m_power[ m_currentPower ][ 0 ];
+    uint8_t* dest = &m_power[ 1 - m_currentPower ][ 0 ];
+
+    // Every gate result has to be ready before any tile is evaluated
+    m_evaluateGates( &m_types[ 0 ], source, &m_gateResults[ 0 ], m_stride, begin, end );
+    int changedCount = m_evaluateTiles( &m_types[ 0 ], source, &m_gateResults[ 0 ], dest, m_stride, begin, end );
+
+    // Write back only the tiles that changed
+    for( int y = 0; y < m_height && changedCount > 0; y++ )
+    {
+        int rowOffset = GetOffset( 0, y );
+        if( memcmp( source + rowOffset, dest + rowOffset, m_width ) == 0 )
+        {
+            continue;
+        }
+
+        for( int x = 0; x < m_width; x++ )
+        {
+            if( source[ rowOffset + x ] != dest[ rowOffset + x ] )
+            {
+                int index = topology.GetIndex( x, y );
+                if( changesOut )
+                {
+                    changesOut->AddTile( index, source[ rowOffset + x ], dest[ rowOffset + x ] );
+                }
+                power.Set( index, dest[ rowOffset + x ] );
+            }
+        }
+    }
+
+    m_currentPower = 1 - m_currentPower;
+    return changedCount;
+}
+
+SimdEngine::SimdLevel SimdEngine::GetSimdLevel() const
+{
+    return m_simdLevel;
+}
+
+SimdEngine::SimdLevel SimdEngine::GetSupportedLevel()
+{
+    #if defined( WIRESIM_SIMD_X86 ) && defined( _MSC_VER )
+
+        int info[ 4 ] = { 0 };
+        __cpuid( info, 0 );
+        int maxLeaf = info[ 0 ];
+
+        __cpuid( info, 1 );
+        bool hasSse2 = ( ( info[ 3 ] >> 26 ) & 1 ) != 0;
+        bool hasAvx = ( ( info[ 2 ] >> 28 ) & 1 ) != 0;
+        bool hasOsSave = ( ( info[ 2 ] >> 27 ) & 1 ) != 0;
+
+        #if defined( WIRESIM_SIMD_AVX2 )
+            // The OS has to save the upper halves of the vector registers too
+            if( maxLeaf >= 7 && hasAvx && hasOsSave && ( _xgetbv( 0 ) & 0x6 ) == 0x6 )
+            {
+                __cpuidex( info, 7, 0 );
+                if( ( ( info[ 1 ] >> 5 ) & 1 ) != 0 )
+                {
+                    return cSimdLevel_Avx2;
+                }
+            }
+        #endif
+
+        return hasSse2 ? cSimdLevel_Sse2 : cSimdLevel_Scalar;
+
+    #elif defined( WIRESIM_SIMD_X86 )
+
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx2" ) )
+        {
+            return cSimdLevel_Avx2;
+        }
+        return __builtin_cpu_supports( "sse2" ) ? cSimdLevel_Sse2 : cSimdLevel_Scalar;
+
+    #else
+
+        return cSimdLevel_Scalar;
+
+    #endif
+}
+
+int SimdEngine::GetOffset( int x, int y ) const
+{
+    return cMargin + ( y + cPaddingRows ) * m_stride + x;
+}
+
+void SimdEngine::LoadTile( const SimTopology& topology, const SimPowerPlane& power, int linearIndex )
+{
+    m_power[ m_currentPower ][ GetOffset( topology.GetX( linearIndex ), topology.GetY( linearIndex ) ) ] = (uint8_t)power.Get( linearIndex );
+}
@@ -0,0 +1,100 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Vectorized engine. Tiles are decoded into one
+ byte each (a type-flags byte and a power byte), so that every
+ neighbor of a run of tiles is itself a run of bytes, and the
+ rules of SimKernel are evaluated as byte masks on 32 (AVX2),
+ 16 (SSE2) or 8 (portable 64-bit words) tiles at a time.
+
+ The widest instruction set the processor supports is picked
+ at run time; all of them produce exactly the same states. The
+ kernel itself lives in SimdKernel.inl and is compiled once per
+ instruction set.
+
+***/
+
+#ifndef __SIMDENGINE_H__
+#define __SIMDENGINE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimEngine.h"
+
+class SimdEngine : public SimEngine
+{
+
+public:
+
+    // Instruction sets, narrowest first
+    enum SimdLevel
+    {
+        cSimdLevel_Scalar,
+        cSimdLevel_Sse2,
+        cSimdLevel_Avx2,
+    };
+
+    // Uses the widest instruction set that both the processor and the given limit allow
+    SimdEngine( SimdLevel maxLevel = cSimdLevel_Avx2 );
+    virtual ~SimdEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    SimdLevel GetSimdLevel() const;
+
+    // Widest instruction set supported by this processor (and build)
+    static SimdLevel GetSupportedLevel();
+
+    // Bits of the per-tile type-flags byte
+    static const uint8_t cFlag_Wire = 0x01;
+    static const uint8_t cFlag_JumpOrNot = 0x02;
+    static const uint8_t cFlag_Not = 0x04;
+    static const uint8_t cFlag_Gate = 0x08;
+    static const uint8_t cFlag_And = 0x10;
+    static const uint8_t cFlag_Or = 0x20;
+    static const uint8_t cFlag_Xor = 0x40;
+    static const uint8_t cFlag_Defined = 0x80;
+
+    // Bits of the per-tile power byte (see WireSim::SimPower)
+    static const uint8_t cPower_Edge = 0x01;
+    static const uint8_t cPower_High = 0x02;
+
+protected:
+
+    // Kernel entry points for one instruction set; both work on the tiles in [begin, end) of the
+    // padded layout, and may write (unchanged) padding up to the next multiple of the lane count
+    typedef void (*GateFunction)( const uint8_t* types, const uint8_t* power, uint8_t* gateResults, int stride, int begin, int end );
+    typedef int (*TileFunction)( const uint8_t* types, const uint8_t* power, const uint8_t* gateResults, uint8_t* nextPower, int stride, int begin, int end );
+
+    // Offset of a tile in the padded layout
+    inline int GetOffset( int x, int y ) const;
+
+    void LoadTile( const SimTopology& topology, const SimPowerPlane& power, int linearIndex );
+
+private:
+
+    SimdLevel m_simdLevel;
+    GateFunction m_evaluateGates;
+    TileFunction m_evaluateTiles;
+
+    // Size of the image, and bytes per padded row
+    int m_width, m_height;
+    int m_stride;
+
+    // One byte per tile, padded with undefined tiles on all sides; power is double-buffered
+    std::vector< uint8_t > m_types;
+    std::vector< uint8_t > m_power[ 2 ];
+    std::vector< uint8_t > m_gateResults;
+    int m_currentPower;
+
+    // Tiles written by SetInput since the last step; loaded from the power plane before stepping
+    std::vector< int > m_touchedIndices;
+
+};
+
+#endif // __SIMDENGINE_H__
@@ -0,0 +1,131 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Byte-mask form of SimKernel, written against a
+ vector type "Ops" (see SimdEngine.cpp). Every boolean is a
+ lane of 0x00 / 0xFF bytes, one lane per tile. This file is
+ included once per instruction set, each time in its own
+ namespace, so do not include it anywhere else.
+
+***/
+
+// Gate result (as a mask) of every gate in [begin, end); non-gates get zero
+void EvaluateGates( const uint8_t* types, const uint8_t* power, uint8_t* gateResults, int stride, int begin, int end )
+{
+    const int cornerOffsets[ 4 ] = { -stride - 1, -stride + 1, stride + 1, stride - 1 };
+
+    const Ops::Vec wireFlag = Ops::Splat( SimdEngine::cFlag_Wire );
+    const Ops::Vec gateFlag = Ops::Splat( SimdEngine::cFlag_Gate );
+    const Ops::Vec andFlag = Ops::Splat( SimdEngine::cFlag_And );
+    const Ops::Vec orFlag = Ops::Splat( SimdEngine::cFlag_Or );
+    const Ops::Vec xorFlag = Ops::Splat( SimdEngine::cFlag_Xor );
+    const Ops::Vec edgeFlag = Ops::Splat( SimdEngine::cPower_Edge );
+    const Ops::Vec highFlag = Ops::Splat( SimdEngine::cPower_High );
+
+    for( int i = begin; i < end; i += Ops::cLanes )
+    {
+        Ops::Vec type = Ops::Load( types + i );
+        if( Ops::IsZero( Ops::HasFlag( type, gateFlag ) ) )
+        {
+            Ops::Store( gateResults + i, Ops::Splat( 0 ) );
+            continue;
+        }
+
+        // Gates read settled wires on their four corners
+        Ops::Vec on[ 4 ];
+        Ops::Vec anyOn = Ops::Splat( 0 );
+        Ops::Vec anyOff = Ops::Splat( 0 );
+        for( int j = 0; j < 4; j++ )
+        {
+            Ops::Vec cornerPower = Ops::Load( power + i + cornerOffsets[ j ] );
+            Ops::Vec cornerValid = Ops::AndNot( Ops::HasFlag( Ops::Load( types + i + cornerOffsets[ j ] ), wireFlag ), Ops::HasFlag( cornerPower, edgeFlag ) );
+            Ops::Vec cornerHigh = Ops::HasFlag( cornerPower, highFlag );
+
+            on[ j ] = Ops::And( cornerValid, cornerHigh );
+            anyOn = Ops::Or( anyOn, on[ j ] );
+            anyOff = Ops::Or( anyOff, Ops::AndNot( cornerValid, cornerHigh ) );
+        }
+
+        Ops::Vec twoOrMoreOn = Ops::Or( Ops::Or( Ops::And( on[ 0 ], on[ 1 ] ), Ops::And( on[ 0 ], on[ 2 ] ) ),
+                                        Ops::Or( Ops::Or( Ops::And( on[ 0 ], on[ 3 ] ), Ops::And( on[ 1 ], on[ 2 ] ) ),
+                                                 Ops::Or( Ops::And( on[ 1 ], on[ 3 ] ), Ops::And( on[ 2 ], on[ 3 ] ) ) ) );
+        Ops::Vec oneOn = Ops::AndNot( anyOn, twoOrMoreOn );
+
+        Ops::Vec result = Ops::And( Ops::HasFlag( type, andFlag ), Ops::AndNot( twoOrMoreOn, anyOff ) );
+        result = Ops::Or( result, Ops::And( Ops::HasFlag( type, orFlag ), Ops::And( anyOn, anyOff ) ) );
+        result = Ops::Or( result, Ops::And( Ops::HasFlag( type, xorFlag ), Ops::And( oneOn, anyOff ) ) );
+        Ops::Store( gateResults + i, result );
+    }
+}
+
+// Next power of every tile in [begin, end); returns the number of tiles that changed
+int EvaluateTiles( const uint8_t* types, const uint8_t* power, const uint8_t* gateResults, uint8_t* nextPower, int stride, int begin, int end )
+{
+    // Writers in reverse scan order (bottom, right, left, top); the first one found is the last one to write
+    const int writerOffsets[ 4 ] = { stride, 1, -1, -stride };
+
+    const Ops::Vec wireFlag = Ops::Splat( SimdEngine::cFlag_Wire );
+    const Ops::Vec jumpOrNotFlag = Ops::Splat( SimdEngine::cFlag_JumpOrNot );
+    const Ops::Vec notFlag = Ops::Splat( SimdEngine::cFlag_Not );
+    const Ops::Vec gateFlag = Ops::Splat( SimdEngine::cFlag_Gate );
+    const Ops::Vec definedFlag = Ops::Splat( SimdEngine::cFlag_Defined );
+    const Ops::Vec edgeFlag = Ops::Splat( SimdEngine::cPower_Edge );
+    const Ops::Vec highFlag = Ops::Splat( SimdEngine::cPower_High );
+    const Ops::Vec allFlags = Ops::Splat( 0xFF );
+
+    int changedCount = 0;
+    for( int i = begin; i < end; i += Ops::cLanes )
+    {
+        Ops::Vec type = Ops::Load( types + i );
+        Ops::Vec centerPower = Ops::Load( power + i );
+        Ops::Vec high = Ops::HasFlag( centerPower, highFlag );
+        Ops::Vec edge = Ops::HasFlag( centerPower, edgeFlag );
+        Ops::Vec settledWire = Ops::AndNot( Ops::HasFlag( type, wireFlag ), edge );
+
+        // Edges settle (except on undefined tiles), and only settled wires can be written to
+        Ops::Vec nextEdge = Ops::AndNot( edge, Ops::HasFlag( type, definedFlag ) );
+        Ops::Vec nextHigh = high;
+
+        if( !Ops::IsZero( settledWire ) )
+        {
+            Ops::Vec unclaimed = settledWire;
+            for( int j = 0; j < 4; j++ )
+            {
+                int writer = i + writerOffsets[ j ];
+                int source = writer + writerOffsets[ j ];
+
+                Ops::Vec writerType = Ops::Load( types + writer );
+                Ops::Vec writerPower = Ops::Load( power + writer );
+                Ops::Vec writerHigh = Ops::HasFlag( writerPower, highFlag );
+
+                // Wires on an edge spread their new level
+                Ops::Vec toggles = Ops::And( Ops::And( Ops::HasFlag( writerType, wireFlag ), Ops::HasFlag( writerPower, edgeFlag ) ), Ops::Xor( writerHigh, high ) );
+
+                // Jump joints / not-gates pass on their source; low ones write right and down, so
+                // only to us if they are left / above, and high ones the opposite
+                Ops::Vec writesToUs = ( writerOffsets[ j ] > 0 ) ? writerHigh : Ops::Xor( writerHigh, allFlags );
+                Ops::Vec sourcePower = Ops::Load( power + source );
+                Ops::Vec sourceSettled = Ops::AndNot( Ops::HasFlag( Ops::Load( types + source ), wireFlag ), Ops::HasFlag( sourcePower, edgeFlag ) );
+                Ops::Vec result = Ops::Xor( Ops::HasFlag( sourcePower, highFlag ), Ops::HasFlag( writerType, notFlag ) );
+                toggles = Ops::Or( toggles, Ops::And( Ops::And( Ops::HasFlag( writerType, jumpOrNotFlag ), writesToUs ), Ops::And( sourceSettled, Ops::Xor( result, high ) ) ) );
+
+                // Gates pulse an edge of the current level when their result differs
+                Ops::Vec pulses = Ops::And( Ops::HasFlag( writerType, gateFlag ), Ops::Xor( Ops::Load( gateResults + writer ), high ) );
+
+                toggles = Ops::And( toggles, unclaimed );
+                Ops::Vec writes = Ops::Or( toggles, Ops::And( pulses, unclaimed ) );
+                nextHigh = Ops::Xor( nextHigh, toggles );
+                nextEdge = Ops::Or( nextEdge, writes );
+                unclaimed = Ops::AndNot( unclaimed, writes );
+            }
+        }
+
+        Ops::Vec nextCenterPower = Ops::Or( Ops::And( nextHigh, highFlag ), Ops::And( nextEdge, edgeFlag ) );
+        Ops::Store( nextPower + i, nextCenterPower );
+        changedCount += Ops::cLanes - Ops::CountEqual( nextCenterPower, centerPower );
+    }
+
+    return changedCount;
+}
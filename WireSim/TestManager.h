@@ -16,7 +16,8 @@
  index to the 0 (low) or 1 (high) state.
  
  eval: Continues simulation until the system is fully
- simulated and can produce a valid output.
+ simulated and can produce a valid output (see
+ WireSim::Eval).
  
  test <input pin index> <0|1>: Tests if the given output
  pin index has the appropriate value of either 0 (low)
@@ -0,0 +1,126 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool( int threadCount )
+    : m_task( NULL )
+    , m_taskCount( 0 )
+    , m_nextTask( 0 )
+    , m_generation( 0 )
+    , m_busyWorkerCount( 0 )
+    , m_isExiting( false )
+{
+    if( threadCount <= 0 )
+    {
+        threadCount = std::max( 1, (int)std::thread::hardware_concurrency() );
+    }
+
+    // The calling thread is the first worker
+    for( int i = 1; i < threadCount; i++ )
+    {
+        m_workers.push_back( std::thread( &ThreadPool::WorkerMain, this ) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_isExiting = true;
+    }
+    m_batchCondition.notify_all();
+
+    for( int i = 0; i < (int)m_workers.size(); i++ )
+    {
+        m_workers[ i ].join();
+    }
+}
+
+int ThreadPool::GetThreadCount() const
+{
+    return (int)m_workers.size() + 1;
+}
+
+void ThreadPool::Run( int taskCount, const std::function< void( int ) >& task )
+{
+    // Nothing to hand off
+    if( m_workers.empty() || taskCount <= 1 )
+    {
+        for( int i = 0; i < taskCount; i++ )
+        {
+            task( i );
+        }
+        return;
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( m_mutex );
+        m_task = &task;
+        m_taskCount = taskCount;
+        m_nextTask = 0;
+        m_busyWorkerCount = (int)m_workers.size();
+        m_generation++;
+    }
+    m_batchCondition.notify_all();
+
+    RunTasks();
+
+    // Wait on the workers, which also guarantees every worker has seen this batch before the next
+    std::unique_lock< std::mutex > lock( m_mutex );
+    while( m_busyWorkerCount > 0 )
+    {
+        m_doneCondition.wait( lock );
+    }
+    m_task = NULL;
+}
+
+void ThreadPool::WorkerMain()
+{
+    unsigned int lastGeneration = 0;
+
+    for( ;; )
+    {
+        {
+            std::unique_lock< std::mutex > lock( m_mutex );
+            while( !m_isExiting && m_generation == lastGeneration )
+            {
+                m_batchCondition.wait( lock );
+            }
+
+            if( m_isExiting )
+            {
+                return;
+            }
+            lastGeneration = m_generation;
+        }
+
+        RunTasks();
+
+        {
+            std::lock_guard< std::mutex > lock( m_mutex );
+            m_busyWorkerCount--;
+        }
+        m_doneCondition.notify_one();
+    }
+}
+
+void ThreadPool::RunTasks()
+{
+    for( ;; )
+    {
+        int taskIndex = m_nextTask++;
+        if( taskIndex >= m_taskCount )
+        {
+            break;
+        }
+
+        ( *m_task )( taskIndex );
+    }
+}
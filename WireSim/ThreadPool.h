@@ -0,0 +1,65 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Persistent set of worker threads for running a
+ batch of independent tasks in parallel. Threads are created
+ once and sleep between batches, so there is no cost to spawn
+ threads per simulation step.
+
+***/
+
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+
+public:
+
+    // Thread count includes the calling thread; zero uses one per hardware thread
+    ThreadPool( int threadCount = 0 );
+    ~ThreadPool();
+
+    int GetThreadCount() const;
+
+    // Run task( i ) for every i in [0, taskCount) across all threads, including the calling
+    // thread; returns once every task has completed. Not re-entrant
+    void Run( int taskCount, const std::function< void( int ) >& task );
+
+protected:
+
+    // Worker thread main loop
+    void WorkerMain();
+
+    // Pull tasks from the current batch until it is empty
+    void RunTasks();
+
+private:
+
+    std::vector< std::thread > m_workers;
+
+    // Current batch
+    const std::function< void( int ) >* m_task;
+    int m_taskCount;
+    std::atomic< int > m_nextTask;
+
+    // Batch hand-off; each batch bumps the generation, and workers report back when done
+    std::mutex m_mutex;
+    std::condition_variable m_batchCondition;
+    std::condition_variable m_doneCondition;
+    unsigned int m_generation;
+    int m_busyWorkerCount;
+    bool m_isExiting;
+
+};
+
+#endif // __THREADPOOL_H__
@@ -0,0 +1,773 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include <algorithm>
+
+#include "SimKernel.h"
+#include "TimingWheelEngine.h"
+
+namespace
+{
+    // Shorter runs of wire are cheaper to step tile by tile
+    const int cMinSegmentLength = 4;
+
+    // Smallest number of buckets on the wheel
+    const int cMinWheelSize = 64;
+
+    inline bool IsGate( WireSim::SimType simType )
+    {
+        return ( simType == WireSim::cSimType_AndGate || simType == WireSim::cSimType_OrGate || simType == WireSim::cSimType_XorGate );
+    }
+
+    inline int MakePower( int level, bool isEdge )
+    {
+        return level * 2 + ( isEdge ? 1 : 0 );
+    }
+}
+
+TimingWheelEngine::TimingWheelEngine()
+    : m_topology( NULL )
+    , m_time( 0 )
+    , m_isPlaneCurrent( false )
+    , m_waveCount( 0 )
+    , m_eventCount( 0 )
+{
+}
+
+TimingWheelEngine::~TimingWheelEngine()
+{
+    // ...
+}
+
+void TimingWheelEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    m_topology = &topology;
+    m_time = 0;
+    m_waveCount = 0;
+    m_eventCount = 0;
+
+    int stride = topology.GetStride();
+    m_sideOffsets[ 0 ] = 1;
+    m_sideOffsets[ 1 ] = stride;
+    m_sideOffsets[ 2 ] = -1;
+    m_sideOffsets[ 3 ] = -stride;
+
+    m_dependencyOffsets.clear();
+    for( int i = 0; i < SimKernel::cDependencyOffsetCount; i++ )
+    {
+        m_dependencyOffsets.push_back( SimKernel::cDependencyOffsets[ i ].y * stride + SimKernel::cDependencyOffsets[ i ].x );
+    }
+
+    BuildSegments( topology );
+
+    // Size the wheel to the longest segment; no wave can travel further than that without an event
+    int wheelSize = cMinWheelSize;
+    for( int i = 0; i < (int)m_segments.size(); i++ )
+    {
+        while( wheelSize < m_segments[ i ].tileCount + 2 )
+        {
+            wheelSize *= 2;
+        }
+    }
+    m_wheel.assign( wheelSize, std::vector< int >() );
+
+    m_isOccupied.assign( m_segmentTiles.size(), 0 );
+    m_changedIndices.clear();
+    m_changedPowers.clear();
+    m_touchedIndices.clear();
+    m_queuedSegments.clear();
+    m_movingSegments.clear();
+    m_isPlaneCurrent = true;
+
+    // Nothing is known about the given state, so everything is evaluated once
+    int tileCount = topology.GetTileCount();
+    m_isQueued.assign( tileCount, 0 );
+    m_worklist.clear();
+    for( int i = 0; i < tileCount; i++ )
+    {
+        if( topology.GetType( i ) != WireSim::cSimType_None && m_tileSegments[ i ] < 0 )
+        {
+            m_isQueued[ i ] = 1;
+            m_worklist.push_back( i );
+        }
+    }
+
+    for( int i = 0; i < (int)m_segments.size(); i++ )
+    {
+        LoadSegment( i, power );
+        QueueSegment( i );
+    }
+}
+
+void TimingWheelEngine::Touch( int linearIndex )
+{
+    if( m_tileSegments[ linearIndex ] >= 0 )
+    {
+        m_touchedIndices.push_back( linearIndex );
+    }
+    QueueDependents( linearIndex );
+}
+
+int TimingWheelEngine::Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    if( changesOut && !m_isPlaneCurrent )
+    {
+        Flush( topology, power );
+    }
+
+    LoadTouchedSegments( power );
+
+    // Segments whose event is due join the ones queued by their end neighbors
+    std::vector< int >& bucket = m_wheel[ m_time & ( (int)m_wheel.size() - 1 ) ];
+    for( int i = 0; i < (int)bucket.size(); i++ )
+    {
+        if( m_segments[ bucket[ i ] ].eventTime == m_time )
+        {
+            QueueSegment( bucket[ i ] );
+        }
+    }
+    bucket.clear();
+
+    // Every wave in flight changes its tile this step, wherever it is
+    int changeCount = m_waveCount;
+
+    // Evaluate everything against the current state before writing anything
+    for( int i = 0; i < (int)m_worklist.size(); i++ )
+    {
+        int linearIndex = m_worklist[ i ];
+        m_isQueued[ linearIndex ] = 0;
+
+        WireSim::SimPower newPower = SimKernel::EvaluateTile( topology, power, linearIndex );
+        if( newPower != power.Get( linearIndex ) )
+        {
+            m_changedIndices.push_back( linearIndex );
+            m_changedPowers.push_back( (uint8_t)newPower );
+        }
+    }
+
+    for( int i = 0; i < (int)m_queuedSegments.size(); i++ )
+    {
+        int segment = m_queuedSegments[ i ];
+        m_segments[ segment ].isQueued = false;
+
+        AdvanceSegment( segment, m_time );
+        StepSegment( segment, power );
+        ScheduleSegment( segment );
+    }
+
+    m_eventCount = (int)( m_worklist.size() + m_queuedSegments.size() );
+    m_worklist.clear();
+    m_queuedSegments.clear();
+    m_time++;
+
+    // Apply, and queue up whatever these changes can affect
+    changeCount += (int)m_changedIndices.size();
+    for( int i = 0; i < (int)m_changedIndices.size(); i++ )
+    {
+        if( changesOut )
+        {
+            changesOut->AddTile( m_changedIndices[ i ], power.Get( m_changedIndices[ i ] ), m_changedPowers[ i ] );
+        }
+        power.Set( m_changedIndices[ i ], m_changedPowers[ i ] );
+        QueueDependents( m_changedIndices[ i ] );
+    }
+
+    m_changedIndices.clear();
+    m_changedPowers.clear();
+
+    // End tiles are written by now, so only the insides of segments are left
+    if( changesOut )
+    {
+        StoreMovingSegments( power, changesOut );
+    }
+    m_isPlaneCurrent = ( changesOut != NULL );
+
+    return changeCount;
+}
+
+void TimingWheelEngine::Flush( const SimTopology&, SimPowerPlane& power )
+{
+    LoadTouchedSegments( power );
+
+    for( int i = 0; i < (int)m_segments.size(); i++ )
+    {
+        AdvanceSegment( i, m_time );
+        StoreSegment( i, power );
+    }
+    m_isPlaneCurrent = true;
+}
+
+int TimingWheelEngine::GetSegmentCount() const
+{
+    return (int)m_segments.size();
+}
+
+int TimingWheelEngine::GetSegmentTileCount() const
+{
+    return (int)m_segmentTiles.size();
+}
+
+int TimingWheelEngine::GetEventCount() const
+{
+    return m_eventCount;
+}
+
+void TimingWheelEngine::BuildSegments( const SimTopology& topology )
+{
+    int tileCount = topology.GetTileCount();
+    m_tileSegments.assign( tileCount, -1 );
+    m_segments.clear();
+    m_segmentTiles.clear();
+    m_segmentLevels.clear();
+
+    // A segment tile is a wire whose only neighbors are two other wires, and which is not read
+    // in any other way (as a gate corner, or by the caller as a pin)
+    std::vector< uint8_t > isCandidate( tileCount, 0 );
+    for( int y = 0; y < topology.GetHeight(); y++ )
+    {
+        for( int x = 0; x < topology.GetWidth(); x++ )
+        {
+            int index = topology.GetIndex( x, y );
+            if( !SimKernel::IsWire( topology.GetType( index ) ) )
+            {
+                continue;
+            }
+
+            int wireCount = 0;
+            int otherCount = 0;
+            for( int i = 0; i < 4; i++ )
+            {
+                WireSim::SimType simType = topology.GetType( index + m_sideOffsets[ i ] );
+                if( SimKernel::IsWire( simType ) )
+                {
+                    wireCount++;
+                }
+                else if( simType != WireSim::cSimType_None )
+                {
+                    otherCount++;
+                }
+
+                int corner = index + m_sideOffsets[ i ] + m_sideOffsets[ ( i + 1 ) % 4 ];
+                if( IsGate( topology.GetType( corner ) ) )
+                {
+                    otherCount++;
+                }
+            }
+
+            isCandidate[ index ] = ( wireCount == 2 && otherCount == 0 );
+        }
+    }
+
+    for( int i = 0; i < (int)topology.GetInputIndices().size(); i++ )
+    {
+        isCandidate[ topology.GetIndex( 0, topology.GetInputIndices()[ i ] ) ] = 0;
+    }
+    for( int i = 0; i < (int)topology.GetOutputIndices().size(); i++ )
+    {
+        isCandidate[ topology.GetIndex( topology.GetWidth() - 1, topology.GetOutputIndices()[ i ] ) ] = 0;
+    }
+
+    // Chain them up; every candidate has exactly two wire neighbors
+    std::vector< uint8_t > isVisited( tileCount, 0 );
+    std::vector< int > tiles;
+    for( int index = 0; index < tileCount; index++ )
+    {
+        if( !isCandidate[ index ] || isVisited[ index ] )
+        {
+            continue;
+        }
+
+        // Walk to one end; closed loops are cut open at the starting tile
+        int previous = -1;
+        int current = index;
+        int outside = -1;
+        while( outside < 0 )
+        {
+            int next = -1;
+            for( int i = 0; i < 4 && next < 0; i++ )
+            {
+                int neighbor = current + m_sideOffsets[ i ];
+                if( neighbor != previous && SimKernel::IsWire( topology.GetType( neighbor ) ) )
+                {
+                    next = neighbor;
+                }
+            }
+
+            if( next == index )
+            {
+                isCandidate[ index ] = 0;
+                break;
+            }
+            else if( !isCandidate[ next ] )
+            {
+                outside = next;
+            }
+            else
+            {
+                previous = current;
+                current = next;
+            }
+        }
+
+        if( outside < 0 )
+        {
+            continue;
+        }
+
+        // Then collect tiles up to the other end
+        tiles.clear();
+        previous = outside;
+        while( true )
+        {
+            tiles.push_back( current );
+            isVisited[ current ] = 1;
+
+            int next = -1;
+            for( int i = 0; i < 4 && next < 0; i++ )
+            {
+                int neighbor = current + m_sideOffsets[ i ];
+                if( neighbor != previous && SimKernel::IsWire( topology.GetType( neighbor ) ) )
+                {
+                    next = neighbor;
+                }
+            }
+
+            if( !isCandidate[ next ] )
+            {
+                previous = next;
+                break;
+            }
+
+            previous = current;
+            current = next;
+        }
+
+        if( (int)tiles.size() < cMinSegmentLength )
+        {
+            continue;
+        }
+
+        Segment segment;
+        segment.firstTile = (int)m_segmentTiles.size();
+        segment.tileCount = (int)tiles.size();
+        segment.outsideIndices[ 0 ] = outside;
+        segment.outsideIndices[ 1 ] = previous;
+        segment.time = 0;
+        segment.eventTime = -1;
+        segment.isQueued = false;
+        segment.isMoving = false;
+
+        for( int i = 0; i < (int)tiles.size(); i++ )
+        {
+            m_tileSegments[ tiles[ i ] ] = (int)m_segments.size();
+        }
+        m_segmentTiles.insert( m_segmentTiles.end(), tiles.begin(), tiles.end() );
+        m_segments.push_back( segment );
+    }
+
+    m_segmentLevels.assign( m_segmentTiles.size(), 0 );
+}
+
+void TimingWheelEngine::LoadSegment( int segmentIndex, const SimPowerPlane& power )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    const int* tiles = &m_segmentTiles[ segment.firstTile ];
+    uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+
+    m_waveCount -= (int)segment.waves.size();
+    segment.waves.clear();
+    segment.time = m_time;
+    segment.eventTime = -1;
+
+    for( int i = 0; i < segment.tileCount; i++ )
+    {
+        levels[ i ] = (uint8_t)( power.Get( tiles[ i ] ) >> 1 );
+    }
+
+    // An edge moves on into every neighbor on the other level; if there is none, it settles
+    for( int i = 0; i < segment.tileCount; i++ )
+    {
+        if( !SimKernel::IsEdge( (WireSim::SimPower)power.Get( tiles[ i ] ) ) )
+        {
+            continue;
+        }
+
+        int waveCount = (int)segment.waves.size();
+        for( int direction = -1; direction <= 1; direction += 2 )
+        {
+            int next = i + direction;
+            if( next >= 0 && next < segment.tileCount && power.Get( tiles[ next ] ) == MakePower( 1 - levels[ i ], false ) )
+            {
+                Wave wave = { i, direction };
+                segment.waves.push_back( wave );
+            }
+        }
+
+        if( waveCount == (int)segment.waves.size() )
+        {
+            Wave wave = { i, 1 };
+            segment.waves.push_back( wave );
+        }
+    }
+
+    m_waveCount += (int)segment.waves.size();
+
+    // Every wave starts on an edge the plane shows
+    segment.storedEdges.clear();
+    for( int i = 0; i < (int)segment.waves.size(); i++ )
+    {
+        segment.storedEdges.push_back( segment.waves[ i ].position );
+    }
+    MarkMoving( segmentIndex );
+}
+
+void TimingWheelEngine::StoreSegment( int segmentIndex, SimPowerPlane& power )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    const int* tiles = &m_segmentTiles[ segment.firstTile ];
+    const uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+
+    segment.storedEdges.clear();
+    for( int i = 0; i < segment.tileCount; i++ )
+    {
+        power.Set( tiles[ i ], MakePower( levels[ i ], false ) );
+    }
+    for( int i = 0; i < (int)segment.waves.size(); i++ )
+    {
+        int position = segment.waves[ i ].position;
+        power.Set( tiles[ position ], MakePower( levels[ position ], true ) );
+        segment.storedEdges.push_back( position );
+    }
+}
+
+void TimingWheelEngine::StoreMovingSegments( SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int movingCount = 0;
+    for( int i = 0; i < (int)m_movingSegments.size(); i++ )
+    {
+        int segmentIndex = m_movingSegments[ i ];
+        Segment& segment = m_segments[ segmentIndex ];
+        const int* tiles = &m_segmentTiles[ segment.firstTile ];
+        const uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+        uint8_t* isOccupied = &m_isOccupied[ segment.firstTile ];
+        AdvanceSegment( segmentIndex, m_time );
+
+        // A step only flips tiles that a wave entered, and only moves edges off tiles waves left
+        for( int j = 0; j < (int)segment.waves.size(); j++ )
+        {
+            isOccupied[ segment.waves[ j ].position ] = 1;
+        }
+        for( int j = 0; j < (int)segment.storedEdges.size(); j++ )
+        {
+            if( !isOccupied[ segment.storedEdges[ j ] ] )
+            {
+                StoreTile( tiles[ segment.storedEdges[ j ] ], MakePower( levels[ segment.storedEdges[ j ] ], false ), power, changesOut );
+            }
+        }
+
+        segment.storedEdges.clear();
+        for( int j = 0; j < (int)segment.waves.size(); j++ )
+        {
+            int position = segment.waves[ j ].position;
+            isOccupied[ position ] = 0;
+            StoreTile( tiles[ position ], MakePower( levels[ position ], true ), power, changesOut );
+            segment.storedEdges.push_back( position );
+        }
+
+        if( segment.waves.empty() )
+        {
+            segment.isMoving = false;
+        }
+        else
+        {
+            m_movingSegments[ movingCount++ ] = segmentIndex;
+        }
+    }
+    m_movingSegments.resize( movingCount );
+}
+
+void TimingWheelEngine::StoreTile( int linearIndex, int newPower, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int oldPower = power.Get( linearIndex );
+    if( newPower != oldPower )
+    {
+        power.Set( linearIndex, newPower );
+        changesOut->AddTile( linearIndex, oldPower, newPower );
+    }
+}
+
+void TimingWheelEngine::MarkMoving( int segmentIndex )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    if( !segment.isMoving && ( !segment.waves.empty() || !segment.storedEdges.empty() ) )
+    {
+        segment.isMoving = true;
+        m_movingSegments.push_back( segmentIndex );
+    }
+}
+
+void TimingWheelEngine::AdvanceSegment( int segmentIndex, int time )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    int stepCount = time - segment.time;
+    segment.time = time;
+    if( stepCount <= 0 || segment.waves.empty() )
+    {
+        return;
+    }
+
+    // Nothing meets within the free steps, but a wave may run through the trail of the one ahead
+    // of it in the same direction, so those are moved first
+    uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+    std::vector< Wave >& waves = segment.waves;
+    for( int i = (int)waves.size() - 1; i >= 0; i-- )
+    {
+        if( waves[ i ].direction > 0 )
+        {
+            uint8_t level = levels[ waves[ i ].position ];
+            std::fill( levels + waves[ i ].position + 1, levels + waves[ i ].position + stepCount + 1, level );
+            waves[ i ].position += stepCount;
+        }
+    }
+    for( int i = 0; i < (int)waves.size(); i++ )
+    {
+        if( waves[ i ].direction < 0 )
+        {
+            uint8_t level = levels[ waves[ i ].position ];
+            std::fill( levels + waves[ i ].position - stepCount, levels + waves[ i ].position, level );
+            waves[ i ].position -= stepCount;
+        }
+    }
+}
+
+void TimingWheelEngine::StepSegment( int segmentIndex, const SimPowerPlane& power )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    const int* tiles = &m_segmentTiles[ segment.firstTile ];
+    uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+    uint8_t* isOccupied = &m_isOccupied[ segment.firstTile ];
+    std::vector< Wave >& waves = segment.waves;
+
+    for( int i = 0; i < (int)waves.size(); i++ )
+    {
+        isOccupied[ waves[ i ].position ] = 1;
+    }
+
+    // A wave moves on if the next tile is settled on the other level, and stops otherwise
+    m_nextWaves.clear();
+    m_levelWrites.clear();
+    for( int i = 0; i < (int)waves.size(); i++ )
+    {
+        int position = waves[ i ].position;
+        int next = position + waves[ i ].direction;
+        if( next >= 0 && next < segment.tileCount && !isOccupied[ next ] && levels[ next ] != levels[ position ] )
+        {
+            Wave wave = { next, waves[ i ].direction };
+            m_nextWaves.push_back( wave );
+            m_levelWrites.push_back( next );
+        }
+    }
+
+    // End neighbors start new waves the same way
+    for( int end = 0; end < 2; end++ )
+    {
+        int position = ( end == 0 ) ? 0 : segment.tileCount - 1;
+        int outsidePower = power.Get( segment.outsideIndices[ end ] );
+        if( !isOccupied[ position ] && SimKernel::IsEdge( (WireSim::SimPower)outsidePower ) && ( outsidePower >> 1 ) != levels[ position ] )
+        {
+            Wave wave = { position, ( end == 0 ) ? 1 : -1 };
+            m_nextWaves.push_back( wave );
+            m_levelWrites.push_back( position );
+        }
+    }
+
+    for( int i = 0; i < (int)waves.size(); i++ )
+    {
+        isOccupied[ waves[ i ].position ] = 0;
+    }
+
+    // Every write flips a tile; tiles entered by two waves at once are flipped only once
+    for( int i = 0; i < (int)m_levelWrites.size(); i++ )
+    {
+        if( !isOccupied[ m_levelWrites[ i ] ] )
+        {
+            isOccupied[ m_levelWrites[ i ] ] = 1;
+            levels[ m_levelWrites[ i ] ] ^= 1;
+        }
+    }
+    for( int i = 0; i < (int)m_levelWrites.size(); i++ )
+    {
+        isOccupied[ m_levelWrites[ i ] ] = 0;
+    }
+
+    m_waveCount += (int)m_nextWaves.size() - (int)waves.size();
+    waves.swap( m_nextWaves );
+    std::sort( waves.begin(), waves.end() );
+    segment.time++;
+
+    // End tiles are read by their outside neighbors, so those are kept current in the plane
+    for( int end = 0; end < 2; end++ )
+    {
+        int position = ( end == 0 ) ? 0 : segment.tileCount - 1;
+
+        bool isEdge = false;
+        for( int i = 0; i < (int)waves.size() && !isEdge; i++ )
+        {
+            isEdge = ( waves[ i ].position == position );
+        }
+
+        int newPower = MakePower( levels[ position ], isEdge );
+        if( newPower != power.Get( tiles[ position ] ) )
+        {
+            m_changedIndices.push_back( tiles[ position ] );
+            m_changedPowers.push_back( (uint8_t)newPower );
+        }
+    }
+}
+
+int TimingWheelEngine::GetFreeSteps( const Segment& segment ) const
+{
+    const uint8_t* levels = &m_segmentLevels[ segment.firstTile ];
+    const std::vector< Wave >& waves = segment.waves;
+
+    int freeSteps = segment.tileCount;
+    for( int i = 0; i < (int)waves.size() && freeSteps > 0; i++ )
+    {
+        int position = waves[ i ].position;
+        int direction = waves[ i ].direction;
+        uint8_t level = levels[ position ];
+
+        // Waves on (or entering) an end change a tile the plane has to show
+        if( position == 0 || position == segment.tileCount - 1 )
+        {
+            return 0;
+        }
+        int steps = ( direction > 0 ) ? segment.tileCount - 2 - position : position - 1;
+
+        // The next wave ahead; waves coming the other way meet halfway, waves going the same way
+        // leave a trail of their own level
+        int scanLength = steps;
+        int ahead = i + direction;
+        while( ahead >= 0 && ahead < (int)waves.size() && waves[ ahead ].position == position )
+        {
+            ahead += direction;
+        }
+        if( ahead >= 0 && ahead < (int)waves.size() )
+        {
+            int distance = ( waves[ ahead ].position - position ) * direction;
+            if( waves[ ahead ].direction != direction )
+            {
+                steps = std::min( steps, ( distance - 1 ) / 2 );
+            }
+            else if( levels[ waves[ ahead ].position ] == level )
+            {
+                steps = std::min( steps, distance - 1 );
+            }
+            scanLength = std::min( steps, distance - 1 );
+        }
+
+        // Tiles already on the wave's level stop it
+        for( int j = 1; j <= scanLength; j++ )
+        {
+            if( levels[ position + j * direction ] == level )
+            {
+                steps = j - 1;
+                break;
+            }
+        }
+
+        freeSteps = std::min( freeSteps, steps );
+    }
+
+    return freeSteps;
+}
+
+void TimingWheelEngine::ScheduleSegment( int segmentIndex )
+{
+    Segment& segment = m_segments[ segmentIndex ];
+    if( segment.waves.empty() )
+    {
+        segment.eventTime = -1;
+        return;
+    }
+
+    MarkMoving( segmentIndex );
+
+    segment.eventTime = segment.time + GetFreeSteps( segment );
+    m_wheel[ segment.eventTime & ( (int)m_wheel.size() - 1 ) ].push_back( segmentIndex );
+}
+
+void TimingWheelEngine::QueueSegment( int segmentIndex )
+{
+    if( !m_segments[ segmentIndex ].isQueued )
+    {
+        m_segments[ segmentIndex ].isQueued = true;
+        m_queuedSegments.push_back( segmentIndex );
+    }
+}
+
+void TimingWheelEngine::QueueDependents( int linearIndex )
+{
+    for( int i = 0; i < (int)m_dependencyOffsets.size(); i++ )
+    {
+        int dependentIndex = linearIndex + m_dependencyOffsets[ i ];
+        if( m_isQueued[ dependentIndex ] == 0 && m_tileSegments[ dependentIndex ] < 0 && m_topology->GetType( dependentIndex ) != WireSim::cSimType_None )
+        {
+            m_isQueued[ dependentIndex ] = 1;
+            m_worklist.push_back( dependentIndex );
+        }
+    }
+
+    // Segments only read the neighbors of their ends
+    for( int i = 0; i < 4; i++ )
+    {
+        int segmentIndex = m_tileSegments[ linearIndex + m_sideOffsets[ i ] ];
+        if( segmentIndex >= 0 )
+        {
+            const Segment& segment = m_segments[ segmentIndex ];
+            if( segment.outsideIndices[ 0 ] == linearIndex || segment.outsideIndices[ 1 ] == linearIndex )
+            {
+                QueueSegment( segmentIndex );
+            }
+        }
+    }
+}
+
+void TimingWheelEngine::LoadTouchedSegments( SimPowerPlane& power )
+{
+    if( m_touchedIndices.empty() )
+    {
+        return;
+    }
+
+    // Bring the rest of each touched segment up to date in the plane, then reload it from there
+    std::vector< int > touchedPowers;
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        touchedPowers.push_back( power.Get( m_touchedIndices[ i ] ) );
+    }
+
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        int segment = m_tileSegments[ m_touchedIndices[ i ] ];
+        AdvanceSegment( segment, m_time );
+        StoreSegment( segment, power );
+        QueueSegment( segment );
+    }
+
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        power.Set( m_touchedIndices[ i ], touchedPowers[ i ] );
+    }
+
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        LoadSegment( m_tileSegments[ m_touchedIndices[ i ] ], power );
+    }
+
+    m_touchedIndices.clear();
+}
@@ -0,0 +1,184 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Event-driven engine that keeps the exact timing
+ of the per-pixel kernel, but does not walk long wires pixel
+ by pixel. Runs of wire tiles that only touch the previous and
+ next wire of the run (no nodes, gate corners or pins nearby)
+ are compiled into segments; a segment only ever reacts to its
+ two end neighbors, and delays everything by one step per tile.
+
+ Inside a segment, every edge is a wave moving one tile per
+ step, flipping each tile it enters; it stops on a tile that
+ already has its level, on another wave, or at an end. So a
+ segment knows up front how many steps its waves can travel
+ without running into anything, and schedules itself on a
+ timing wheel (a ring of per-step buckets) for that step
+ instead of being stepped in between; the tiles a wave crossed
+ are filled in at once. Everything else is stepped exactly as
+ in ActiveSetEngine.
+
+ Segment tiles are only written to the power plane when they
+ are read by a neighbor (end tiles) or when the plane is
+ flushed; output pins are never part of a segment, so
+ WireSim::GetOutput is always current. Steps that list their
+ changes keep the plane current instead, but only write the
+ tiles around the waves of segments that have any.
+
+***/
+
+#ifndef __TIMINGWHEELENGINE_H__
+#define __TIMINGWHEELENGINE_H__
+
+#include <vector>
+#include <stdint.h>
+
+#include "SimEngine.h"
+
+class TimingWheelEngine : public SimEngine
+{
+
+public:
+
+    TimingWheelEngine();
+    virtual ~TimingWheelEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+    virtual void Flush( const SimTopology& topology, SimPowerPlane& power );
+
+    // Number of segments, and of tiles in them (their delay in steps)
+    int GetSegmentCount() const;
+    int GetSegmentTileCount() const;
+
+    // Number of segments (and single tiles) evaluated by the last step
+    int GetEventCount() const;
+
+protected:
+
+    // An edge inside a segment; position is an offset into the segment's tiles, direction +1 / -1
+    struct Wave
+    {
+        int position;
+        int direction;
+
+        bool operator<( const Wave& other ) const { return position < other.position; }
+    };
+
+    // Run of wire tiles, in order; end 0 is the first tile, end 1 the last
+    struct Segment
+    {
+        int firstTile;
+        int tileCount;
+
+        // Wire tile next to each end, outside of the segment
+        int outsideIndices[ 2 ];
+
+        // Step the waves (and levels) of this segment are at, and the step at which it has to
+        // be stepped next (-1 if idle)
+        int time;
+        int eventTime;
+        bool isQueued;
+
+        // Sorted by position
+        std::vector< Wave > waves;
+
+        // Positions the power plane shows edges at, as of the last time the segment was stored;
+        // and whether it is listed in m_movingSegments
+        std::vector< int > storedEdges;
+        bool isMoving;
+    };
+
+    // Find all segments of the given topology
+    void BuildSegments( const SimTopology& topology );
+
+    // Rebuild a segment's levels and waves from the power plane
+    void LoadSegment( int segment, const SimPowerPlane& power );
+
+    // Write a segment's current state to the power plane; touched tiles are left alone
+    void StoreSegment( int segment, SimPowerPlane& power );
+
+    // Bring every segment with waves in flight up to date in the power plane, listing the tiles
+    // changed; only tiles on or next to a wave can have changed since the last step
+    void StoreMovingSegments( SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Write a single tile of a segment, listing it if it changed
+    void StoreTile( int linearIndex, int newPower, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // List a segment that has waves, or edges in the plane (see StoreMovingSegments)
+    void MarkMoving( int segment );
+
+    // Move the waves of a segment forward to the given step; must not pass its event time
+    void AdvanceSegment( int segment, int time );
+
+    // Step a segment exactly once, queuing changes to its end tiles
+    void StepSegment( int segment, const SimPowerPlane& power );
+
+    // Number of steps all waves of a segment can travel without meeting anything
+    int GetFreeSteps( const Segment& segment ) const;
+
+    // Put a segment on the wheel for its next event
+    void ScheduleSegment( int segment );
+    void QueueSegment( int segment );
+
+    // Queue every tile and segment that depends on the given tile for the next step
+    void QueueDependents( int linearIndex );
+
+    // Reload segments whose tiles were written outside of a step
+    void LoadTouchedSegments( SimPowerPlane& power );
+
+private:
+
+    // Topology of the attached simulation
+    const SimTopology* m_topology;
+
+    // Step the simulation is at
+    int m_time;
+
+    // Single tiles to evaluate on the next step, as in ActiveSetEngine
+    std::vector< int > m_worklist;
+    std::vector< uint8_t > m_isQueued;
+    std::vector< int > m_dependencyOffsets;
+    int m_sideOffsets[ 4 ];
+
+    // Changes found by the current step; applied once everything has been evaluated
+    std::vector< int > m_changedIndices;
+    std::vector< uint8_t > m_changedPowers;
+
+    // Segment of every tile (-1 if none); tiles and levels (0 or 1) of all segments, grouped by
+    // segment
+    std::vector< int > m_tileSegments;
+    std::vector< Segment > m_segments;
+    std::vector< int > m_segmentTiles;
+    std::vector< uint8_t > m_segmentLevels;
+
+    // Segments to step on the next step
+    std::vector< int > m_queuedSegments;
+
+    // Segments to step at a future step, in buckets of step modulo the wheel size; the wheel is
+    // larger than the longest segment, so no event is ever further out than one turn
+    std::vector< std::vector< int > > m_wheel;
+
+    // Segment tiles written outside of a step
+    std::vector< int > m_touchedIndices;
+
+    // Segments that may have waves, or edges in the plane; and whether the plane shows every
+    // segment's current state (it does after a flush, and after every step that lists changes)
+    std::vector< int > m_movingSegments;
+    bool m_isPlaneCurrent;
+
+    // Scratch space for stepping a segment
+    std::vector< uint8_t > m_isOccupied;
+    std::vector< Wave > m_nextWaves;
+    std::vector< int > m_levelWrites;
+
+    // Waves in flight in all segments, and evaluations done by the last step
+    int m_waveCount;
+    int m_eventCount;
+
+};
+
+#endif // __TIMINGWHEELENGINE_H__
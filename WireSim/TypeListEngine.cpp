@@ -0,0 +1,342 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+***/
+
+#include "SimKernel.h"
+#include "TypeListEngine.h"
+
+namespace
+{
+    // Writers in the kernel's order (reverse scan order): bottom, right, left, then top; writers
+    // on the left or top are the ones a low joint writes to the right or down from
+    const int cWriterCount = 4;
+    const int cFirstLowWriter = 2;
+
+    // Corner offsets, relative to a gate
+    const int cCornerCount = 4;
+    const Vec2 cCorners[ cCornerCount ] =
+    {
+        Vec2( -1, -1 ),
+        Vec2( 1, -1 ),
+        Vec2( 1, 1 ),
+        Vec2( -1, 1 ),
+    };
+
+    // Edge a wire driven toward the given level takes on
+    inline WireSim::SimPower GetEdge( WireSim::SimPower level )
+    {
+        return ( level == WireSim::cSimPower_HighEdge ) ? WireSim::cSimPower_RisingEdge : WireSim::cSimPower_FallingEdge;
+    }
+}
+
+TypeListEngine::TypeListEngine()
+{
+}
+
+TypeListEngine::~TypeListEngine()
+{
+    // ...
+}
+
+void TypeListEngine::Reset( const SimTopology& topology, const SimPowerPlane& power )
+{
+    for( int i = 0; i < WireSim::cSimTypeCount; i++ )
+    {
+        m_typeIndices[ i ].clear();
+    }
+    m_wireTiles.clear();
+    m_wireWriterStarts.assign( 1, 0 );
+    m_wireWriters.clear();
+    m_mixedTiles.clear();
+    m_mixedWriterStarts.assign( 1, 0 );
+    m_mixedWriters.clear();
+    m_writerInputs.clear();
+
+    const int stride = topology.GetStride();
+    const int writerOffsets[ cWriterCount ] = { stride, 1, -1, -stride };
+    for( int y = 0; y < topology.GetHeight(); y++ )
+    {
+        for( int x = 0; x < topology.GetWidth(); x++ )
+        {
+            int index = topology.GetIndex( x, y );
+            WireSim::SimType simType = topology.GetType( index );
+            if( simType == WireSim::cSimType_None )
+            {
+                continue;
+            }
+
+            m_typeIndices[ simType ].push_back( index );
+            if( !SimKernel::IsWire( simType ) )
+            {
+                continue;
+            }
+
+            // Wires are never in the border, so every writer and every tile it reads is in the layout
+            std::vector< Writer > writers;
+            bool isWireWritten = true;
+            for( int i = 0; i < cWriterCount; i++ )
+            {
+                Writer writer;
+                writer.index = index + writerOffsets[ i ];
+                writer.firstInput = (int)m_writerInputs.size();
+                writer.inputCount = 0;
+                writer.isLowWriter = ( i >= cFirstLowWriter );
+
+                switch( topology.GetType( writer.index ) )
+                {
+                    case WireSim::cSimType_WireType0:
+                    case WireSim::cSimType_WireType1:
+                        writer.kind = cWriterKind_Wire;
+                        break;
+
+                    // Copies the tile on the far side, which only ever writes if that is a wire
+                    case WireSim::cSimType_JumpJoint:
+                    case WireSim::cSimType_NotGate:
+                        if( !SimKernel::IsWire( topology.GetType( writer.index + writerOffsets[ i ] ) ) )
+                        {
+                            continue;
+                        }
+                        writer.kind = ( topology.GetType( writer.index ) == WireSim::cSimType_NotGate ) ? cWriterKind_Not : cWriterKind_Jump;
+                        m_writerInputs.push_back( writer.index + writerOffsets[ i ] );
+                        writer.inputCount = 1;
+                        break;
+
+                    // Reads the wires among its corners; with none, it still writes low
+                    case WireSim::cSimType_AndGate:
+                    case WireSim::cSimType_OrGate:
+                    case WireSim::cSimType_XorGate:
+                        {
+                            WireSim::SimType gateType = topology.GetType( writer.index );
+                            writer.kind = ( gateType == WireSim::cSimType_AndGate ) ? cWriterKind_And : ( gateType == WireSim::cSimType_OrGate ) ? cWriterKind_Or : cWriterKind_Xor;
+                            for( int j = 0; j < cCornerCount; j++ )
+                            {
+                                int inputIndex = writer.index + cCorners[ j ].y * stride + cCorners[ j ].x;
+                                if( SimKernel::IsWire( topology.GetType( inputIndex ) ) )
+                                {
+                                    m_writerInputs.push_back( inputIndex );
+                                    writer.inputCount++;
+                                }
+                            }
+                        }
+                        break;
+
+                    default:
+                        continue;
+                }
+
+                isWireWritten = isWireWritten && ( writer.kind == cWriterKind_Wire );
+                writers.push_back( writer );
+            }
+
+            if( isWireWritten )
+            {
+                m_wireTiles.push_back( index );
+                for( int i = 0; i < (int)writers.size(); i++ )
+                {
+                    m_wireWriters.push_back( writers[ i ].index );
+                }
+                m_wireWriterStarts.push_back( (int)m_wireWriters.size() );
+            }
+            else
+            {
+                m_mixedTiles.push_back( index );
+                m_mixedWriters.insert( m_mixedWriters.end(), writers.begin(), writers.end() );
+                m_mixedWriterStarts.push_back( (int)m_mixedWriters.size() );
+            }
+        }
+    }
+
+    for( int i = 0; i < WireSim::cSimTypeCount; i++ )
+    {
+        std::vector< int >( m_typeIndices[ i ] ).swap( m_typeIndices[ i ] );
+    }
+
+    m_backPower = power;
+    m_touchedIndices.clear();
+}
+
+void TypeListEngine::Touch( int linearIndex )
+{
+    m_touchedIndices.push_back( linearIndex );
+}
+
+int TypeListEngine::Step( const SimTopology&, SimPowerPlane& power, SimChangeList* changesOut )
+{
+    for( int i = 0; i < (int)m_touchedIndices.size(); i++ )
+    {
+        m_backPower.Set( m_touchedIndices[ i ], power.Get( m_touchedIndices[ i ] ) );
+    }
+    m_touchedIndices.clear();
+
+    // Nodes only settle their own edges
+    int changeCount = 0;
+    changeCount += SettleTiles( m_typeIndices[ WireSim::cSimType_JumpJoint ], power, changesOut );
+    changeCount += SettleTiles( m_typeIndices[ WireSim::cSimType_NotGate ], power, changesOut );
+    changeCount += SettleTiles( m_typeIndices[ WireSim::cSimType_AndGate ], power, changesOut );
+    changeCount += SettleTiles( m_typeIndices[ WireSim::cSimType_OrGate ], power, changesOut );
+    changeCount += SettleTiles( m_typeIndices[ WireSim::cSimType_XorGate ], power, changesOut );
+
+    // Wires settle their own edges, or are written by a neighbor
+    changeCount += StepWireTiles( power, changesOut );
+    changeCount += StepMixedTiles( power, changesOut );
+
+    power.Swap( m_backPower );
+    return changeCount;
+}
+
+int TypeListEngine::GetTileCount( WireSim::SimType simType ) const
+{
+    return (int)m_typeIndices[ simType ].size();
+}
+
+size_t TypeListEngine::GetListByteCount() const
+{
+    size_t byteCount = 0;
+    for( int i = 0; i < WireSim::cSimTypeCount; i++ )
+    {
+        byteCount += m_typeIndices[ i ].capacity() * sizeof( int );
+    }
+
+    byteCount += ( m_wireTiles.capacity() + m_wireWriterStarts.capacity() + m_wireWriters.capacity() ) * sizeof( int );
+    byteCount += ( m_mixedTiles.capacity() + m_mixedWriterStarts.capacity() + m_writerInputs.capacity() ) * sizeof( int );
+    byteCount += m_mixedWriters.capacity() * sizeof( Writer );
+    return byteCount;
+}
+
+int TypeListEngine::SettleTiles( const std::vector< int >& indices, const SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int changeCount = 0;
+    for( int i = 0; i < (int)indices.size(); i++ )
+    {
+        WireSim::SimPower simPower = (WireSim::SimPower)power.Get( indices[ i ] );
+        WireSim::SimPower newPower = SimKernel::Settle( simPower );
+        m_backPower.Set( indices[ i ], newPower );
+        if( newPower != simPower )
+        {
+            changeCount++;
+            if( changesOut )
+            {
+                changesOut->AddTile( indices[ i ], simPower, newPower );
+            }
+        }
+    }
+    return changeCount;
+}
+
+int TypeListEngine::StepWireTiles( const SimPowerPlane& power, SimChangeList* changesOut )
+{
+    // A settled wire takes on the edge of the first neighbor changing toward the other level
+    int changeCount = 0;
+    for( int i = 0; i < (int)m_wireTiles.size(); i++ )
+    {
+        int index = m_wireTiles[ i ];
+        WireSim::SimPower simPower = (WireSim::SimPower)power.Get( index );
+        WireSim::SimPower newPower = SimKernel::Settle( simPower );
+        if( newPower == simPower )
+        {
+            WireSim::SimPower spreadEdge = ( simPower == WireSim::cSimPower_LowEdge ) ? WireSim::cSimPower_RisingEdge : WireSim::cSimPower_FallingEdge;
+            for( int j = m_wireWriterStarts[ i ]; j < m_wireWriterStarts[ i + 1 ]; j++ )
+            {
+                if( power.Get( m_wireWriters[ j ] ) == spreadEdge )
+                {
+                    newPower = spreadEdge;
+                    break;
+                }
+            }
+        }
+
+        m_backPower.Set( index, newPower );
+        if( newPower != simPower )
+        {
+            changeCount++;
+            if( changesOut )
+            {
+                changesOut->AddTile( index, simPower, newPower );
+            }
+        }
+    }
+    return changeCount;
+}
+
+int TypeListEngine::StepMixedTiles( const SimPowerPlane& power, SimChangeList* changesOut )
+{
+    int changeCount = 0;
+    for( int i = 0; i < (int)m_mixedTiles.size(); i++ )
+    {
+        int index = m_mixedTiles[ i ];
+        WireSim::SimPower simPower = (WireSim::SimPower)power.Get( index );
+        WireSim::SimPower newPower = SimKernel::Settle( simPower );
+        for( int j = m_mixedWriterStarts[ i ]; j < m_mixedWriterStarts[ i + 1 ] && newPower == simPower; j++ )
+        {
+            const Writer& writer = m_mixedWriters[ j ];
+            WireSim::SimPower writerPower = (WireSim::SimPower)power.Get( writer.index );
+            const int* inputs = m_writerInputs.data() + writer.firstInput;
+
+            switch( writer.kind )
+            {
+                case cWriterKind_Wire:
+                    if( SimKernel::IsEdge( writerPower ) && SimKernel::Settle( writerPower ) != simPower )
+                    {
+                        newPower = writerPower;
+                    }
+                    break;
+
+                // Joints copy (and not-gates invert) their settled source, in the direction their own level picks
+                case cWriterKind_Jump:
+                case cWriterKind_Not:
+                    {
+                        WireSim::SimPower sourcePower = (WireSim::SimPower)power.Get( inputs[ 0 ] );
+                        if( ( SimKernel::Settle( writerPower ) == WireSim::cSimPower_LowEdge ) != writer.isLowWriter || SimKernel::IsEdge( sourcePower ) )
+                        {
+                            break;
+                        }
+                        if( writer.kind == cWriterKind_Not )
+                        {
+                            sourcePower = ( sourcePower == WireSim::cSimPower_LowEdge ) ? WireSim::cSimPower_HighEdge : WireSim::cSimPower_LowEdge;
+                        }
+                        if( sourcePower != simPower )
+                        {
+                            newPower = GetEdge( sourcePower );
+                        }
+                    }
+                    break;
+
+                // Gates pulse the edge of the wire's current level whenever their result differs from it
+                default:
+                    {
+                        int onCount = 0;
+                        int offCount = 0;
+                        for( int k = 0; k < writer.inputCount; k++ )
+                        {
+                            WireSim::SimPower inputPower = (WireSim::SimPower)power.Get( inputs[ k ] );
+                            onCount += ( inputPower == WireSim::cSimPower_HighEdge ) ? 1 : 0;
+                            offCount += ( inputPower == WireSim::cSimPower_LowEdge ) ? 1 : 0;
+                        }
+
+                        bool isHigh = ( writer.kind == cWriterKind_And ) ? ( onCount >= 2 && offCount <= 0 ) :
+                                      ( writer.kind == cWriterKind_Or ) ? ( onCount >= 1 && offCount > 0 ) :
+                                      ( onCount == 1 && offCount > 0 );
+                        if( isHigh != ( simPower == WireSim::cSimPower_HighEdge ) )
+                        {
+                            newPower = GetEdge( simPower );
+                        }
+                    }
+                    break;
+            }
+        }
+
+        m_backPower.Set( index, newPower );
+        if( newPower != simPower )
+        {
+            changeCount++;
+            if( changesOut )
+            {
+                changesOut->AddTile( index, simPower, newPower );
+            }
+        }
+    }
+    return changeCount;
+}
@@ -0,0 +1,109 @@
+/***
+
+ WireSim - Discrete Circuit Simulated PixelArt
+ Copyright (c) 2014 Jeremy Bridon
+
+ Description: Engine that steps tiles grouped by type instead
+ of in scan order. The indices of all tiles of each type are
+ collected once; undefined tiles never change, so they are
+ not listed at all, and every other list gets its own loop:
+ nodes (jump joints, not-gates, gates) only ever settle their
+ own edges, and only wires look at their neighbors. No loop
+ branches on the type of the tile it is looking at.
+
+ What can write to a wire never changes either, so its writers
+ (see SimKernel) are resolved once as well: for every wire the
+ neighbors that can write to it, in the kernel's order, each
+ with its kind and the tiles it reads. Neighbors that can never
+ write (undefined tiles, joints without a wire to copy) are
+ left out. Most wires only have wires around them; those are
+ kept in a list of their own, stepped without looking at any
+ writer kind.
+
+***/
+
+#ifndef __TYPELISTENGINE_H__
+#define __TYPELISTENGINE_H__
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SimEngine.h"
+#include "WireSim.h"
+
+class TypeListEngine : public SimEngine
+{
+
+public:
+
+    TypeListEngine();
+    virtual ~TypeListEngine();
+
+    virtual void Reset( const SimTopology& topology, const SimPowerPlane& power );
+    virtual void Touch( int linearIndex );
+    virtual int Step( const SimTopology& topology, SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Number of tiles of the given type (zero for cSimType_None, which is not listed)
+    int GetTileCount( WireSim::SimType simType ) const;
+
+    // Memory taken by all index and writer lists
+    size_t GetListByteCount() const;
+
+private:
+
+    // What a writer of a wire is, and so how it decides to write
+    enum WriterKind
+    {
+        cWriterKind_Wire,
+        cWriterKind_Jump,
+        cWriterKind_Not,
+        cWriterKind_And,
+        cWriterKind_Or,
+        cWriterKind_Xor,
+    };
+
+    // A neighbor that can write to a wire; jump / not writers read the wire on the far side, gates
+    // the wires among their corners, listed in m_writerInputs
+    struct Writer
+    {
+        int index;
+        int firstInput;
+        uint8_t kind;
+        uint8_t inputCount;
+        bool isLowWriter; // Jump / not writers only write this wire while settled low (else high)
+    };
+
+    // Settle the edges of the given tiles; returns the number of tiles changed, which are also
+    // added to the given change list, if any
+    int SettleTiles( const std::vector< int >& indices, const SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Step wires with only wire writers, or with any writers; same return value
+    int StepWireTiles( const SimPowerPlane& power, SimChangeList* changesOut );
+    int StepMixedTiles( const SimPowerPlane& power, SimChangeList* changesOut );
+
+    // Tile indices (see SimTopology::GetIndex) of every type, in scan order
+    std::vector< int > m_typeIndices[ WireSim::cSimTypeCount ];
+
+    // Wires written by wires only, with the indices of those (m_wireWriterStarts has one more
+    // entry than there are wires, so wire i owns [ start[ i ], start[ i + 1 ] ))
+    std::vector< int > m_wireTiles;
+    std::vector< int > m_wireWriterStarts;
+    std::vector< int > m_wireWriters;
+
+    // All other wires, with their writers in the same way
+    std::vector< int > m_mixedTiles;
+    std::vector< int > m_mixedWriterStarts;
+    std::vector< Writer > m_mixedWriters;
+    std::vector< int > m_writerInputs;
+
+    // Next power states, swapped with the simulation's power plane after every step; tiles that
+    // are not listed hold the same power in both
+    SimPowerPlane m_backPower;
+
+    // Tiles written outside of a step; copied over to the back buffer in case they are not listed
+    std::vector< int > m_touchedIndices;
+
+};
+
+#endif // __TYPELISTENGINE_H__
@@ -5,10 +5,25 @@
 
  ***/
 
+#include <algorithm>
+#include <chrono>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
 #include <vector>
 
 #include "../lodepng.h"
-#include "Vec2.h"
+#include "ActiveSetEngine.h"
+#include "SimCheckpoint.h"
+#include "SimCompiledCircuit.h"
+#include "SimCycleDetector.h"
+#include "SimFrameWriter.h"
+#include "SimHistory.h"
+#include "SimEngine.h"
+#include "SimKernel.h"
+#include "SimSnapshot.h"
+#include "SimTopology.h"
 #include "WireSim.h"
 
 namespace
@@ -28,92 +43,52 @@ namespace
         { 0x00ad7fa8, 0x00ad7fa9, 0x005c3566, 0x005c3567 }, // Not (Purple)
     };
     
-    // Constants used for iterating over adjacent tiles, etc..
+    // Eval leaves the packed kernel for an event-driven engine once fewer than one in this many
+    // words change per step
+    const int cEvalSparseRatio = 64;
     
-    // Directly adjacent offsets
-    const int cDirectlyAdjacentOffsetCount = 4;
-    const Vec2 cDirectlyAdjacentOffsets[ cDirectlyAdjacentOffsetCount ] =
-    {
-        Vec2( 2, 1 ), // Right
-        Vec2( 1, 2 ), // Down
-        Vec2( 0, 1 ), // Left
-        Vec2( 1, 0 ), // Top
-    };
+    // Steps between reads of the clock in Eval
+    const int cEvalTimeCheckInterval = 16;
     
-    // Corner offsets
-    const int cCornerOffsetCount = 4;
-    const Vec2 cCornerOffsets[ cCornerOffsetCount ] =
-    {
-        Vec2( 0, 0 ), // Top-left
-        Vec2( 2, 0 ), // Top-right
-        Vec2( 2, 2 ), // Bottom-right
-        Vec2( 0, 2 ), // Bottom-left
-    };
+    // Steps computed on a band of rows before moving to the next one, and the cache space a band
+    // should fit in (its rows in all four planes a block touches)
+    const int cBlockStepCount = 8;
+    const int cBlockByteCount = 256 * 1024;
     
 }
 
-WireSim::WireSim( const char* pngFileName )
+WireSim::WireSim( const char* fileName )
     : m_width( 0 )
     , m_height( 0 )
+    , m_topology( new SimTopology( fileName ) )
+    , m_stepCount( 0 )
+    , m_cycleFirstStep( 0 )
 {
-    std::vector< unsigned char > srcImage;
-    unsigned int width;
-    unsigned int height;
-    
-    // Given as RGBA format, convert to ARGB
-    unsigned int error = lodepng::decode( srcImage, width, height, pngFileName );
-    
-    if( error != 0 )
-    {
-        printf( "Failed to load\n" );
-        return;
-    }
-    
-    m_width = (int)width;
-    m_height = (int)height;
-    
-    for( int i = 0; i < (int)srcImage.size(); i += 4 )
-    {
-        SimColor simColor = 0;
-        simColor |= (SimColor)( srcImage.at( i + 0 ) & 0xff ) << 16;
-        simColor |= (SimColor)( srcImage.at( i + 1 ) & 0xff ) << 8;
-        simColor |= (SimColor)( srcImage.at( i + 2 ) & 0xff );
-        m_image.push_back( simColor );
-    }
-    
-    // Every other line
-    for( int y = 0; y < m_height; y += 2 )
-    {
-        // Read left and right
-        for( int dx = 0; dx < 2; dx++ )
-        {
-            int x = 0;
-            if( dx == 1 )
-            {
-                x = m_width - 1;
-            }
-            
-            SimType simType = cSimType_None;
-            SimPower powerOut = cSimPower_LowEdge;
-            GetSimType( x, y, simType, powerOut );
-            
-            if( simType == cSimType_WireType0 ||
-                simType == cSimType_WireType1 ||
-                simType == cSimType_JumpJoint )
-            {
-                if( dx == 0 )
-                {
-                    m_inputIndices.push_back( y );
-                }
-                else
-                {
-                    m_outputIndices.push_back( y );
-                }
-            }
-        }
-    }
-    
-    // TODO: Initialize all not-gates...
+    m_width = m_topology->GetWidth();
+    m_height = m_topology->GetHeight();
+    m_power = m_topology->GetInitialPower();
+}
+
+WireSim::WireSim( const std::shared_ptr< const SimTopology >& topology )
+    : m_width( topology->GetWidth() )
+    , m_height( topology->GetHeight() )
+    , m_topology( topology )
+    , m_power( topology->GetInitialPower() )
+    , m_stepCount( 0 )
+    , m_cycleFirstStep( 0 )
+{
+    // ...
+}
+
+WireSim::WireSim( const std::shared_ptr< const SimSnapshot >& snapshot )
+    : m_width( snapshot->GetTopology()->GetWidth() )
+    , m_height( snapshot->GetTopology()->GetHeight() )
+    , m_topology( snapshot->GetTopology() )
+    , m_stepCount( snapshot->GetStepCount() )
+    , m_cycleFirstStep( 0 )
+    , m_baseSnapshot( snapshot )
+{
+    snapshot->CopyTo( m_power );
 }
 
 WireSim::~WireSim()
@@ -129,12 +104,12 @@ void WireSim::GetSize( int& widthOut, int& heightOut ) const
 
 int WireSim::GetInputCount() const
 {
-    return (int)m_inputIndices.size();
+    return (int)m_topology->GetInputIndices().size();
 }
 
 void WireSim::SetInput( int inputIndex, bool turnOn )
 {
-    int pinOffset = m_inputIndices.at( inputIndex );
+    int pinOffset = m_topology->GetInputIndices().at( inputIndex );
     
     SimType simType = cSimType_None;
     SimPower simPower = cSimPower_LowEdge;
@@ -143,18 +118,40 @@ void WireSim::SetInput( int inputIndex, bool turnOn )
     if( ( turnOn && simPower != cSimPower_HighEdge && simPower != cSimPower_RisingEdge ) ||
         ( !turnOn && simPower != cSimPower_LowEdge && simPower != cSimPower_FallingEdge ) )
     {
-        SetSimType( m_image, 0, pinOffset, simType, turnOn ? cSimPower_RisingEdge : cSimPower_FallingEdge );
+        SimPower newPower = turnOn ? cSimPower_RisingEdge : cSimPower_FallingEdge;
+        SetSimPower( m_power, 0, pinOffset, newPower );
+        
+        if( m_engine )
+        {
+            m_engine->Touch( GetLinearPosition( 0, pinOffset ) );
+        }
+        if( m_history )
+        {
+            m_history->RecordWrite( GetLinearPosition( 0, pinOffset ), simPower, newPower );
+        }
+        
+        // States recorded before the change lead somewhere else now; any cycle found among them
+        // no longer applies, and their hashes must not match the ones to come
+        if( m_cycleDetector )
+        {
+            if( m_engine )
+            {
+                m_engine->Flush( *m_topology, m_power );
+            }
+            m_cycleDetector->Reset( m_power );
+            m_cycleFirstStep = m_stepCount;
+        }
     }
 }
 
 int WireSim::GetOutputCount() const
 {
-    return (int)m_outputIndices.size();
+    return (int)m_topology->GetOutputIndices().size();
 }
 
 void WireSim::GetOutput( int outputIndex, SimPower& powerLevel ) const
 {
-    int pinOffset = m_outputIndices.at( outputIndex );
+    int pinOffset = m_topology->GetOutputIndices().at( outputIndex );
     
     SimType simType = cSimType_None;
     GetSimType( m_width - 1, pinOffset, simType, powerLevel );
@@ -162,35 +159,270 @@ void WireSim::GetOutput( int outputIndex, SimPower& powerLevel ) const
 
 bool WireSim::Update()
 {
-    // Copy source to dest; update, then flip buffer
-    std::vector< SimColor > resultImage = m_image;
+    int count = 0;
+    SimChangeList* changes = GetStepChanges();
+    if( m_engine )
+    {
+        count = m_engine->Step( *m_topology, m_power, changes );
+    }
+    else
+    {
+        // Pull the next state of every tile into the back buffer, counting the words that
+        // differ as they are written; then flip buffers
+        PrepareBackPower();
+        count = SimKernel::EvaluateWords( *m_topology, m_power, m_backPower, 0, m_power.GetWordCount(), changes );
+        m_power.Swap( m_backPower );
+    }
     
-    // For each pixel..
-    for( int y = 0; y < m_height; y++ )
+    m_stepCount++;
+    RecordState();
+    return ( count > 0 );
+}
+
+bool WireSim::Update( int steps )
+{
+    // Cycle detection and history need every intermediate state
+    if( m_engine || m_cycleDetector || m_history || steps < 2 )
     {
-        for( int x = 0; x < m_width; x++ )
+        bool hasChanged = false;
+        for( int i = 0; i < steps; i++ )
         {
-            Update( x, y, m_image, resultImage );
+            hasChanged = Update();
         }
+        return hasChanged;
     }
     
-    // Check for differences
-    int count = 0;
-    for( int i = 0; i < (int)resultImage.size(); i++ )
+    // A row's next state only depends on rows up to the kernel's reach away. So bands of rows are
+    // taken through several steps at a time, each step of a band shifted up by that reach: all
+    // rows it needs from the previous step are then either its own, or those of the band above,
+    // which is already done. Every row is still computed once per step, but a band stays in
+    // cache for all of its steps
+    const int cReach = SimTopology::cBorder;
+    int rowWordCount = m_topology->GetStride() / SimPowerPlane::cTilesPerWord;
+    int bandRowCount = std::max( cReach * 4, cBlockByteCount / ( 4 * rowWordCount * (int)sizeof( uint64_t ) ) - cReach * cBlockStepCount );
+    
+    // Rows outside the image never change, but are read; every plane written gets a copy (new
+    // planes share all chunks, see SimPowerPlane)
+    int firstImageWord = m_topology->GetIndex( 0, 0 ) / SimPowerPlane::cTilesPerWord;
+    int endImageWord = m_topology->GetIndex( 0, m_height ) / SimPowerPlane::cTilesPerWord;
+    SimPowerPlane* planes[ 3 ] = { &m_backPower, &m_blockPower[ 0 ], &m_blockPower[ 1 ] };
+    for( int i = 0; i < 3; i++ )
     {
-        if( m_image.at( i ) != resultImage.at( i ) )
+        if( planes[ i ]->GetTileCount() != m_power.GetTileCount() )
         {
-            count++;
+            *planes[ i ] = m_power;
+        }
+        for( int word = 0; word < firstImageWord; word++ )
+        {
+            planes[ i ]->SetWord( word, m_power.GetWord( word ) );
+        }
+        for( int word = endImageWord; word < m_power.GetWordCount(); word++ )
+        {
+            planes[ i ]->SetWord( word, m_power.GetWord( word ) );
         }
     }
     
-    // Save to output
-    m_image = resultImage;
+    int changeCount = 0;
+    for( int stepIndex = 0; stepIndex < steps; stepIndex += cBlockStepCount )
+    {
+        int blockStepCount = std::min( cBlockStepCount, steps - stepIndex );
+        int bandCount = ( m_height + cReach * blockStepCount + bandRowCount - 1 ) / bandRowCount;
+        
+        changeCount = 0;
+        for( int band = 0; band < bandCount; band++ )
+        {
+            // Intermediate steps go back and forth between the block planes, the last one is
+            // written to the back buffer; a band never overwrites rows the next band still reads
+            for( int i = 1; i <= blockStepCount; i++ )
+            {
+                int firstRow = std::max( 0, band * bandRowCount - cReach * i );
+                int endRow = std::min( m_height, ( band + 1 ) * bandRowCount - cReach * i );
+                if( firstRow >= endRow )
+                {
+                    continue;
+                }
+                
+                const SimPowerPlane& source = ( i == 1 ) ? m_power : m_blockPower[ ( i - 1 ) & 1 ];
+                SimPowerPlane& dest = ( i == blockStepCount ) ? m_backPower : m_blockPower[ i & 1 ];
+                int firstWord = m_topology->GetIndex( 0, firstRow ) / SimPowerPlane::cTilesPerWord;
+                int endWord = m_topology->GetIndex( 0, endRow ) / SimPowerPlane::cTilesPerWord;
+                int count = SimKernel::EvaluateWords( *m_topology, source, dest, firstWord, endWord, NULL );
+                
+                if( i == blockStepCount )
+                {
+                    changeCount += count;
+                }
+            }
+        }
+        
+        m_power.Swap( m_backPower );
+    }
     
-    return ( count > 0 );
+    m_stepCount += steps;
+    return ( changeCount > 0 );
+}
+
+int64_t WireSim::GetStepCount() const
+{
+    return m_stepCount;
+}
+
+int WireSim::Eval( int maxSteps, double timeBudget, EvalStatus& statusOut )
+{
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    
+    // Without an engine, dense steps run on the packed kernel; once activity has died down to a
+    // few tiles, the rest is handed to an event-driven engine, which produces the same states
+    // but only looks at tiles next to a change
+    SimEngine* engine = m_engine.get();
+    std::unique_ptr< SimEngine > tailEngine;
+    
+    statusOut = cEvalStatus_StepLimit;
+    int stepCount = 0;
+    while( stepCount < maxSteps )
+    {
+        int changeCount = 0;
+        SimChangeList* changes = GetStepChanges();
+        if( engine )
+        {
+            changeCount = engine->Step( *m_topology, m_power, changes );
+        }
+        else
+        {
+            PrepareBackPower();
+            changeCount = SimKernel::EvaluateWords( *m_topology, m_power, m_backPower, 0, m_power.GetWordCount(), changes );
+            m_power.Swap( m_backPower );
+            
+            if( changeCount > 0 && changeCount * cEvalSparseRatio < m_power.GetWordCount() )
+            {
+                tailEngine.reset( new ActiveSetEngine() );
+                tailEngine->Reset( *m_topology, m_power );
+                engine = tailEngine.get();
+            }
+        }
+        stepCount++;
+        m_stepCount++;
+        
+        RecordState();
+        
+        if( changeCount == 0 )
+        {
+            statusOut = cEvalStatus_Settled;
+            break;
+        }
+        
+        if( m_cycleDetector && m_cycleDetector->HasCycle() )
+        {
+            statusOut = cEvalStatus_Cycle;
+            break;
+        }
+        
+        if( timeBudget > 0.0 && ( stepCount % cEvalTimeCheckInterval ) == 0 &&
+            std::chrono::duration< double >( std::chrono::steady_clock::now() - startTime ).count() >= timeBudget )
+        {
+            statusOut = cEvalStatus_TimeLimit;
+            break;
+        }
+    }
+    
+    return stepCount;
+}
+
+void WireSim::SetEngine( SimEngine* engine )
+{
+    // The old engine may still hold part of the state
+    if( m_engine )
+    {
+        m_engine->Flush( *m_topology, m_power );
+    }
+    
+    m_engine.reset( engine );
+    
+    if( m_engine )
+    {
+        m_engine->Reset( *m_topology, m_power );
+    }
+}
+
+SimEngine* WireSim::GetEngine() const
+{
+    return m_engine.get();
 }
 
-bool WireSim::GetSimType( const SimColor& givenColor, SimType& simTypeOut, SimPower& powerOut ) const
+void WireSim::SetCycleDetection( bool isEnabled )
+{
+    m_cycleDetector.reset();
+    
+    if( isEnabled )
+    {
+        if( m_engine )
+        {
+            m_engine->Flush( *m_topology, m_power );
+        }
+        
+        m_cycleDetector.reset( new SimCycleDetector() );
+        m_cycleDetector->Reset( m_power );
+        m_cycleFirstStep = m_stepCount;
+    }
+}
+
+void WireSim::SetHistoryRecording( bool isEnabled )
+{
+    m_history.reset();
+    
+    if( isEnabled )
+    {
+        if( m_engine )
+        {
+            m_engine->Flush( *m_topology, m_power );
+        }
+        
+        m_history.reset( new SimHistory( m_topology ) );
+        m_history->Reset( m_power, m_stepCount );
+    }
+}
+
+const SimHistory* WireSim::GetHistory() const
+{
+    return m_history.get();
+}
+
+bool WireSim::RestoreStep( int64_t step )
+{
+    if( !m_history || !m_history->Truncate( step ) )
+    {
+        return false;
+    }
+    
+    m_history->GetState( step, m_power );
+    m_stepCount = step;
+    
+    if( m_engine )
+    {
+        m_engine->Reset( *m_topology, m_power );
+    }
+    if( m_cycleDetector )
+    {
+        m_cycleDetector->Reset( m_power );
+        m_cycleFirstStep = m_stepCount;
+    }
+    
+    return true;
+}
+
+bool WireSim::GetCycle( int& periodOut, int64_t& startStepOut ) const
+{
+    if( !m_cycleDetector || !m_cycleDetector->HasCycle() )
+    {
+        return false;
+    }
+    
+    periodOut = m_cycleDetector->GetPeriod();
+    startStepOut = m_cycleFirstStep + m_cycleDetector->GetStartStep();
+    return true;
+}
+
+bool WireSim::GetSimType( const SimColor& givenColor, SimType& simTypeOut, SimPower& powerOut )
 {
     // Linear search
     // Todo: could do a hash for fast lookup
@@ -214,278 +446,327 @@ bool WireSim::GetSimType( const SimColor& givenColor, SimType& simTypeOut, SimPo
 
 bool WireSim::GetSimType( int x, int y, SimType& simTypeOut, SimPower& powerOut ) const
 {
+    // Tiles are decoded on load, so this never fails
     int linearIndex = GetLinearPosition( x, y );
-    return GetSimType( m_image.at( linearIndex ), simTypeOut, powerOut );
+    simTypeOut = m_topology->GetType( linearIndex );
+    powerOut = (SimPower)m_power.Get( linearIndex );
+    return true;
 }
 
-bool WireSim::SaveState( const char* pngOutFileName, int pixelSize, bool highlightEdgeChanges )
+const std::shared_ptr< const SimTopology >& WireSim::GetTopology() const
 {
-    // Convert from ARGB to RGBA
-    std::vector< unsigned char > outImage;
-    outImage.resize( m_width * m_height * pixelSize * pixelSize * 4 );
+    return m_topology;
+}
+
+std::shared_ptr< const SimSnapshot > WireSim::Snapshot()
+{
+    if( m_engine )
+    {
+        m_engine->Flush( *m_topology, m_power );
+    }
     
-    for( int y = 0; y < m_height; y++ )
+    // Chunks written back to what the base held are shared with it again, here too, so the next
+    // snapshot finds them unchanged without comparing them
+    m_baseSnapshot.reset( new SimSnapshot( m_topology, m_power, m_stepCount, m_baseSnapshot.get() ) );
+    m_baseSnapshot->CopyTo( m_power );
+    return m_baseSnapshot;
+}
+
+WireSim* WireSim::Fork()
+{
+    return new WireSim( Snapshot() );
+}
+
+bool WireSim::SaveState( const char* pngOutFileName, int pixelSize, bool highlightEdgeChanges, SaveProfile profile )
+{
+    if( m_engine )
     {
-        for( int x = 0; x < m_width; x++ )
-        {
-            // Grab the power type
-            SimType simType = cSimType_None;
-            SimPower simPower = cSimPower_LowEdge;
-            GetSimType( x, y, simType, simPower );
-
-            // Grab color state directly from image buffer
-            int r = ( ( cSimColors[ simType ][ simPower ] & 0x00ff0000 ) >> 16 );
-            int g = ( ( cSimColors[ simType ][ simPower ] & 0x0000ff00 ) >> 8 );
-            int b = (   cSimColors[ simType ][ simPower ] & 0x000000ff );
-            int a = ( 0xFF );
-            
-            for( int dy = 0; dy < pixelSize; dy++ )
-            {
-                for( int dx = 0; dx < pixelSize; dx++ )
-                {
-                    bool drawEdge = highlightEdgeChanges &&
-                                    //( simType != cSimType_None ) &&
-                                    ( simPower == cSimPower_RisingEdge || simPower == cSimPower_FallingEdge ) &&
-                                    ( dx == 0 || dx == ( pixelSize - 1 ) || dy == 0 || dy == ( pixelSize - 1 ) );
-
-                    int index = ( y * pixelSize + dy ) * m_width * pixelSize * 4 + ( x * pixelSize + dx ) * 4;
-                    outImage.at( index + 0 ) = drawEdge ? 0x00 : r;
-                    outImage.at( index + 1 ) = drawEdge ? 0x00 : g;
-                    outImage.at( index + 2 ) = drawEdge ? 0x00 : b;
-                    outImage.at( index + 3 ) = a;
-                }
-            }
-        }
+        m_engine->Flush( *m_topology, m_power );
     }
     
-    // Write out
-    unsigned int error = lodepng::encode( pngOutFileName, outImage, m_width * pixelSize, m_height * pixelSize );
-    if( error != 0 )
+    // A single frame has all cores to itself
+    std::vector< unsigned char > pngData;
+    int threadCount = std::max( 1, (int)std::thread::hardware_concurrency() );
+    if( !EncodeState( *m_topology, m_power, pixelSize, highlightEdgeChanges, pngData, profile, threadCount ) )
     {
         printf( "Error encoding\n" );
         return false;
     }
     
+    // Write out
+    if( lodepng_save_file( &pngData[ 0 ], pngData.size(), pngOutFileName ) != 0 )
+    {
+        printf( "Error writing \"%s\"\n", pngOutFileName );
+        return false;
+    }
+    
     return true;
 }
 
-inline bool WireSim::IsBounded( int x, int y ) const
+void WireSim::SaveState( SimFrameWriter& frameWriter, const char* pngOutFileName, int pixelSize, bool highlightEdgeChanges, SaveProfile profile )
 {
-    if( x < 0 || y < 0 || x >= m_width || y >= m_height )
+    if( m_engine )
+    {
+        m_engine->Flush( *m_topology, m_power );
+    }
+    
+    frameWriter.Write( m_topology, m_power, pngOutFileName, pixelSize, highlightEdgeChanges, profile );
+}
+
+bool WireSim::SaveCheckpoint( const char* fileName )
+{
+    if( m_engine )
+    {
+        m_engine->Flush( *m_topology, m_power );
+    }
+    
+    return SimCheckpoint::Save( fileName, *m_topology, m_power, m_stepCount );
+}
+
+bool WireSim::LoadCheckpoint( const char* fileName )
+{
+    SimPowerPlane power;
+    int64_t stepCount = 0;
+    if( !SimCheckpoint::Load( fileName, *m_topology, power, stepCount ) )
     {
         return false;
     }
-    else
+    
+    m_power.Swap( power );
+    m_stepCount = stepCount;
+    
+    // Nothing cached from the old state is valid any more
+    if( m_engine )
     {
-        return true;
+        m_engine->Reset( *m_topology, m_power );
+    }
+    if( m_cycleDetector )
+    {
+        m_cycleDetector->Reset( m_power );
+        m_cycleFirstStep = m_stepCount;
+    }
+    if( m_history )
+    {
+        m_history->Reset( m_power, m_stepCount );
     }
+    m_baseSnapshot.reset();
+    
+    return true;
 }
 
-inline int WireSim::GetLinearPosition( int x, int y ) const
+bool WireSim::CompileCircuit( const char* pngFileName, const char* compiledFileName )
 {
-    return y * m_width + x;
+    SimTopology topology( pngFileName );
+    if( topology.GetTileCount() == 0 )
+    {
+        return false;
+    }
+    
+    return SimCompiledCircuit::Save( compiledFileName, topology );
 }
 
-void WireSim::Update( int x, int y, const std::vector< SimColor >& source, std::vector< SimColor >& dest )
+void WireSim::PrepareBackPower()
 {
-    // Get the 3x3 grid centered on the target
-    SimType nodeGrid[ 3 ][ 3 ] = {
-        { cSimType_None, cSimType_None, cSimType_None },
-        { cSimType_None, cSimType_None, cSimType_None },
-        { cSimType_None, cSimType_None, cSimType_None },
-    };
+    // Shares every chunk to begin with; the kernel only copies those it changes
+    if( m_backPower.GetTileCount() != m_power.GetTileCount() )
+    {
+        m_backPower = m_power;
+    }
+}
+
+SimChangeList* WireSim::GetStepChanges()
+{
+    if( !m_cycleDetector && !m_history )
+    {
+        return NULL;
+    }
     
-    // Get the 3x3 power levels
-    SimPower powerGrid[ 3 ][ 3 ] = {
-        { cSimPower_LowEdge, cSimPower_LowEdge, cSimPower_LowEdge },
-        { cSimPower_LowEdge, cSimPower_LowEdge, cSimPower_LowEdge },
-        { cSimPower_LowEdge, cSimPower_LowEdge, cSimPower_LowEdge },
-    };
+    m_stepChanges.Clear();
+    return &m_stepChanges;
+}
+
+void WireSim::RecordState()
+{
+    if( m_cycleDetector )
+    {
+        m_cycleDetector->Record( m_stepChanges );
+    }
+    if( m_history )
+    {
+        m_history->Record( m_power, m_stepChanges );
+    }
+}
+
+bool WireSim::EncodeState( const SimTopology& topology, const SimPowerPlane& power, int pixelSize, bool highlightEdgeChanges, std::vector< unsigned char >& pngOut, SaveProfile profile, int threadCount )
+{
+    int width = topology.GetWidth();
+    int height = topology.GetHeight();
+    
+    // Pixels are addressed with int coordinates, and the image is packed in memory as a whole
+    // (at most 8 bits per pixel)
+    int64_t outWidth = (int64_t)width * pixelSize;
+    int64_t outHeight = (int64_t)height * pixelSize;
+    if( pixelSize <= 0 || outWidth > INT_MAX || outHeight > INT_MAX || (uint64_t)( outWidth * outHeight ) > SIZE_MAX / 8 )
+    {
+        printf( "Cannot encode %d x %d tiles at %d pixels per tile\n", width, height, pixelSize );
+        return false;
+    }
     
-    for( int dx = -1; dx <= 1; dx++ )
+    // There are only a few dozen tile colors, so instead of expanding every pixel to RGBA, tiles
+    // are mapped to palette entries; first find the colors in use
+    const int cColorCount = cSimTypeCount * cSimPowerCount;
+    std::vector< uint8_t > tileColors( (size_t)width * height );
+    bool isColorUsed[ cColorCount ] = { false };
+    
+    for( int y = 0; y < height; y++ )
     {
-        for( int dy = -1; dy <= 1; dy++ )
+        for( int x = 0; x < width; x++ )
         {
-            if( IsBounded( x + dx, y + dy ) )
-            {
-                GetSimType( x + dx, y + dy, nodeGrid[ dx + 1 ][ dy + 1 ], powerGrid[ dx + 1 ][ dy + 1 ] );
-            }
+            int index = topology.GetIndex( x, y );
+            int color = topology.GetType( index ) * cSimPowerCount + power.Get( index );
+            tileColors[ (size_t)y * width + x ] = (uint8_t)color;
+            isColorUsed[ color ] = true;
         }
     }
     
-    // Alias for tile we're simulating
-    const SimType& centerType = nodeGrid[ 1 ][ 1 ];
-    SimPower centerPower = powerGrid[ 1 ][ 1 ];
+    // Tiles of the same color share an entry; black for edge outlines comes last. Outlined tiles
+    // smaller than 3x3 pixels are all outline, so their own color is never drawn
+    std::vector< SimColor > palette;
+    uint8_t paletteIndices[ cColorCount ] = { 0 };
+    bool hasEdges = false;
+    for( int i = 0; i < cColorCount; i++ )
+    {
+        bool isOutlined = highlightEdgeChanges && SimKernel::IsEdge( SimPower( i % cSimPowerCount ) );
+        if( !isColorUsed[ i ] || ( isOutlined && pixelSize <= 2 ) )
+        {
+            hasEdges = hasEdges || ( isColorUsed[ i ] && isOutlined );
+            continue;
+        }
+        
+        SimColor simColor = MakeSimColor( SimType( i / cSimPowerCount ), SimPower( i % cSimPowerCount ) );
+        size_t entry = std::find( palette.begin(), palette.end(), simColor ) - palette.begin();
+        if( entry == palette.size() )
+        {
+            palette.push_back( simColor );
+        }
+        
+        paletteIndices[ i ] = (uint8_t)entry;
+        hasEdges = hasEdges || isOutlined;
+    }
     
-    // Ignore if undefined simulation tile
-    if( centerType == cSimType_None )
+    uint8_t edgeIndex = (uint8_t)palette.size();
+    if( hasEdges )
     {
-        return;
+        palette.push_back( 0x00000000 );
     }
     
-    // Settle the power state on this node
-    bool powerChanged = false;
-    if( centerPower == cSimPower_RisingEdge )
+    // 1, 2, 4 or 8 bits per pixel
+    int bitDepth = 1;
+    while( ( 1 << bitDepth ) < (int)palette.size() )
     {
-        powerChanged = true;
-        centerPower = cSimPower_HighEdge;
-        SetSimType( dest, x, y, centerType, cSimPower_HighEdge );
+        bitDepth *= 2;
     }
-    else if( centerPower == cSimPower_FallingEdge )
+    
+    lodepng::State state;
+    state.encoder.auto_convert = LAC_NO;
+    state.encoder.zlibsettings.threadcount = threadCount;
+    
+    // Rows are palette indices, which lodepng never filters, so all that changes is the deflate search
+    LodePNGCompressSettings& zlibSettings = state.encoder.zlibsettings;
+    switch( profile )
     {
-        powerChanged = true;
-        centerPower = cSimPower_LowEdge;
-        SetSimType( dest, x, y, centerType, cSimPower_LowEdge );
+        case cSaveProfile_Store:
+            zlibSettings.btype = 0;
+            break;
+        
+        case cSaveProfile_Fast:
+            zlibSettings.fastmatching = 1;
+            zlibSettings.windowsize = 4096;
+            break;
+        
+        case cSaveProfile_Max:
+            zlibSettings.windowsize = 32768;
+            zlibSettings.nicematch = 258;
+            break;
+        
+        default:
+            break;
     }
     
-    // Check with type
-    switch( centerType )
+    state.info_raw.colortype = LCT_PALETTE;
+    state.info_raw.bitdepth = bitDepth;
+    state.info_png.color.colortype = LCT_PALETTE;
+    state.info_png.color.bitdepth = bitDepth;
+    for( size_t i = 0; i < palette.size(); i++ )
+    {
+        int r = ( ( palette[ i ] & 0x00ff0000 ) >> 16 );
+        int g = ( ( palette[ i ] & 0x0000ff00 ) >> 8 );
+        int b = (   palette[ i ] & 0x000000ff );
+        lodepng_palette_add( &state.info_raw, r, g, b, 0xFF );
+        lodepng_palette_add( &state.info_png.color, r, g, b, 0xFF );
+    }
+    
+    // Pack indices, most significant bits first; rows of the raw image are not padded to whole bytes
+    std::vector< unsigned char > outImage( ( (size_t)outWidth * (size_t)outHeight * bitDepth + 7 ) / 8, 0 );
+    std::vector< uint8_t > rowIndices( (size_t)outWidth );
+    size_t bitOffset = 0;
+    
+    for( int y = 0; y < height; y++ )
     {
-        // Wire spreads directly adjacent to no-power nodes if they are
-        // the same wire type or a joint
-        case cSimType_WireType0:
-        case cSimType_WireType1:
+        for( int dy = 0; dy < pixelSize; dy++ )
+        {
+            for( int x = 0; x < width; x++ )
             {
-                // Only propogate on edge-change
-                if( powerChanged )
+                int color = tileColors[ (size_t)y * width + x ];
+                bool isEdgeTile = hasEdges && SimKernel::IsEdge( SimPower( color % cSimPowerCount ) );
+                
+                for( int dx = 0; dx < pixelSize; dx++ )
                 {
-                    // For each directly-adjacent element..
-                    for( int i = 0; i < cDirectlyAdjacentOffsetCount; i++ )
-                    {
-                        const Vec2& adjacentOffset = cDirectlyAdjacentOffsets[ i ];
-                        const SimPower& adjPower = powerGrid[ adjacentOffset.x ][ adjacentOffset.y ];
-                        const SimType& adjType = nodeGrid[ adjacentOffset.x ][ adjacentOffset.y ];
-                    
-                        // Only spread to other directly-connected same-type wires
-                        if( IsWire( adjType ) && IsSettled( adjPower ) && centerPower != adjPower  )
-                        {
-                            SetSimType( dest, x + adjacentOffset.x - 1, y + adjacentOffset.y - 1, adjType, ( centerPower == cSimPower_HighEdge ) ? cSimPower_RisingEdge : cSimPower_FallingEdge );
-                        }
-                    }
+                    bool drawEdge = isEdgeTile && ( dx == 0 || dx == ( pixelSize - 1 ) || dy == 0 || dy == ( pixelSize - 1 ) );
+                    rowIndices[ (size_t)x * pixelSize + dx ] = drawEdge ? edgeIndex : paletteIndices[ color ];
                 }
             }
             
-            break;
-            
-        case cSimType_JumpJoint:
-        case cSimType_NotGate:
+            if( bitDepth == 8 )
             {
-                // Not-gates are and jump-gates are the only directional gates that only move either
-                // top-down/left-right OR down-top/right-left based on their off/on state, e.g. a light purple means it is on,
-                // which means it is a not-gate that operates down-top/right-left, while a dark brown means it is off, so the gate
-                // operators on top-down/left-right. Also note that state-transfer only happens on settled inputs and outputs
-                int powerOffset = ( centerPower == cSimPower_LowEdge ) ? 2 : 0;
-                for( int i = 0; i < 2; i++ )
-                {
-                    int sourceIndex = powerOffset + i;
-                    const Vec2& sourceOffset = cDirectlyAdjacentOffsets[ sourceIndex ];
-
-                    // Get input details
-                    const SimPower& sourcePower = powerGrid[ sourceOffset.x ][ sourceOffset.y ];
-                    const SimType& sourceType = nodeGrid[ sourceOffset.x ][ sourceOffset.y ];
-
-                    // Save input state; ignore if not settled
-                    SimPower resultPower = sourcePower;
-                    if( !IsWire( sourceType ) || !IsSettled( sourcePower ) )
-                    {
-                        continue;
-                    }
-
-                    // Flip if not-gate
-                    if( centerType == cSimType_NotGate )
-                    {
-                        resultPower = ( resultPower == cSimPower_LowEdge ) ? cSimPower_HighEdge : cSimPower_LowEdge;
-                    }
-
-                    // Only apply onto directly opposite edges
-                    const Vec2& outputPos = cDirectlyAdjacentOffsets[ ( sourceIndex + 2 ) % cDirectlyAdjacentOffsetCount ];
-                    
-                    // Get type and power
-                    const SimType& outputType = nodeGrid[ outputPos.x ][ outputPos.y ];
-                    const SimPower& outputPower = powerGrid[ outputPos.x ][ outputPos.y ];
-                    
-                    // Set output state only if there is a difference
-                    if( IsWire( outputType ) && IsSettled( outputPower ) && outputPower != resultPower )
-                    {
-                        SimPower newEdgePower = ( resultPower == cSimPower_LowEdge ) ? cSimPower_FallingEdge : cSimPower_RisingEdge;
-                        SetSimType( dest, x + outputPos.x - 1, y + outputPos.y - 1, outputType, newEdgePower );
-                    }
-                }
+                std::copy( rowIndices.begin(), rowIndices.end(), outImage.begin() + bitOffset / 8 );
+                bitOffset += (size_t)outWidth * 8;
             }
-            break;
-
-        case cSimType_AndGate:
-        case cSimType_OrGate:
-        case cSimType_XorGate:
+            else
             {
-                // Total on and off; we ignore non-wire corner tiles
-                int onCount = 0;
-                int offCount = 0;
-                
-                // For each input (corner wires)
-                for( int i = 0; i < cCornerOffsetCount; i++ )
-                {
-                    const Vec2& inputPos = cCornerOffsets[ i ];
-                    
-                    // Get type and power
-                    const SimType& inputType = nodeGrid[ inputPos.x ][ inputPos.y ];
-                    const SimPower& inputPower = powerGrid[ inputPos.x ][ inputPos.y ];
-                    
-                    // Save input state
-                    if( IsWire( inputType ) && IsSettled( inputPower ) )
-                    {
-                        onCount += ( inputPower == cSimPower_HighEdge ) ? 1 : 0;
-                        offCount += ( inputPower == cSimPower_LowEdge ) ? 1 : 0;
-                    }
-                }
-                
-                
-                // Compute and place result; break out
-                SimPower resultPower = cSimPower_LowEdge;
-                
-                if( centerType == cSimType_AndGate && onCount >= 2 && offCount <= 0 )
-                {
-                    resultPower = cSimPower_HighEdge;
-                }
-                else if( centerType == cSimType_OrGate && onCount >= 1 && offCount > 0 )
-                {
-                    resultPower = cSimPower_HighEdge;
-                }
-                else if( centerType == cSimType_XorGate && onCount == 1 && offCount > 0 )
+                for( size_t i = 0; i < rowIndices.size(); i++ )
                 {
-                    resultPower = cSimPower_HighEdge;
-                }
-                
-                // Only apply the edge on settled states
-                for( int i = 0; i < cDirectlyAdjacentOffsetCount; i++ )
-                {
-                    const Vec2& outputPos = cDirectlyAdjacentOffsets[ i ];
-                    
-                    // Get type and power
-                    const SimType& outputType = nodeGrid[ outputPos.x ][ outputPos.y ];
-                    const SimPower& outputPower = powerGrid[ outputPos.x ][ outputPos.y ];
-                    
-                    // Set input state only if there is a state change
-                    if( IsWire( outputType ) && IsSettled( outputPower ) && outputPower != resultPower )
-                    {
-                        SetSimType( dest, x + outputPos.x - 1, y + outputPos.y - 1, outputType, ( outputPower == cSimPower_HighEdge ) ? cSimPower_RisingEdge : cSimPower_FallingEdge );
-                    }
+                    outImage[ bitOffset / 8 ] |= (unsigned char)( rowIndices[ i ] << ( 8 - bitDepth - ( bitOffset % 8 ) ) );
+                    bitOffset += bitDepth;
                 }
             }
-            
-            break;
-            
-            // Ignore these cases
-        case cSimType_None:
-        default:
-            break;
+        }
+    }
+    
+    return ( lodepng::encode( pngOut, outImage, (unsigned)outWidth, (unsigned)outHeight, state ) == 0 );
+}
+
+inline bool WireSim::IsBounded( int x, int y ) const
+{
+    if( x < 0 || y < 0 || x >= m_width || y >= m_height )
+    {
+        return false;
+    }
+    else
+    {
+        return true;
     }
 }
 
-void WireSim::SetSimType( std::vector< SimColor >& dstImage, int x, int y, const SimType& simType, SimPower powerLevel )
+inline int WireSim::GetLinearPosition( int x, int y ) const
+{
+    return m_topology->GetIndex( x, y );
+}
+
+void WireSim::SetSimPower( SimPowerPlane& dstPower, int x, int y, SimPower powerLevel )
 {
     int linearIndex = GetLinearPosition( x, y );
-    dstImage.at( linearIndex ) = MakeSimColor( simType, powerLevel );
+    dstPower.Set( linearIndex, powerLevel );
 }
 
 WireSim::SimColor WireSim::MakeSimColor( const SimType& simType, SimPower powerLevel )
@@ -34,14 +34,34 @@
 #define __WIRESIM_H__
 
 #include <vector>
+#include <memory>
 #include <stdint.h>
 
+#include "SimChangeList.h"
+#include "SimPowerPlane.h"
+
+class SimCycleDetector;
+class SimEngine;
+class SimFrameWriter;
+class SimHistory;
+class SimSnapshot;
+class SimTopology;
+
 class WireSim
 {
     
 public:
     
-    WireSim( const char* pngFileName );
+    // Load a circuit from a PNG, or from a compiled circuit (see CompileCircuit)
+    WireSim( const char* fileName );
+    
+    // Start a new simulation of an already-loaded circuit; the topology is shared, not copied
+    WireSim( const std::shared_ptr< const SimTopology >& topology );
+    
+    // Continue a simulation from a snapshot (see Snapshot), without an engine or cycle detection;
+    // the power plane shares every chunk of the snapshot until written
+    WireSim( const std::shared_ptr< const SimSnapshot >& snapshot );
+    
     ~WireSim();
     
     // All types
@@ -87,34 +107,134 @@ public:
     // Full simulation step; returns true if any pixel has changed state
     bool Update();
     
+    // Advance the given number of steps; the result is the same as calling Update that many
+    // times, and so is the return value (of the last step). Without an engine, several steps
+    // are computed on one cache-sized band of rows before moving on to the next band
+    bool Update( int steps );
+    
+    // Number of steps taken since the circuit was loaded
+    int64_t GetStepCount() const;
+    
+    // How Eval ended
+    enum EvalStatus
+    {
+        cEvalStatus_Settled,    // The last step changed nothing
+        cEvalStatus_StepLimit,  // Still changing after the maximum number of steps
+        cEvalStatus_TimeLimit,  // Still changing when the time budget ran out
+        cEvalStatus_Cycle,      // Entered a cycle of states (see SetCycleDetection), so will never settle
+    };
+    
+    // Step until a step changes nothing, like calling Update until it returns false, but without
+    // returning to the caller in between; gives up after maxSteps steps or timeBudget seconds
+    // (zero for no time limit), or once a cycle is found. Returns the number of steps taken,
+    // including the last one
+    int Eval( int maxSteps, double timeBudget, EvalStatus& statusOut );
+    
+    // Step with the given engine instead of the per-pixel kernel (see SimEngine.h); the simulation
+    // takes ownership of the engine. Pass NULL to go back to the per-pixel kernel
+    void SetEngine( SimEngine* engine );
+    SimEngine* GetEngine() const;
+    
+    // Watch for the simulation repeating itself (see SimCycleDetector); every step from here on is
+    // recorded, from the tiles it changed. Changing an input starts over from the new state,
+    // dropping any cycle found before
+    void SetCycleDetection( bool isEnabled );
+    
+    // Returns true once states started to repeat: the state at startStep (see GetStepCount) comes
+    // back every period steps, for as long as inputs are left alone
+    bool GetCycle( int& periodOut, int64_t& startStepOut ) const;
+    
+    // Record every step from here on (see SimHistory), so earlier states can be brought back
+    void SetHistoryRecording( bool isEnabled );
+    
+    // Steps recorded so far; NULL if not recording
+    const SimHistory* GetHistory() const;
+    
+    // Go back to a recorded step (see GetStepCount), dropping the history after it; returns false
+    // if the step was not recorded
+    bool RestoreStep( int64_t step );
+    
+    // How much time saving spends on compression; every profile writes a standard PNG
+    enum SaveProfile
+    {
+        cSaveProfile_Store,     // No compression at all; written at memory speed, but large
+        cSaveProfile_Fast,      // Greedy matching of runs and one earlier match per position
+        cSaveProfile_Default,   // Default lodepng settings
+        cSaveProfile_Max,       // Full 32 KB window search; several times slower, smallest files
+    };
+    
     // Save the current state of the PNG to the given filename; returns true on success, false on failure
     // If highlightEdgeChanges is set to true, then we draw a box outline on any edge-rise or edge-fall tiles
-    bool SaveState( const char* pngOutFileName, int pixelSize = 1, bool highlightEdgeChanges = false );
+    // The image is written palette-indexed, with as few bits per pixel as the colors in use allow
+    bool SaveState( const char* pngOutFileName, int pixelSize = 1, bool highlightEdgeChanges = false, SaveProfile profile = cSaveProfile_Default );
+    
+    // Same, but only hands a copy of the current state to the given writer, which encodes and
+    // writes it in the background (see SimFrameWriter); failures are reported by its Flush
+    void SaveState( SimFrameWriter& frameWriter, const char* pngOutFileName, int pixelSize = 1, bool highlightEdgeChanges = false, SaveProfile profile = cSaveProfile_Default );
+    
+    // Encode power states of the given circuit as SaveState would; returns true on success
+    // Large images are deflated in pieces on up to threadCount threads (SaveState uses all cores)
+    static bool EncodeState( const SimTopology& topology, const SimPowerPlane& power, int pixelSize, bool highlightEdgeChanges, std::vector< unsigned char >& pngOut, SaveProfile profile = cSaveProfile_Default, int threadCount = 1 );
+    
+    // Dump the current state (power of every tile, pins included, and the step count) to a binary
+    // file, or restore one saved from the same image (see SimCheckpoint); far faster than going
+    // through SaveState and reloading the PNG. Returns true on success, false on failure
+    bool SaveCheckpoint( const char* fileName );
+    bool LoadCheckpoint( const char* fileName );
+    
+    // Convert a circuit image to a compiled circuit (see SimCompiledCircuit), which any WireSim
+    // constructor taking a file name loads without decoding; returns true on success, false on failure
+    static bool CompileCircuit( const char* pngFileName, const char* compiledFileName );
     
     // Color type; ARGB format
     typedef uint32_t SimColor;
     
+    // Get type and power value of the given color; power is added to each color component
+    // Returns true if found, else returns false
+    static bool GetSimType( const SimColor& givenColor, SimType& simTypeOut, SimPower& powerOut );
+    
+    // Immutable circuit description (tile types and pins); can be handed to other simulations
+    const std::shared_ptr< const SimTopology >& GetTopology() const;
+    
+    // Freeze the current state (see SimSnapshot); every chunk that did not change since the
+    // snapshot this simulation started from, or since its last snapshot, is shared with that one.
+    // Chunks a step never wrote are still shared with it, so only the written ones are compared
+    std::shared_ptr< const SimSnapshot > Snapshot();
+    
+    // Branch off a new simulation at the current state; the caller owns it. Same as constructing
+    // one from a new snapshot. The fork steps on the snapshot's chunks, copying each the first
+    // time a step or SetInput changes it; the per-pixel kernel keeps its back buffer the same
+    // way. So a branch costs memory for the chunks it changed, not for a full plane. Engines may
+    // keep their own buffers (see SetEngine)
+    WireSim* Fork();
+    
 protected:
     
     // Bounds check
     inline bool IsBounded( int x, int y ) const;
     
-    // Convert 2D position to linear index; top-left is origin (0,0), grows X+ to the right, Y+ down
+    // Convert 2D position to tile index (see SimTopology::GetIndex); top-left is origin (0,0), grows X+ to the right, Y+ down
     inline int GetLinearPosition( int x, int y ) const;
     
-    // Simulate a single pixel
-    void Update( int x, int y, const std::vector< SimColor >& source, std::vector< SimColor >& dest );
-    
-    // Get type and power value of the given color; power is added to each color component
-    // Returns true if found, else returns false
-    bool GetSimType( const SimColor& givenColor, SimType& simTypeOut, SimPower& powerOut ) const;
+    // Get type and power value of the given tile
     bool GetSimType( int x, int y, SimType& simTypeOut, SimPower& powerOut ) const;
     
-    // Set the simtype or power into the given buffer using linear indexing
-    void SetSimType( std::vector< SimColor >& dstImage, int x, int y, const SimType& simType, SimPower powerLevel );
+    // Set the power into the given buffer; tile types never change
+    void SetSimPower( SimPowerPlane& dstPower, int x, int y, SimPower powerLevel );
     
     // Create color with the appropriate tint (based on power level)
-    SimColor MakeSimColor( const SimType& simType, SimPower powerLevel );
+    static SimColor MakeSimColor( const SimType& simType, SimPower powerLevel );
+    
+    // Size the back buffer before the per-pixel kernel first steps into it
+    void PrepareBackPower();
+    
+    // Empty change list for the next step to fill in (see SimChangeList); NULL if neither cycle
+    // detection nor history look at steps
+    SimChangeList* GetStepChanges();
+    
+    // Pass the state reached by a step, and the changes it listed, on to cycle detection and
+    // history, if enabled
+    void RecordState();
     
     // Fast inline filters
     inline bool IsEdge( const SimPower& simPower ) const;
@@ -127,12 +247,37 @@ private:
     // Size of image
     int m_width, m_height;
     
-    // List of input / outpout indices (wire pixels in the left and right column even-rows)
-    std::vector< int > m_inputIndices;
-    std::vector< int> m_outputIndices;
+    // Tile types and pins; never written to once loaded
+    std::shared_ptr< const SimTopology > m_topology;
+    
+    // Current power states, two bits per tile; colors are only rebuilt when saving
+    SimPowerPlane m_power;
+    
+    // Next power states; written by every step of the per-pixel kernel, then swapped with the
+    // current states. Only allocated once that kernel first steps, engines never need it
+    SimPowerPlane m_backPower;
+    
+    // Steps taken so far
+    int64_t m_stepCount;
+    
+    // Intermediate steps of a band in Update( steps )
+    SimPowerPlane m_blockPower[ 2 ];
+    
+    // Optional replacement for the per-pixel kernel
+    std::unique_ptr< SimEngine > m_engine;
+    
+    // Optional, see SetCycleDetection; and the step it last started over at (its step zero)
+    std::unique_ptr< SimCycleDetector > m_cycleDetector;
+    int64_t m_cycleFirstStep;
+    
+    // Tiles changed by the last step, listed while cycle detection or history are enabled
+    SimChangeList m_stepChanges;
+    
+    // Optional, see SetHistoryRecording
+    std::unique_ptr< SimHistory > m_history;
     
-    // Current colors / states
-    std::vector< SimColor > m_image;
+    // Last snapshot taken, or the one this simulation started from; new snapshots share chunks with it
+    std::shared_ptr< const SimSnapshot > m_baseSnapshot;
     
 };
 
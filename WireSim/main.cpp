@@ -40,16 +40,27 @@
 ***/
 
 #include <stdio.h>
+#include <string.h>
 
+#include "SimFrameWriter.h"
+#include "SimTests.h"
 #include "WireSim.h"
 
-// Main application entry point
-int main()
+// Main application entry point; "test" runs the self-tests instead (see SimTests)
+int main( int argc, char** argv )
 {
+    if( argc > 1 && strcmp( argv[ 1 ], "test" ) == 0 )
+    {
+        return SimTests::Run();
+    }
+    
     // Simulation cycle count
     const int cMaxSimulationCount = 1000;
     const int cPixelSize = 8;
     
+    // Frames are only looked at while debugging, so trade some file size for encoding speed
+    const WireSim::SaveProfile cSaveProfile = WireSim::cSaveProfile_Fast;
+    
     // All circuits to simulate
     const int cPngFileNameCount = 1;//14;
     const char* cPngFileNames[ cPngFileNameCount ] =
@@ -70,18 +81,26 @@ int main()
         //"Circuit_2To4Decoder_v3.png",
     };
     
+    // Frames are encoded and written in the background while simulating, by one encoder per
+    // hardware thread; every frame has its own file, so they need not land in order
+    const size_t cMaxFrameByteCount = 512 * 1024 * 1024;
+    SimFrameWriter frameWriter( 0, 64, cMaxFrameByteCount, false );
+    
     for( int i = 0; i < cPngFileNameCount; i++ )
     {
         printf( "Starting simulations for \"%s\":\n", cPngFileNames[ i ] );
         
         WireSim wireSim( cPngFileNames[ i ] );
         
+        // Circuits with feedback never settle; stop once they start repeating instead
+        wireSim.SetCycleDetection( true );
+        
         // File name buffer
         char fileName[ 512 ];
         
         // Initial state
         sprintf( fileName, "%s_000.output.png", cPngFileNames[ i ] );
-        wireSim.SaveState( fileName, cPixelSize );
+        wireSim.SaveState( frameWriter, fileName, cPixelSize, false, cSaveProfile );
         
         for( int j = 1; j < cMaxSimulationCount; j++ )
         {
@@ -95,7 +114,7 @@ int main()
             
             sprintf( fileName, "%s_%03d.output.png", cPngFileNames[ i ], j );
             fflush( stdout );
-            wireSim.SaveState( fileName, cPixelSize, true );
+            wireSim.SaveState( frameWriter, fileName, cPixelSize, true, cSaveProfile );
             
             printf( " %0.1f%%", 100.0f * ( float(j + 1) / float( cMaxSimulationCount ) ) );
             
@@ -103,10 +122,24 @@ int main()
             {
                 break;
             }
+            
+            int cyclePeriod = 0;
+            int64_t cycleStart = 0;
+            if( wireSim.GetCycle( cyclePeriod, cycleStart ) )
+            {
+                printf( "\n Entered a cycle of period %d at step %lld", cyclePeriod, (long long)cycleStart );
+                break;
+            }
         }
         
+        frameWriter.Flush();
         printf( " Done!\n" );
     }
+    
+    SimFrameWriter::Metrics metrics = frameWriter.GetMetrics();
+    printf( "Wrote %d frames on %d threads: %0.2f ms encoding per frame (at most %0.2f ms), %0.1f frames in flight on average (at most %d, %0.1f MB), %0.2f s waited on encoders\n",
+        metrics.frameCount, frameWriter.GetThreadCount(), metrics.averageEncodeTime * 1000.0, metrics.maxEncodeTime * 1000.0,
+        metrics.averageQueueDepth, metrics.maxQueueDepth, metrics.peakByteCount / ( 1024.0 * 1024.0 ), metrics.waitTime );
         
     return 0;
 }
@@ -34,7 +34,10 @@
 #include <stdlib.h>
 
 #ifdef LODEPNG_COMPILE_CPP
+#include <atomic>
 #include <fstream>
+#include <thread>
+#include <vector>
 #endif /*LODEPNG_COMPILE_CPP*/
 
 #define VERSION_STRING "20140609"
@@ -316,6 +319,57 @@ static void string_set(char** out, const char* in)
 
 /* ////////////////////////////////////////////////////////////////////////// */
 
+#if defined(LODEPNG_COMPILE_ENCODER) || defined(LODEPNG_COMPILE_DECODER)
+/*the least amount of data (deflated, inflated or unfiltered) worth a thread of its own*/
+#define PARALLEL_PIECE_SIZE 262144
+
+#ifdef LODEPNG_COMPILE_CPP
+static void runParallelTasks(void (*task)(void*, size_t), void* context, size_t count, std::atomic<size_t>* next)
+{
+    for(;;)
+    {
+        size_t i = (*next)++;
+        if(i >= count) break;
+        task(context, i);
+    }
+}
+#endif /*LODEPNG_COMPILE_CPP*/
+
+/*
+ Calls task(context, i) for every i in 0..count-1, on up to threadcount threads (including the calling
+ one), in no particular order. In C, or if no more threads can be started, the rest is done on the
+ calling thread.
+ */
+static void runParallel(void (*task)(void*, size_t), void* context, size_t count, unsigned threadcount)
+{
+#ifdef LODEPNG_COMPILE_CPP
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    size_t i;
+    try
+    {
+        threads.reserve(threadcount < count ? threadcount : count);
+        for(i = 1; i < threadcount && i < count; i++)
+        {
+            threads.push_back(std::thread(runParallelTasks, task, context, count, &next));
+        }
+    }
+    catch(...)
+    {
+        /*fewer threads*/
+    }
+    runParallelTasks(task, context, count, &next);
+    for(i = 0; i < threads.size(); i++) threads[i].join();
+#else /*LODEPNG_COMPILE_CPP*/
+    size_t i;
+    (void)threadcount;
+    for(i = 0; i < count; i++) task(context, i);
+#endif /*LODEPNG_COMPILE_CPP*/
+}
+#endif /*defined(LODEPNG_COMPILE_ENCODER) || defined(LODEPNG_COMPILE_DECODER)*/
+
+/* ////////////////////////////////////////////////////////////////////////// */
+
 unsigned lodepng_read32bitInt(const unsigned char* buffer)
 {
     return (buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
@@ -1213,30 +1267,32 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
     return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings)
+/*
+ inflates blocks until the final one, or until a block ends at or after byte inend, whichever comes first;
+ BFINAL tells which one it was, and bp (in bits) where the last block ended. Blocks may read up to insize.
+ */
+static unsigned inflateBlocks(ucvector* out, const unsigned char* in, size_t insize, size_t inend,
+                              size_t* bp, unsigned* BFINAL)
 {
-    /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
-    size_t bp = 0;
-    unsigned BFINAL = 0;
+    /*bp: bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
     size_t pos = 0; /*byte position in the out buffer*/
     
     unsigned error = 0;
     
-    (void)settings;
+    *bp = 0;
+    *BFINAL = 0;
     
-    while(!BFINAL)
+    while(!(*BFINAL) && *bp < inend * 8)
     {
         unsigned BTYPE;
-        if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
-        BFINAL = readBitFromStream(&bp, in);
-        BTYPE = 1 * readBitFromStream(&bp, in);
-        BTYPE += 2 * readBitFromStream(&bp, in);
+        if(*bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
+        *BFINAL = readBitFromStream(bp, in);
+        BTYPE = 1 * readBitFromStream(bp, in);
+        BTYPE += 2 * readBitFromStream(bp, in);
         
         if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-        else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-        else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+        else if(BTYPE == 0) error = inflateNoCompression(out, in, bp, &pos, insize); /*no compression*/
+        else error = inflateHuffmanBlock(out, in, bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
         
         if(error) return error;
     }
@@ -1247,6 +1303,22 @@ static unsigned lodepng_inflatev(ucvector* out,
     return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+                                 const unsigned char* in, size_t insize,
+                                 const LodePNGDecompressSettings* settings)
+{
+    size_t bp;
+    unsigned BFINAL;
+    unsigned error;
+    
+    (void)settings;
+    
+    error = inflateBlocks(out, in, insize, insize, &bp, &BFINAL);
+    if(!error && !BFINAL) error = 52; /*error, bit pointer will jump past memory*/
+    
+    return error;
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings)
@@ -1615,28 +1687,94 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
     return error;
 }
 
+/*
+ LZ77 encoding for speed rather than size: greedy, with only two candidates per position, a run of the
+ previous byte (distance 1, as in run length encoding) and the last position that had the same three
+ bytes coming up. Positions inside a match are skipped without being remembered.
+ */
+static unsigned encodeLZ77Fast(uivector* out, Hash* hash,
+                               const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
+                               unsigned minmatch)
+{
+    size_t pos = inpos;
+    
+    if(windowsize <= 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
+    if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+    if(minmatch < 3) minmatch = 3;
+    
+    while(pos < insize)
+    {
+        const unsigned char* lastptr = &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH ? insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
+        const unsigned char *foreptr, *backptr;
+        unsigned length = 0, offset = 0;
+        
+        if(pos > 0)
+        {
+            foreptr = &in[pos];
+            backptr = &in[pos - 1];
+            while(foreptr != lastptr && *backptr == *foreptr) { ++backptr; ++foreptr; }
+            length = (unsigned)(foreptr - &in[pos]);
+            offset = 1;
+        }
+        
+        if(pos + 2 < insize && length < MAX_SUPPORTED_DEFLATE_LENGTH)
+        {
+            /*head holds positions instead of window indices here; a stale one is only ever a worse candidate*/
+            unsigned hashval = ((in[pos] | (in[pos + 1] << 8) | (in[pos + 2] << 16)) * 2654435761u) >> 16;
+            unsigned candidate = (unsigned)hash->head[hashval];
+            unsigned current_offset = (unsigned)pos - candidate;
+            hash->head[hashval] = (int)pos;
+            
+            if(current_offset > 1 && current_offset <= windowsize && current_offset <= pos)
+            {
+                foreptr = &in[pos];
+                backptr = &in[pos - current_offset];
+                while(foreptr != lastptr && *backptr == *foreptr) { ++backptr; ++foreptr; }
+                if((unsigned)(foreptr - &in[pos]) > length)
+                {
+                    length = (unsigned)(foreptr - &in[pos]);
+                    offset = current_offset;
+                }
+            }
+        }
+        
+        if(length < minmatch)
+        {
+            if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+            pos++;
+        }
+        else
+        {
+            addLengthDistance(out, length, offset);
+            pos += length;
+        }
+    }
+    
+    return 0;
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize)
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, int final)
 {
     /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
      2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
     
-    size_t i, j, numdeflateblocks = (datasize + 65534) / 65535;
-    unsigned datapos = 0;
+    size_t i, j, oldsize, numdeflateblocks = (datasize + 65534) / 65535;
+    size_t datapos = 0;
     for(i = 0; i < numdeflateblocks; i++)
     {
         unsigned BFINAL, BTYPE, LEN, NLEN;
         unsigned char firstbyte;
         
-        BFINAL = (i == numdeflateblocks - 1);
+        BFINAL = final && (i == numdeflateblocks - 1);
         BTYPE = 0;
         
         firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
         ucvector_push_back(out, firstbyte);
         
         LEN = 65535;
-        if(datasize - datapos < 65535) LEN = (unsigned)datasize - datapos;
+        if(datasize - datapos < 65535) LEN = (unsigned)(datasize - datapos);
         NLEN = 65535 - LEN;
         
         ucvector_push_back(out, (unsigned char)(LEN % 256));
@@ -1645,10 +1783,9 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
         ucvector_push_back(out, (unsigned char)(NLEN / 256));
         
         /*Decompressed data*/
-        for(j = 0; j < 65535 && datapos < datasize; j++)
-        {
-            ucvector_push_back(out, data[datapos++]);
-        }
+        oldsize = out->size;
+        if(!ucvector_resize(out, oldsize + LEN)) return 83; /*alloc fail*/
+        for(j = 0; j < LEN; j++) out->data[oldsize + j] = data[datapos++];
     }
     
     return 0;
@@ -1747,7 +1884,12 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
      allow breaking out of it to the cleanup phase on error conditions.*/
     while(!error)
     {
-        if(settings->use_lz77)
+        if(settings->use_lz77 && settings->fastmatching)
+        {
+            error = encodeLZ77Fast(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize, settings->minmatch);
+            if(error) break;
+        }
+        else if(settings->use_lz77)
         {
             error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
                                settings->minmatch, settings->nicematch, settings->lazymatching);
@@ -1756,7 +1898,7 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
         else
         {
             if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
-            for(i = datapos; i < dataend; i++) lz77_encoded.data[i] = data[i]; /*no LZ77, but still will be Huffman compressed*/
+            for(i = datapos; i < dataend; i++) lz77_encoded.data[i - datapos] = data[i]; /*no LZ77, but still will be Huffman compressed*/
         }
         
         if(!uivector_resizev(&frequencies_ll, 286, 0)) ERROR_BREAK(83 /*alloc fail*/);
@@ -1959,8 +2101,15 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
     {
         uivector lz77_encoded;
         uivector_init(&lz77_encoded);
-        error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                           settings->minmatch, settings->nicematch, settings->lazymatching);
+        if(settings->fastmatching)
+        {
+            error = encodeLZ77Fast(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize, settings->minmatch);
+        }
+        else
+        {
+            error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
+                               settings->minmatch, settings->nicematch, settings->lazymatching);
+        }
         if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
         uivector_cleanup(&lz77_encoded);
     }
@@ -1981,8 +2130,12 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
     return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings)
+/*
+ deflates one piece of a stream. If it's not the final piece, it ends with an empty stored block (a sync
+ flush) instead of a final block, so the next piece can be appended starting at a byte boundary
+ */
+static unsigned deflatePiece(ucvector* out, const unsigned char* in, size_t insize,
+                             const LodePNGCompressSettings* settings, int final)
 {
     unsigned error = 0;
     size_t i, blocksize, numdeflateblocks;
@@ -1990,7 +2143,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
     Hash hash;
     
     if(settings->btype > 2) return 61;
-    else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
+    else if(settings->btype == 0) return deflateNoCompression(out, in, insize, final);
     else if(settings->btype == 1) blocksize = insize;
     else /*if(settings->btype == 2)*/
     {
@@ -2006,20 +2159,36 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
     
     for(i = 0; i < numdeflateblocks && !error; i++)
     {
-        int final = i == numdeflateblocks - 1;
+        int blockfinal = final && i == numdeflateblocks - 1;
         size_t start = i * blocksize;
         size_t end = start + blocksize;
         if(end > insize) end = insize;
         
-        if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-        else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+        if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, blockfinal);
+        else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, blockfinal);
     }
     
     hash_cleanup(&hash);
     
+    if(!error && !final)
+    {
+        /*BFINAL 0 and BTYPE 00, then LEN 0 and NLEN 65535 at the next byte boundary*/
+        addBitsToStream(&bp, out, 0, 3);
+        ucvector_push_back(out, 0);
+        ucvector_push_back(out, 0);
+        ucvector_push_back(out, 255);
+        ucvector_push_back(out, 255);
+    }
+    
     return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings)
+{
+    return deflatePiece(out, in, insize, settings, 1);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings)
@@ -2053,7 +2222,7 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                  */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+static unsigned update_adler32(unsigned adler, const unsigned char* data, size_t len)
 {
     unsigned s1 = adler & 0xffff;
     unsigned s2 = (adler >> 16) & 0xffff;
@@ -2061,7 +2230,7 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
     while(len > 0)
     {
         /*at least 5550 sums can be done before the sums overflow, saving a lot of module divisions*/
-        unsigned amount = len > 5550 ? 5550 : len;
+        size_t amount = len > 5550 ? 5550 : len;
         len -= amount;
         while(amount > 0)
         {
@@ -2077,21 +2246,35 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
 }
 
 /*Return the adler32 of the bytes data[0..len-1]*/
-static unsigned adler32(const unsigned char* data, unsigned len)
+static unsigned adler32(const unsigned char* data, size_t len)
 {
     return update_adler32(1L, data, len);
 }
 
+/*Return the adler32 of two pieces of data one after the other, given the adler32 of each and the length of the second*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+    /*the first sum just adds up, every byte of the first piece adds to the second sum once more per byte of the second*/
+    unsigned rem = (unsigned)(len2 % 65521);
+    unsigned s1 = adler1 & 0xffff;
+    unsigned s2 = (rem * s1) % 65521;
+    
+    s1 += (adler2 & 0xffff) + 65521 - 1;
+    s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+    s1 %= 65521;
+    s2 %= 65521;
+    
+    return (s2 << 16) | s1;
+}
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings)
+static unsigned zlib_check_header(const unsigned char* in, size_t insize)
 {
-    unsigned error = 0;
     unsigned CM, CINFO, FDICT;
     
     if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2120,13 +2303,22 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
         return 26;
     }
     
+    return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings)
+{
+    unsigned error = zlib_check_header(in, insize);
+    if(error) return error;
+    
     error = inflate(out, outsize, in + 2, insize - 2, settings);
     if(error) return error;
     
     if(!settings->ignore_adler32)
     {
         unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-        unsigned checksum = adler32(*out, (unsigned)(*outsize));
+        unsigned checksum = adler32(*out, *outsize);
         if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
     }
     
@@ -2146,22 +2338,204 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
     }
 }
 
+typedef struct InflatePiece
+{
+    size_t inpos, inend; /*where the piece is in the zlib stream*/
+    size_t outpos, outsize; /*where its data goes*/
+    unsigned adler;
+    unsigned error;
+} InflatePiece;
+
+typedef struct InflatePieces
+{
+    InflatePiece* pieces;
+    size_t numpieces;
+    const unsigned char* in;
+    size_t insize;
+    unsigned char* out;
+    const LodePNGDecompressSettings* settings;
+} InflatePieces;
+
+static void inflateZlibPiece(void* context, size_t index)
+{
+    InflatePieces* p = (InflatePieces*)context;
+    InflatePiece* piece = &p->pieces[index];
+    unsigned final = index == p->numpieces - 1;
+    ucvector v;
+    size_t bp, i;
+    unsigned BFINAL;
+    
+    ucvector_init_buffer(&v, 0, 0);
+    piece->error = inflateBlocks(&v, &p->in[piece->inpos], p->insize - piece->inpos,
+                                 piece->inend - piece->inpos, &bp, &BFINAL);
+    
+    /*every piece but the last must end in a sync flush right where the next one starts*/
+    if(!piece->error && (BFINAL != final || (!final && bp != (piece->inend - piece->inpos) * 8))) piece->error = 52;
+    if(!piece->error && v.size != piece->outsize) piece->error = 52;
+    
+    if(!piece->error)
+    {
+        for(i = 0; i < v.size; i++) p->out[piece->outpos + i] = v.data[i];
+        if(!p->settings->ignore_adler32) piece->adler = adler32(v.data, v.size);
+    }
+    
+    lodepng_free(v.data);
+}
+
+/*
+ zlib decompress a stream deflated in pieces, given the index of where they start (see the dfIX chunk), on
+ multiple threads. out must already have the size the data will have. Fails if the index doesn't match the
+ stream; inflating it as a whole after that gives the real error, if there is one.
+ */
+static unsigned zlib_decompress_pieces(ucvector* out, const unsigned char* in, size_t insize,
+                                       const unsigned char* index, size_t indexsize,
+                                       const LodePNGDecompressSettings* settings)
+{
+    unsigned error = zlib_check_header(in, insize);
+    InflatePieces pieces;
+    size_t i;
+    
+    if(error) return error;
+    if(insize < 6 || indexsize < 8 || indexsize % 8 != 0) return 52;
+    
+    pieces.numpieces = indexsize / 8;
+    pieces.pieces = (InflatePiece*)lodepng_malloc(pieces.numpieces * sizeof(InflatePiece));
+    if(!pieces.pieces) return 83; /*alloc fail*/
+    pieces.in = in;
+    pieces.insize = insize;
+    pieces.out = out->data;
+    pieces.settings = settings;
+    
+    /*the pieces must follow each other, the first one right after the zlib header*/
+    for(i = 0; i < pieces.numpieces && !error; i++)
+    {
+        InflatePiece* piece = &pieces.pieces[i];
+        size_t outend = i + 1 < pieces.numpieces ? lodepng_read32bitInt(&index[i * 8 + 12]) : out->size;
+        piece->inpos = lodepng_read32bitInt(&index[i * 8]);
+        piece->inend = i + 1 < pieces.numpieces ? lodepng_read32bitInt(&index[i * 8 + 8]) : insize - 4;
+        piece->outpos = lodepng_read32bitInt(&index[i * 8 + 4]);
+        piece->error = 0;
+        piece->adler = 1;
+        
+        if(i == 0 && (piece->inpos != 2 || piece->outpos != 0)) error = 52;
+        else if(piece->inend <= piece->inpos || piece->inend > insize - 4) error = 52;
+        else if(outend <= piece->outpos || outend > out->size) error = 52;
+        else piece->outsize = outend - piece->outpos;
+    }
+    
+    if(!error) runParallel(inflateZlibPiece, &pieces, pieces.numpieces, settings->threadcount);
+    
+    for(i = 0; i < pieces.numpieces && !error; i++) error = pieces.pieces[i].error;
+    
+    if(!error && !settings->ignore_adler32)
+    {
+        unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
+        unsigned checksum = pieces.pieces[0].adler;
+        for(i = 1; i < pieces.numpieces; i++)
+        {
+            checksum = adler32_combine(checksum, pieces.pieces[i].adler, pieces.pieces[i].outsize);
+        }
+        if(checksum != ADLER32) error = 58; /*error, adler checksum not correct, data must be corrupted*/
+    }
+    
+    lodepng_free(pieces.pieces);
+    
+    return error;
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
-unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                               size_t insize, const LodePNGCompressSettings* settings)
+typedef struct DeflatePiece
+{
+    const unsigned char* in;
+    size_t insize;
+    ucvector deflated;
+    unsigned adler;
+    unsigned error;
+} DeflatePiece;
+
+typedef struct DeflatePieces
+{
+    DeflatePiece* pieces;
+    size_t numpieces;
+    const LodePNGCompressSettings* settings;
+} DeflatePieces;
+
+static void deflateZlibPiece(void* context, size_t index)
+{
+    DeflatePieces* p = (DeflatePieces*)context;
+    DeflatePiece* piece = &p->pieces[index];
+    piece->error = deflatePiece(&piece->deflated, piece->in, piece->insize, p->settings, index == p->numpieces - 1);
+    piece->adler = adler32(piece->in, piece->insize);
+}
+
+/*
+ deflates the data in up to settings->threadcount pieces on as many threads, and appends them to the zlib
+ stream in out one after another, as they'd be if deflated serially (see deflatePiece)
+ */
+static unsigned deflate_pieces(ucvector* out, unsigned* ADLER32, const unsigned char* in, size_t insize,
+                               size_t numpieces, const LodePNGCompressSettings* settings, uivector* index)
+{
+    unsigned error = 0;
+    size_t i, j, piecesize = (insize + numpieces - 1) / numpieces;
+    DeflatePieces pieces;
+    
+    pieces.numpieces = numpieces;
+    pieces.settings = settings;
+    pieces.pieces = (DeflatePiece*)lodepng_malloc(numpieces * sizeof(DeflatePiece));
+    if(!pieces.pieces) return 83; /*alloc fail*/
+    
+    for(i = 0; i < numpieces; i++)
+    {
+        DeflatePiece* piece = &pieces.pieces[i];
+        piece->in = &in[i * piecesize];
+        piece->insize = i + 1 < numpieces ? piecesize : insize - i * piecesize;
+        ucvector_init_buffer(&piece->deflated, 0, 0);
+        piece->error = 0;
+    }
+    
+    runParallel(deflateZlibPiece, &pieces, numpieces, settings->threadcount);
+    
+    for(i = 0; i < numpieces; i++)
+    {
+        DeflatePiece* piece = &pieces.pieces[i];
+        size_t oldsize = out->size;
+        if(!error) error = piece->error;
+        if(!error && index)
+        {
+            if(!uivector_push_back(index, (unsigned)oldsize)) error = 83; /*alloc fail*/
+            if(!uivector_push_back(index, (unsigned)(i * piecesize))) error = 83; /*alloc fail*/
+        }
+        if(!error)
+        {
+            if(!ucvector_resize(out, oldsize + piece->deflated.size)) error = 83; /*alloc fail*/
+            for(j = 0; j < piece->deflated.size && !error; j++) out->data[oldsize + j] = piece->deflated.data[j];
+            *ADLER32 = i == 0 ? piece->adler : adler32_combine(*ADLER32, piece->adler, piece->insize);
+        }
+        lodepng_free(piece->deflated.data);
+    }
+    
+    lodepng_free(pieces.pieces);
+    
+    return error;
+}
+
+/*
+ zlib compress into out, which may already hold data. If index isn't NULL, it receives the start of every piece
+ the data was deflated in, as offset in out followed by offset in the data
+ */
+static unsigned zlib_compress_pieces(ucvector* out, const unsigned char* in, size_t insize,
+                                     const LodePNGCompressSettings* settings, uivector* index)
 {
-    /*initially, *out must be NULL and outsize 0, if you just give some random *out
-     that's pointing to a non allocated buffer, this'll crash*/
-    ucvector outv;
     size_t i;
     unsigned error;
     unsigned char* deflatedata = 0;
     size_t deflatesize = 0;
+    size_t numpieces = 1;
     
-    unsigned ADLER32;
+    unsigned ADLER32 = 1;
     /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
     unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
     unsigned FLEVEL = 0;
@@ -2170,22 +2544,59 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
     unsigned FCHECK = 31 - CMFFLG % 31;
     CMFFLG += FCHECK;
     
-    /*ucvector-controlled version of the output buffer, for dynamic array*/
-    ucvector_init_buffer(&outv, *out, *outsize);
-    
-    ucvector_push_back(&outv, (unsigned char)(CMFFLG / 256));
-    ucvector_push_back(&outv, (unsigned char)(CMFFLG % 256));
+    ucvector_push_back(out, (unsigned char)(CMFFLG / 256));
+    ucvector_push_back(out, (unsigned char)(CMFFLG % 256));
     
-    error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+    /*pieces only pay off when each is big enough to keep a thread busy, and need the built in deflate*/
+    if(settings->threadcount > 1 && !settings->custom_deflate)
+    {
+        numpieces = insize / PARALLEL_PIECE_SIZE;
+        if(numpieces > settings->threadcount) numpieces = settings->threadcount;
+        if(numpieces == 0) numpieces = 1;
+    }
     
-    if(!error)
+    if(numpieces > 1)
     {
-        ADLER32 = adler32(in, (unsigned)insize);
-        for(i = 0; i < deflatesize; i++) ucvector_push_back(&outv, deflatedata[i]);
+        error = deflate_pieces(out, &ADLER32, in, insize, numpieces, settings, index);
+    }
+    else
+    {
+        if(index)
+        {
+            uivector_push_back(index, (unsigned)out->size);
+            uivector_push_back(index, 0);
+        }
+        
+        error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+        
+        if(!error)
+        {
+            size_t oldsize = out->size;
+            ADLER32 = adler32(in, insize);
+            if(!ucvector_resize(out, oldsize + deflatesize)) error = 83; /*alloc fail*/
+            for(i = 0; i < deflatesize && !error; i++) out->data[oldsize + i] = deflatedata[i];
+        }
         lodepng_free(deflatedata);
-        lodepng_add32bitInt(&outv, ADLER32);
     }
     
+    if(!error) lodepng_add32bitInt(out, ADLER32);
+    
+    return error;
+}
+
+unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                               size_t insize, const LodePNGCompressSettings* settings)
+{
+    /*initially, *out must be NULL and outsize 0, if you just give some random *out
+     that's pointing to a non allocated buffer, this'll crash*/
+    ucvector outv;
+    unsigned error;
+    
+    /*ucvector-controlled version of the output buffer, for dynamic array*/
+    ucvector_init_buffer(&outv, *out, *outsize);
+    
+    error = zlib_compress_pieces(&outv, in, insize, settings, 0);
+    
     *out = outv.data;
     *outsize = outv.size;
     
@@ -2245,13 +2656,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
     settings->minmatch = 3;
     settings->nicematch = 128;
     settings->lazymatching = 1;
+    settings->fastmatching = 0;
+    settings->threadcount = 0;
     
     settings->custom_zlib = 0;
     settings->custom_deflate = 0;
     settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2261,13 +2674,14 @@ const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT
 void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings)
 {
     settings->ignore_adler32 = 0;
+    settings->threadcount = 0;
     
     settings->custom_zlib = 0;
     settings->custom_inflate = 0;
     settings->custom_context = 0;
 }
 
-const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0};
+const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0, 0, 0};
 
 #endif /*LODEPNG_COMPILE_DECODER*/
 
@@ -4099,7 +4513,50 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
     return 0;
 }
 
-static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp)
+/*unfilters the rows y0..y1-1; the first one must not depend on the row above it (or be the first of the image)*/
+static unsigned unfilterRows(unsigned char* out, const unsigned char* in, size_t bytewidth, size_t linebytes,
+                             unsigned y0, unsigned y1)
+{
+    unsigned y;
+    unsigned char* prevline = 0;
+    
+    for(y = y0; y < y1; y++)
+    {
+        size_t outindex = linebytes * y;
+        size_t inindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
+        unsigned char filterType = in[inindex];
+        
+        CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes));
+        
+        prevline = &out[outindex];
+    }
+    
+    return 0;
+}
+
+typedef struct UnfilterRange
+{
+    unsigned y0, y1;
+    unsigned error;
+} UnfilterRange;
+
+typedef struct UnfilterRanges
+{
+    UnfilterRange* ranges;
+    unsigned char* out;
+    const unsigned char* in;
+    size_t bytewidth, linebytes;
+} UnfilterRanges;
+
+static void unfilterRange(void* context, size_t index)
+{
+    UnfilterRanges* r = (UnfilterRanges*)context;
+    UnfilterRange* range = &r->ranges[index];
+    range->error = unfilterRows(r->out, r->in, r->bytewidth, r->linebytes, range->y0, range->y1);
+}
+
+static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp,
+                         unsigned threadcount)
 {
     /*
      For PNG filter method 0
@@ -4107,27 +4564,49 @@ static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w
      out must have enough bytes allocated already, in must have the scanlines + 1 filtertype byte per scanline
      w and h are image dimensions or dimensions of reduced image, bpp is bits per pixel
      in and out are allowed to be the same memory address (but aren't the same size since in has the extra filter bytes)
+     with threadcount above 1, the rows are unfiltered in ranges on multiple threads; in and out must not overlap then
      */
     
-    unsigned y;
-    unsigned char* prevline = 0;
+    UnfilterRanges ranges;
+    size_t numranges = 0, rangerows, i;
+    unsigned y, error = 0;
     
     /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
     size_t bytewidth = (bpp + 7) / 8;
     size_t linebytes = (w * bpp + 7) / 8;
     
+    if(threadcount <= 1 || (linebytes + 1) * h < 2 * PARALLEL_PIECE_SIZE)
+    {
+        return unfilterRows(out, in, bytewidth, linebytes, 0, h);
+    }
+    
+    /*rows with filter type None or Sub don't depend on the row above, so a range can start at any of them*/
+    rangerows = PARALLEL_PIECE_SIZE / (linebytes + 1) + 1;
+    ranges.ranges = (UnfilterRange*)lodepng_malloc((h / rangerows + 1) * sizeof(UnfilterRange));
+    if(!ranges.ranges) return 83; /*alloc fail*/
+    ranges.out = out;
+    ranges.in = in;
+    ranges.bytewidth = bytewidth;
+    ranges.linebytes = linebytes;
+    
     for(y = 0; y < h; y++)
     {
-        size_t outindex = linebytes * y;
-        size_t inindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
-        unsigned char filterType = in[inindex];
-        
-        CERROR_TRY_RETURN(unfilterScanline(&out[outindex], &in[inindex + 1], prevline, bytewidth, filterType, linebytes));
-        
-        prevline = &out[outindex];
+        unsigned char filterType = in[(1 + linebytes) * y];
+        if(y == 0 || (y - ranges.ranges[numranges - 1].y0 >= rangerows && filterType <= 1))
+        {
+            if(numranges > 0) ranges.ranges[numranges - 1].y1 = y;
+            ranges.ranges[numranges].y0 = y;
+            numranges++;
+        }
     }
+    ranges.ranges[numranges - 1].y1 = h;
     
-    return 0;
+    runParallel(unfilterRange, &ranges, numranges, threadcount);
+    
+    for(i = 0; i < numranges && !error; i++) error = ranges.ranges[i].error;
+    lodepng_free(ranges.ranges);
+    
+    return error;
 }
 
 /*
@@ -4222,7 +4701,7 @@ static void removePaddingBits(unsigned char* out, const unsigned char* in,
  the IDAT chunks (with filter index bytes and possible padding bits)
  return value is error*/
 static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
-                                     unsigned w, unsigned h, const LodePNGInfo* info_png)
+                                     unsigned w, unsigned h, const LodePNGInfo* info_png, unsigned threadcount)
 {
     /*
      This function converts the filtered-padded-interlaced data into pure 2D image buffer with the PNG's colortype.
@@ -4230,6 +4709,7 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
      *) if no Adam7: 1) unfilter 2) remove padding bits (= posible extra bits per scanline if bpp < 8)
      *) if adam7: 1) 7x unfilter 2) 7x remove padding bits 3) Adam7_deinterlace
      NOTE: the in buffer will be overwritten with intermediate data!
+     threadcount only applies when unfiltering straight into the out buffer
      */
     unsigned bpp = lodepng_get_bpp(&info_png->color);
     if(bpp == 0) return 31; /*error: invalid colortype*/
@@ -4238,11 +4718,11 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
     {
         if(bpp < 8 && w * bpp != ((w * bpp + 7) / 8) * 8)
         {
-            CERROR_TRY_RETURN(unfilter(in, in, w, h, bpp));
+            CERROR_TRY_RETURN(unfilter(in, in, w, h, bpp, 1));
             removePaddingBits(out, in, w * bpp, ((w * bpp + 7) / 8) * 8, h);
         }
         /*we can immediatly filter into the out buffer, no other steps needed*/
-        else CERROR_TRY_RETURN(unfilter(out, in, w, h, bpp));
+        else CERROR_TRY_RETURN(unfilter(out, in, w, h, bpp, threadcount));
     }
     else /*interlace_method is 1 (Adam7)*/
     {
@@ -4253,7 +4733,7 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
         
         for(i = 0; i < 7; i++)
         {
-            CERROR_TRY_RETURN(unfilter(&in[padded_passstart[i]], &in[filter_passstart[i]], passw[i], passh[i], bpp));
+            CERROR_TRY_RETURN(unfilter(&in[padded_passstart[i]], &in[filter_passstart[i]], passw[i], passh[i], bpp, 1));
             /*TODO: possible efficiency improvement: if in this reduced image the bits fit nicely in 1 scanline,
              move bytes instead of bits or move not at all*/
             if(bpp < 8)
@@ -4578,16 +5058,16 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*
+ read the header and all chunks of a PNG up to IEND into state->info_png; the data of all IDAT chunks is appended
+ to idat (which must be initialized), and pieceindex points to the dfIX chunk data, if any
+ */
+static void readChunks(unsigned* w, unsigned* h, LodePNGState* state, const unsigned char* in, size_t insize,
+                       ucvector* idat, const unsigned char** pieceindex, size_t* pieceindexsize)
 {
     unsigned char IEND = 0;
     const unsigned char* chunk;
     size_t i;
-    ucvector idat; /*the data from idat chunks*/
-    ucvector scanlines;
     
     /*for unknown chunk order*/
     unsigned unknown = 0;
@@ -4595,13 +5075,12 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     
-    /*provide some proper output values if error will happen*/
-    *out = 0;
+    *pieceindex = 0;
+    *pieceindexsize = 0;
     
     state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
     if(state->error) return;
     
-    ucvector_init(&idat);
     chunk = &in[33]; /*first byte of the first chunk after the header*/
     
     /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4629,9 +5108,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
         /*IDAT chunk, containing compressed image data*/
         if(lodepng_chunk_type_equals(chunk, "IDAT"))
         {
-            size_t oldsize = idat.size;
-            if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-            for(i = 0; i < chunkLength; i++) idat.data[oldsize + i] = data[i];
+            size_t oldsize = idat->size;
+            if(!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+            for(i = 0; i < chunkLength; i++) idat->data[oldsize + i] = data[i];
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
             critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4656,6 +5135,12 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
             state->error = readChunk_tRNS(&state->info_png.color, data, chunkLength);
             if(state->error) break;
         }
+        /*index of the pieces the IDAT data was deflated in (dfIX), only kept to inflate them in parallel*/
+        else if(lodepng_chunk_type_equals(chunk, "dfIX"))
+        {
+            *pieceindex = data;
+            *pieceindexsize = chunkLength;
+        }
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
         /*background color chunk (bKGD)*/
         else if(lodepng_chunk_type_equals(chunk, "bKGD"))
@@ -4724,6 +5209,24 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
         
         if(!IEND) chunk = lodepng_chunk_next_const(chunk);
     }
+}
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+    ucvector idat; /*the data from idat chunks*/
+    ucvector scanlines;
+    const unsigned char* pieceindex; /*the dfIX chunk data, if any*/
+    size_t pieceindexsize;
+    unsigned inflated = 0;
+    
+    /*provide some proper output values if error will happen*/
+    *out = 0;
+    
+    ucvector_init(&idat);
+    readChunks(w, h, state, in, insize, &idat, &pieceindex, &pieceindexsize);
     
     ucvector_init(&scanlines);
     if(!state->error)
@@ -4734,7 +5237,23 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
             state->error = 83; /*alloc fail*/
         }
     }
-    if(!state->error)
+#ifdef LODEPNG_COMPILE_ZLIB
+    if(!state->error && pieceindex && state->decoder.zlibsettings.threadcount > 1
+       && !state->decoder.zlibsettings.custom_zlib && state->info_png.interlace_method == 0)
+    {
+        /*inflate the pieces on multiple threads straight into place; any mismatch with the index falls back to
+         inflating the stream as a whole below. The index only holds 32-bit offsets, so it can't describe a
+         stream or data beyond 4 GB*/
+        size_t linebytes = ((size_t)(*w) * lodepng_get_bpp(&state->info_png.color) + 7) / 8;
+        if(idat.size <= 0xffffffffu && (linebytes + 1) * (*h) <= 0xffffffffu)
+        {
+            if(!ucvector_resize(&scanlines, (linebytes + 1) * (*h))) state->error = 83; /*alloc fail*/
+            else inflated = !zlib_decompress_pieces(&scanlines, idat.data, idat.size, pieceindex, pieceindexsize,
+                                                    &state->decoder.zlibsettings);
+        }
+    }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+    if(!state->error && !inflated)
     {
         /*decompress with the Zlib decompressor*/
         state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
@@ -4748,7 +5267,8 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
         ucvector_init(&outv);
         if(!ucvector_resizev(&outv,
                              lodepng_get_raw_size(*w, *h, &state->info_png.color), 0)) state->error = 83; /*alloc fail*/
-        if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png);
+        if(!state->error) state->error = postProcessScanlines(outv.data, scanlines.data, *w, *h, &state->info_png,
+                                                              state->decoder.zlibsettings.threadcount);
         *out = outv.data;
     }
     ucvector_cleanup(&scanlines);
@@ -4798,6 +5318,178 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
     return state->error;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*state of lodepng_decode_rows while scanlines are inflated*/
+typedef struct RowDecoder
+{
+    LodePNGState* state;
+    unsigned w, h;
+    size_t linebytes; /*bytes of an unfiltered scanline, without the filter type byte*/
+    size_t bytewidth;
+    unsigned y; /*next scanline to hand out*/
+    size_t consumed; /*bytes of the inflated data that were handed out already*/
+    unsigned adler; /*of the inflated data that was discarded already*/
+    unsigned char* lines; /*the current and the previous unfiltered scanline, alternating*/
+    unsigned char* converted; /*scanline in the color type of info_raw, if it differs from the PNG*/
+    void (*row)(void*, unsigned, const unsigned char*);
+    void* context;
+} RowDecoder;
+
+/*
+ hand out every complete scanline in out, then drop all inflated data but the deflate window and the incomplete
+ scanline, so back references keep working
+ */
+static unsigned flushRows(RowDecoder* d, ucvector* out, size_t* pos)
+{
+    size_t discard, i;
+    while(d->y < d->h && *pos - d->consumed >= d->linebytes + 1)
+    {
+        const unsigned char* scanline = &out->data[d->consumed];
+        unsigned char* recon = &d->lines[(d->y & 1) * d->linebytes];
+        const unsigned char* precon = d->y ? &d->lines[((d->y + 1) & 1) * d->linebytes] : 0;
+        CERROR_TRY_RETURN(unfilterScanline(recon, &scanline[1], precon, d->bytewidth, scanline[0], d->linebytes));
+        if(d->converted)
+        {
+            CERROR_TRY_RETURN(lodepng_convert(d->converted, recon, &d->state->info_raw, &d->state->info_png.color,
+                                              d->w, 1, d->state->decoder.fix_png));
+        }
+        d->row(d->context, d->y, d->converted ? d->converted : recon);
+        d->consumed += d->linebytes + 1;
+        d->y++;
+    }
+    
+    discard = *pos > 32768 ? *pos - 32768 : 0;
+    if(discard > d->consumed) discard = d->consumed;
+    if(discard > 0)
+    {
+        if(!d->state->decoder.zlibsettings.ignore_adler32)
+        {
+            d->adler = adler32_combine(d->adler, adler32(out->data, discard), discard);
+        }
+        for(i = 0; i + discard < *pos; i++) out->data[i] = out->data[i + discard];
+        *pos -= discard;
+        d->consumed -= discard;
+    }
+    
+    return 0;
+}
+
+/*zlib decompress the IDAT data one deflate block at a time, handing out scanlines as they are completed*/
+static unsigned inflateRows(RowDecoder* d, const unsigned char* in, size_t insize)
+{
+    unsigned error = zlib_check_header(in, insize);
+    ucvector out;
+    size_t bp = 0, pos = 0;
+    unsigned BFINAL = 0;
+    
+    if(error) return error;
+    
+    ucvector_init(&out);
+    while(!error && !BFINAL)
+    {
+        unsigned BTYPE;
+        if(bp + 2 >= (insize - 2) * 8) CERROR_BREAK(error, 52); /*error, bit pointer will jump past memory*/
+        BFINAL = readBitFromStream(&bp, &in[2]);
+        BTYPE = 1 * readBitFromStream(&bp, &in[2]);
+        BTYPE += 2 * readBitFromStream(&bp, &in[2]);
+        
+        if(BTYPE == 3) error = 20; /*error: invalid BTYPE*/
+        else if(BTYPE == 0) error = inflateNoCompression(&out, &in[2], &bp, &pos, insize - 2); /*no compression*/
+        else error = inflateHuffmanBlock(&out, &in[2], &bp, &pos, insize - 2, BTYPE); /*BTYPE 01 or 10*/
+        
+        if(!error) error = flushRows(d, &out, &pos);
+    }
+    
+    if(!error && d->y < d->h) error = 91; /*error: fewer scanlines than the image has*/
+    
+    if(!error && !d->state->decoder.zlibsettings.ignore_adler32)
+    {
+        unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
+        unsigned checksum = adler32_combine(d->adler, adler32(out.data, pos), pos);
+        if(checksum != ADLER32) error = 58; /*error, adler checksum not correct, data must be corrupted*/
+    }
+    
+    ucvector_cleanup(&out);
+    return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*hand out the rows of a decoded image one at a time*/
+static void handOutRows(const unsigned char* image, unsigned w, unsigned h, const LodePNGColorMode* mode,
+                        void (*row)(void*, unsigned, const unsigned char*), void* context)
+{
+    size_t linebytes = ((size_t)w * lodepng_get_bpp(mode) + 7) / 8;
+    unsigned y;
+    for(y = 0; y < h; y++) row(context, y, &image[y * linebytes]);
+}
+
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             void (*row)(void* context, unsigned y, const unsigned char* data), void* context)
+{
+#ifdef LODEPNG_COMPILE_ZLIB
+    ucvector idat;
+    const unsigned char* pieceindex; /*not used, the pieces are inflated in order*/
+    size_t pieceindexsize;
+    RowDecoder d;
+    unsigned convert;
+    
+    ucvector_init(&idat);
+    readChunks(w, h, state, in, insize, &idat, &pieceindex, &pieceindexsize);
+    
+    /*interlaced scanlines only make whole rows once all passes are in, and custom zlib decoders only inflate as a
+     whole; both are decoded as a whole first*/
+    if(!state->error && state->info_png.interlace_method == 0 && !state->decoder.zlibsettings.custom_zlib
+       && !state->decoder.zlibsettings.custom_inflate)
+    {
+        unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+        convert = state->decoder.color_convert && !lodepng_color_mode_equal(&state->info_raw, &state->info_png.color);
+        if(!state->decoder.color_convert)
+        {
+            state->error = lodepng_color_mode_copy(&state->info_raw, &state->info_png.color);
+        }
+        else if(convert && !(state->info_raw.colortype == LCT_RGB || state->info_raw.colortype == LCT_RGBA)
+                && !(state->info_raw.bitdepth == 8))
+        {
+            state->error = 56; /*unsupported color mode conversion*/
+        }
+        
+        d.state = state;
+        d.w = *w;
+        d.h = *h;
+        d.linebytes = ((size_t)(*w) * bpp + 7) / 8;
+        d.bytewidth = (bpp + 7) / 8;
+        d.y = 0;
+        d.consumed = 0;
+        d.adler = 1;
+        d.lines = 0;
+        d.converted = 0;
+        d.row = row;
+        d.context = context;
+        if(!state->error)
+        {
+            d.lines = (unsigned char*)lodepng_malloc(d.linebytes * 2);
+            if(convert) d.converted = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(*w, 1, &state->info_raw));
+            if(!d.lines || (convert && !d.converted)) state->error = 83; /*alloc fail*/
+        }
+        if(!state->error) state->error = inflateRows(&d, idat.data, idat.size);
+        
+        lodepng_free(d.lines);
+        lodepng_free(d.converted);
+        ucvector_cleanup(&idat);
+        return state->error;
+    }
+    ucvector_cleanup(&idat);
+    if(state->error) return state->error;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+    {
+        unsigned char* image = 0;
+        if(!lodepng_decode(&image, w, h, state, in, insize)) handOutRows(image, *w, *h, &state->info_raw, row, context);
+        lodepng_free(image);
+    }
+    return state->error;
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -5002,6 +5694,22 @@ static unsigned addChunk_tRNS(ucvector* out, const LodePNGColorMode* info)
     return error;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*private chunk: where each piece of a zlib stream deflated in pieces starts, in the stream and in the data*/
+static unsigned addChunk_dfIX(ucvector* out, const uivector* index)
+{
+    unsigned error = 0;
+    size_t i;
+    ucvector data;
+    ucvector_init(&data);
+    for(i = 0; i < index->size; i++) lodepng_add32bitInt(&data, index->data[i]);
+    error = addChunk(out, "dfIX", data.data, data.size);
+    ucvector_cleanup(&data);
+    
+    return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t datasize,
                               LodePNGCompressSettings* zlibsettings)
 {
@@ -5010,7 +5718,25 @@ static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t d
     
     /*compress with the Zlib compressor*/
     ucvector_init(&zlibdata);
-    error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, zlibsettings);
+#ifdef LODEPNG_COMPILE_ZLIB
+    if(!zlibsettings->custom_zlib)
+    {
+        uivector index;
+        uivector_init(&index);
+        error = zlib_compress_pieces(&zlibdata, data, datasize, zlibsettings, &index);
+        /*tell decoders where the pieces start if there's more than one, so they can inflate them in parallel;
+         offsets are 32-bit, so streams or data beyond 4 GB go without*/
+        if(!error && index.size > 2 && zlibdata.size <= 0xffffffffu && datasize <= 0xffffffffu)
+        {
+            error = addChunk_dfIX(out, &index);
+        }
+        uivector_cleanup(&index);
+    }
+    else
+#endif /*LODEPNG_COMPILE_ZLIB*/
+    {
+        error = zlib_compress(&zlibdata.data, &zlibdata.size, data, datasize, zlibsettings);
+    }
     if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
     ucvector_cleanup(&zlibdata);
     
@@ -6042,6 +6768,7 @@ const char* lodepng_error_text(unsigned code)
         case 89: return "text chunk keyword too short or long: must have size 1-79";
             /*the windowsize in the LodePNGCompressSettings. Requiring POT(==> & instead of %) makes encoding 12% faster.*/
         case 90: return "windowsize must be a power of two";
+        case 91: return "decompressed image data too small for the image size";
     }
     return "unknown error code";
 }
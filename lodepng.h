@@ -250,6 +250,9 @@ typedef struct LodePNGDecompressSettings LodePNGDecompressSettings;
 struct LodePNGDecompressSettings
 {
     unsigned ignore_adler32; /*if 1, continue and don't give an error message if the Adler32 checksum is corrupted*/
+    /*if above 1, zlib streams split into pieces by the encoder (see dfIX chunk) are inflated, and scanlines
+     unfiltered, on up to this many threads (C++ only, otherwise one after another). Default: 0*/
+    unsigned threadcount;
     
     /*use custom zlib decoder instead of built in one (default: null)*/
     unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -284,6 +287,13 @@ struct LodePNGCompressSettings /*deflate = compress*/
     unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
     unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
     unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+    /*use a greedy matcher with only a run of the previous byte and one earlier position as candidates:
+     much faster but compresses less; nicematch and lazymatching are ignored. Default: false*/
+    unsigned fastmatching;
+    /*if above 1, large inputs are split into up to this many pieces that are deflated independently on their
+     own thread (C++ only, otherwise one after another), then joined into one standard zlib stream. Costs a
+     little compression since no piece refers back into the one before it. Default: 0*/
+    unsigned threadcount;
     
     /*use custom zlib encoder instead of built in one (default: null)*/
     unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -660,6 +670,17 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+ Same as lodepng_decode, but instead of returning the whole image, calls row for every scanline from top to
+ bottom, with its pixels in the color type of state->info_raw; data is only valid during the call. The IDAT
+ data is inflated one deflate block at a time, so only a few scanlines and the deflate window are held at once,
+ never the whole image. Interlaced images, and any decoded with a custom zlib function, are decoded as a whole
+ first.
+ */
+unsigned lodepng_decode_rows(unsigned* w, unsigned* h, LodePNGState* state,
+                             const unsigned char* in, size_t insize,
+                             void (*row)(void* context, unsigned y, const unsigned char* data), void* context);
+
 /*
  Read the PNG header, but not the actual data. This returns only the information
  that is in the header chunk of the PNG, such as width, height and color type. The
@@ -1110,6 +1131,12 @@ namespace lodepng
  and you'll have to puzzle the colors of the pixels together yourself using the
  color type information in the LodePNGInfo.
  
+ With zlibsettings.threadcount above 1, the pieces listed by a dfIX chunk (see
+ the encoder settings) are inflated on that many threads; a stream without one,
+ or one that doesn't match it, is inflated as a whole as usual. Scanlines are
+ unfiltered in parallel too, from every row with filter type None or Sub on,
+ since those don't depend on the row above; interlaced images are not.
+ 
  
  5. Encoding
  -----------
@@ -1174,6 +1201,15 @@ namespace lodepng
  true for proper compression.
  *) windowsize: the window size used by the LZ77 encoder (1 - 32768). Has value
  2048 by default, but can be set to 32768 for better, but slow, compression.
+ *) fastmatching: replaces the LZ77 search with a greedy one that only tries a
+ run of the previous byte and the last earlier position with the same next three
+ bytes. Several times faster on large images, at some cost in size.
+ *) threadcount: if above 1, the image data is deflated in pieces on that many
+ threads. The result is still a single standard zlib stream; the pieces end in
+ empty stored blocks (sync flushes) and their Adler32 checksums are combined. A
+ private dfIX chunk listing where each piece starts is added before the IDAT
+ chunks, which other decoders ignore. Its offsets are 32-bit, so it is left out
+ when the image data or the zlib stream is larger than 4 GB.
  *) force_palette: if colortype is 2 or 6, you can make the encoder write a PLTE
  chunk if force_palette is true. This can used as suggested palette to convert
  to by viewers that don't support more than 256 colors (if those still exist)
@@ -1574,6 +1610,12 @@ namespace lodepng
  Some changes aren't backwards compatible. Those are indicated with a (!)
  symbol.
  
+ *) WireSim: Added threadcount to the zlib settings, for deflating and inflating
+ large images in pieces on multiple threads, and the private dfIX chunk.
+ *) WireSim: Added fastmatching to the compress settings. Fixed dynamic blocks
+ without LZ77 writing out of bounds past the first block.
+ *) WireSim: Added lodepng_decode_rows, which inflates one deflate block at a
+ time and hands out scanlines as they complete, and error 91.
  *) 09 jun 2014: Faster encoder by fixing hash bug and more zeros optimization.
  *) 22 dec 2013: Power of two windowsize required for optimization.
  *) 15 apr 2013: Fixed bug with LAC_ALPHA and color key.